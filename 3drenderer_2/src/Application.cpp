@@ -1,13 +1,22 @@
 #include "Application.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <vector>
 
-#include <tracy/tracy/Tracy.hpp>
-
+#include "Controller/InputRecording.h"
 #include "Controller/PlayerController.h"
 #include "GUI/GUI.h"
+#include "Graphics/Graphics.h"
 #include "Logger/Logger.h"
+#include "Renderer/FrameCapture.h"
 #include "Renderer/Renderer.h"
+#include "Utils/CycleCounters.h"
+#include "Utils/FrameTimings.h"
+#include "Utils/PipelineStats.h"
+#include "Utils/TraceRecorder.h"
+#include "Utils/UnitTests.h"
 #include "Viewport/Viewport.h"
 #include "Window/Window.h"
 #include "World/World.h"
@@ -35,11 +44,242 @@ Application::~Application()
 	std::cout << "Application destructor called.\n";
 }
 
+bool Application::parse_arguments(int argc, char* args[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string argument = args[i];
+		const bool has_value = i + 1 < argc;
+		if (argument == "--headless")
+		{
+			headless = true;
+		}
+		else if (argument == "--frames" && has_value)
+		{
+			num_frames = std::max(atoi(args[++i]), 1);
+			benchmark_options.num_frames = num_frames;
+		}
+		else if (argument == "--output" && has_value)
+		{
+			output_filename = args[++i];
+		}
+		else if (argument == "--width" && has_value)
+		{
+			viewport->width = std::max(atoi(args[++i]), 1);
+		}
+		else if (argument == "--height" && has_value)
+		{
+			viewport->height = std::max(atoi(args[++i]), 1);
+		}
+		else if (argument == "--benchmark")
+		{
+			benchmark = true;
+		}
+		else if (argument == "--microbench")
+		{
+			microbenchmark = true;
+			headless = true;
+		}
+		else if (argument == "--test")
+		{
+			unit_tests = true;
+			headless = true;
+		}
+		else if (argument == "--regression" || argument == "--update-golden")
+		{
+			regression = true;
+			headless = true;
+			regression_options.update_golden = argument == "--update-golden";
+		}
+		else if (argument == "--capture" && has_value)
+		{
+			capture_filename = args[++i];
+		}
+		else if (argument == "--replay" && has_value)
+		{
+			replay_filename = args[++i];
+			headless = true;
+		}
+		else if (argument == "--record-input" && has_value)
+		{
+			input_recorder = std::make_unique<InputRecorder>();
+			if (!input_recorder->open(args[++i]))
+			{
+				return false;
+			}
+		}
+		else if (argument == "--replay-input" && has_value)
+		{
+			input_player = std::make_unique<InputPlayer>();
+			if (!input_player->load(args[++i]))
+			{
+				return false;
+			}
+		}
+		else if (argument == "--counters" && has_value)
+		{
+#ifdef PROFILING_ON
+			counters_filename = args[++i];
+#else
+			std::cerr << "This build has no cycle counters, --counters needs one built with PROFILING_ON.\n";
+			return false;
+#endif
+		}
+		else if (argument == "--trace" && has_value)
+		{
+			trace_options.filename = args[++i];
+		}
+		else if (argument == "--trace-start" && has_value)
+		{
+			trace_options.first_frame = std::max(atoi(args[++i]), 0);
+		}
+		else if (argument == "--trace-frames" && has_value)
+		{
+			trace_options.num_frames = std::max(atoi(args[++i]), 1);
+		}
+		else if (argument == "--trace-buffer" && has_value)
+		{
+			trace_options.events_per_thread = std::max(atoi(args[++i]), 1);
+		}
+		else if (argument == "--trace-detail" && has_value && parse_trace_detail(args[i + 1], trace_options.detail))
+		{
+			i++;
+		}
+		else if (argument == "--golden" && has_value)
+		{
+			regression_options.golden_directory = args[++i];
+		}
+		else if (argument == "--tolerance" && has_value)
+		{
+			regression_options.tolerance = std::max(atoi(args[++i]), 0);
+		}
+		else if (argument == "--perf-threshold" && has_value)
+		{
+			regression_options.perf_threshold = (float)std::max(atof(args[++i]), 0.0) / 100.0f;
+		}
+		else if (argument == "--filter" && has_value)
+		{
+			microbenchmark_options.filter = args[++i];
+			test_filter = microbenchmark_options.filter;
+		}
+		else if (argument == "--min-time" && has_value)
+		{
+			microbenchmark_options.min_seconds = std::max(atof(args[++i]), 0.0);
+		}
+		else if (argument == "--models" && has_value)
+		{
+			// Comma separated
+			std::string models = args[++i];
+			size_t start = 0;
+			while (start <= models.size())
+			{
+				const size_t end = std::min(models.find(',', start), models.size());
+				if (end > start)
+				{
+					benchmark_options.models.push_back(models.substr(start, end - start));
+				}
+				start = end + 1;
+			}
+		}
+		else if (argument == "--warmup" && has_value)
+		{
+			benchmark_options.warmup_frames = std::max(atoi(args[++i]), 0);
+		}
+		else if (argument == "--threads" && has_value)
+		{
+			benchmark_options.num_threads = std::max(atoi(args[++i]), 0);
+		}
+		else if (argument == "--render-mode" && has_value && parse_render_mode(args[i + 1], benchmark_options.render_mode))
+		{
+			i++;
+		}
+		else if (argument == "--shading-mode" && has_value && parse_shading_mode(args[i + 1], benchmark_options.shading_mode))
+		{
+			i++;
+		}
+		else if (argument == "--texture-format" && has_value && parse_texture_format(args[i + 1], benchmark_options.texture_format))
+		{
+			i++;
+		}
+		else if (argument == "--json" && has_value)
+		{
+			benchmark_options.json_filename = args[++i];
+			microbenchmark_options.json_filename = benchmark_options.json_filename;
+		}
+		else if (argument == "--csv" && has_value)
+		{
+			benchmark_options.csv_filename = args[++i];
+			microbenchmark_options.csv_filename = benchmark_options.csv_filename;
+		}
+		else
+		{
+			std::cerr << "Unknown option " << argument << ".\n"
+					  << "Usage: " << args[0] << " [options]\n"
+					  << "  --headless         render without a window\n"
+					  << "  --frames <n>       frames to render headless (1) or to measure (500)\n"
+					  << "  --output <file>    write the last headless frame to a PPM image\n"
+					  << "  --width <pixels>   size of the framebuffer\n"
+					  << "  --height <pixels>\n"
+					  << "  --benchmark        fly around the scene uncapped and report frame times\n"
+					  << "  --models <a,b,..>  OBJ files to benchmark instead of the starting level\n"
+					  << "  --warmup <n>       frames rendered before measuring (10)\n"
+					  << "  --threads <n>      threads of every stage\n"
+					  << "  --render-mode <vertices|wireframe|wireframe_vertices|solid|solid_wireframe|textured|textured_wireframe|\n"
+					  << "                      depth|overdraw|depth_rejections|tile_time|tile_triangles>\n"
+					  << "  --shading-mode <none|flat|gouraud>\n"
+					  << "  --texture-format <argb8888|bc1|bc3>\n"
+					  << "  --microbench       time the clipper, transform, rasterizer and clear kernels on their own\n"
+					  << "  --filter <name>    only the microbenchmarks or tests whose name contains it\n"
+					  << "  --min-time <s>     seconds spent in each microbenchmark (0.25)\n"
+					  << "  --capture <file>   where F12 writes the next frame, or the last headless frame to\n"
+					  << "  --replay <file>    render a captured frame --frames times and report frame times\n"
+					  << "  --record-input <file>  record the input of every frame\n"
+					  << "  --replay-input <file>  drive the application from a recording, one recorded frame per frame\n"
+					  << "  --counters <file>  write the cycle counters of the last frame and the whole run as JSON (PROFILING_ON builds only)\n"
+					  << "  --trace <file>     write the profiler zones of a few frames as a Chrome trace\n"
+					  << "  --trace-start <n>  first traced frame (0)\n"
+					  << "  --trace-frames <n> frames traced (5)\n"
+					  << "  --trace-detail <function|triangle>  also trace a zone per drawn and clipped triangle\n"
+					  << "  --trace-buffer <n> events kept per thread, the oldest are overwritten (131072)\n"
+					  << "  --test             run the unit tests of the modules\n"
+					  << "  --regression       compare renders of every model against the reference images and timings\n"
+					  << "  --update-golden    render the reference images and timings instead\n"
+					  << "  --golden <dir>     where the references are kept (assets/golden)\n"
+					  << "  --tolerance <n>    largest difference of a color channel that still matches (8)\n"
+					  << "  --perf-threshold <percent>  slowdown of a model that fails the regression (25)\n"
+					  << "  --json <file>      write the benchmark results as JSON\n"
+					  << "  --csv <file>       write the benchmark results as CSV\n";
+			return false;
+		}
+	}
+
+	// The framebuffer takes the size of the captured frame
+	if (!replay_filename.empty())
+	{
+		replay_capture = std::make_unique<FrameCapture>();
+		if (!load_frame_capture(replay_filename.c_str(), *replay_capture))
+		{
+			return false;
+		}
+		viewport->width = replay_capture->width;
+		viewport->height = replay_capture->height;
+	}
+	return true;
+}
+
 void Application::initialize()
 {
-	window->initialize(viewport.get()); // Initializes SDL and the SDL window and renderer
-	gui->initialize(window.get(), world.get()); // Creates the ImGui context and sets up for SDL
+	if (!headless)
+	{
+		window->initialize(viewport.get()); // Initializes SDL and the SDL window and renderer
+		gui->initialize(window.get(), world.get()); // Creates the ImGui context and sets up for SDL
+	}
 	renderer->initialize(window.get(), viewport.get(), world.get()); // Initializes the framebuffer and z buffer and assigns to the renderer the viewport, window and world pointers
+	if (!capture_filename.empty())
+	{
+		renderer->capture_filename = capture_filename;
+	}
+	start_trace(trace_options);
 
 	running = true;
 }
@@ -52,8 +292,42 @@ void Application::setup() const
 
 void Application::run()
 {
-	setup();
+	if (unit_tests)
+	{
+		exit_code = run_unit_tests(test_filter) ? 0 : 1;
+		return;
+	}
+	if (replay_capture)
+	{
+		run_replay();
+		return;
+	}
+	if (regression)
+	{
+		exit_code = run_regression(*this, regression_options) ? 0 : 1;
+		return;
+	}
+	if (microbenchmark)
+	{
+		run_microbenchmarks(*viewport, microbenchmark_options);
+		return;
+	}
+	if (benchmark)
+	{
+		run_benchmark(*this, benchmark_options);
+		return;
+	}
+	if (headless)
+	{
+		run_headless();
+		return;
+	}
 
+	setup();
+	if (input_recorder || input_player)
+	{
+		world->wait_for_assets();
+	}
 
 	SDL_DisplayMode display_mode;
 	SDL_GetCurrentDisplayMode(0, &display_mode);
@@ -70,9 +344,12 @@ void Application::run()
 	while (running)
 	{
 		start = SDL_GetPerformanceCounter();
-		input();
-		update();
-		render();
+		{
+			TIMED_BLOCK("Frame loop");
+			input();
+			update();
+			render();
+		}
 		FrameMark; // for tracy
 		end = SDL_GetPerformanceCounter();
 
@@ -96,20 +373,108 @@ void Application::run()
 	}
 }
 
+void Application::run_headless()
+{
+	setup();
+
+	// Nothing moves the camera without input, unless a recording is replayed,
+	// and every frame should show the whole scene rather than the placeholders
+	// of meshes still loading
+	if (!input_player)
+	{
+		world->camera.input_mode = INPUT_DISABLED;
+	}
+	world->wait_for_assets();
+
+	// A replayed recording decides how many frames there are
+	const int frames = input_player ? (int)input_player->frames.size() : num_frames;
+	for (int i = 0; i < frames && running; i++)
+	{
+		renderer->capture_next_frame = i == frames - 1 && !capture_filename.empty();
+		if (input_player)
+		{
+			input();
+		}
+		update();
+		render();
+		FrameMark; // for tracy
+	}
+
+	if (!output_filename.empty() && save_framebuffer_ppm(output_filename.c_str()))
+	{
+		std::cout << "Saved the frame to " << output_filename << "\n";
+	}
+}
+
+void Application::run_replay()
+{
+	::run_replay(*this, *replay_capture, benchmark_options);
+
+	if (!output_filename.empty() && save_framebuffer_ppm(output_filename.c_str()))
+	{
+		std::cout << "Saved the frame to " << output_filename << "\n";
+	}
+}
+
 void Application::destroy() const
 {
+	if (!counters_filename.empty())
+	{
+		// The last frame, up to now
+		snapshot_cycle_counters();
+		write_cycle_counters_json(counters_filename.c_str());
+	}
+	finish_trace();
+	if (input_recorder)
+	{
+		input_recorder->close();
+	}
+	if (input_player)
+	{
+		input_player->report();
+	}
+
 	renderer->destroy(); // Frees the framebuffer, z buffer and framebuffer SDL texture
-	GUI::destroy(); // Destroys the imgui SDL context
-	window->destroy(); // Destroys SDL window, renderer and SDL itself
+	if (!headless)
+	{
+		GUI::destroy(); // Destroys the imgui SDL context
+		window->destroy(); // Destroys SDL window, renderer and SDL itself
+	}
 }
 
 void Application::input()
 {
 	ZoneScoped; // for tracy
+	TIMED_BLOCK("Input");
 
-	SDL_Event event;
+	// The events and mouse motion of this frame, live or from the recording
+	// being replayed
+	std::vector<SDL_Event> events;
+	glm::ivec2 mouse_delta(0);
+	if (input_player)
+	{
+		if (!input_player->begin_frame(events, mouse_delta))
+		{
+			running = false;
+			return;
+		}
+	}
+	else if (!headless)
+	{
+		SDL_Event event;
+		while (SDL_PollEvent(&event))
+		{
+			events.push_back(event);
+		}
+		SDL_GetRelativeMouseState(&mouse_delta.x, &mouse_delta.y);
+	}
+	if (input_recorder)
+	{
+		input_recorder->begin_frame(events, mouse_delta);
+	}
+	world->camera.mouse_delta = mouse_delta;
 
-	while (SDL_PollEvent(&event))
+	for (SDL_Event& event : events)
 	{
 		// NOTE: Not for this engine, but potentially for future engines, use
 		// different switch statements for different control schemes? Maybe the
@@ -135,7 +500,10 @@ void Application::input()
 			}
 		}
 		// Imgui SDL input handling
-		gui->process_input(event);
+		if (!headless)
+		{
+			gui->process_input(event);
+		}
 		// Player controller SDL input handling
 		controller->process_input(event);
 	}
@@ -143,12 +511,39 @@ void Application::input()
 
 void Application::update() const
 {
+	begin_trace_frame();
+	snapshot_cycle_counters();
+	reset_frame_timings();
+	reset_pipeline_stats();
+	TIMED_BLOCK("Update");
+
+	// Meshlets facing away from the camera are only thrown out when the
+	// renderer would cull their triangles anyway
+	world->backface_culling = renderer->backface_culling;
 	world->update();
+
+	if (input_recorder || input_player)
+	{
+		const InputFrameState state = get_input_frame_state(world->camera, world->light);
+		if (input_recorder)
+		{
+			input_recorder->end_frame(state);
+		}
+		if (input_player)
+		{
+			input_player->end_frame(state);
+		}
+	}
 }
 
 void Application::render() const
 {
+	TIMED_BLOCK("Render");
 	renderer->render();
-	gui->render();
-	Renderer::display_frame();
+	if (!headless)
+	{
+		log_cycle_counters();
+		gui->render();
+		Renderer::display_frame();
+	}
 }
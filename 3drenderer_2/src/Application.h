@@ -1,8 +1,17 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
+#include "Benchmark/Benchmark.h"
+#include "Benchmark/Microbenchmark.h"
+#include "Benchmark/Regression.h"
+#include "Utils/TraceRecorder.h"
+
+struct FrameCapture;
 struct GUI;
+struct InputPlayer;
+struct InputRecorder;
 struct PlayerController;
 struct Renderer;
 struct Viewport;
@@ -60,9 +69,81 @@ struct Application
 
 	bool running = false;
 
+	/**
+	 * Renders without a window, for machines without a display. SDL video,
+	 * ImGui and vsync are left out entirely and every frame stays in the
+	 * framebuffer, see get_framebuffer(). run() then renders num_frames frames
+	 * as fast as it can once every mesh has loaded, and writes the last one to
+	 * output_filename as a PPM image if one is given
+	 */
+	bool headless = false;
+	int num_frames = 1;
+	std::string output_filename;
+
+	/** Runs run_benchmark() instead of the interactive loop, with or without a window */
+	bool benchmark = false;
+	BenchmarkOptions benchmark_options;
+
+	/** Runs run_microbenchmarks() instead, always headless */
+	bool microbenchmark = false;
+	MicrobenchmarkOptions microbenchmark_options;
+
+	/** Runs run_regression() instead, always headless */
+	bool regression = false;
+	RegressionOptions regression_options;
+
+	/** Runs run_unit_tests() instead, always headless */
+	bool unit_tests = false;
+	std::string test_filter;
+
+	/**
+	 * Where F12 writes the next frame to, or where the last headless frame is
+	 * written to if given
+	 */
+	std::string capture_filename;
+
+	/**
+	 * Renders the frame captured in replay_filename over and over with
+	 * run_replay() instead, always headless and at the size of the capture
+	 */
+	std::string replay_filename;
+	std::unique_ptr<FrameCapture> replay_capture;
+
+	/**
+	 * Records the input of every frame to a file, or drives the application
+	 * from such a recording in place of live input, see InputRecorder and
+	 * InputPlayer. Both start once the starting assets have loaded, so the
+	 * recorded session and its replays begin from the same state. Replaying
+	 * headless renders one frame per recorded frame
+	 */
+	std::unique_ptr<InputRecorder> input_recorder;
+	std::unique_ptr<InputPlayer> input_player;
+
+	/**
+	 * Where the cycle counters are written as JSON on exit, see TIMED_BLOCK.
+	 * Only builds with PROFILING_ON accept --counters
+	 */
+	std::string counters_filename;
+
+	/**
+	 * The frames written as a Chrome trace, see TraceRecorder.h. Works in every
+	 * mode, without a Tracy server
+	 */
+	TraceOptions trace_options;
+
+	/** Returned by main(), non-zero when the regression tests fail */
+	int exit_code = 0;
+
+	/**
+	 * Reads the command line options into the fields above and the viewport.
+	 * Prints the usage and returns false if they can't be read
+	 */
+	bool parse_arguments(int argc, char* args[]);
 	void initialize();
 	void setup() const;
 	void run();
+	void run_headless();
+	void run_replay();
 
 	void input();
 	void update() const;
@@ -0,0 +1,409 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/trigonometric.hpp>
+#include <omp.h>
+
+#include "../Application.h"
+#include "../Mesh/Mesh.h"
+#include "../Renderer/FrameCapture.h"
+#include "../Renderer/Renderer.h"
+#include "../Utils/FrameTimings.h"
+#include "../Utils/PipelineStats.h"
+#include "../Utils/TraceRecorder.h"
+#include "../Viewport/Viewport.h"
+#include "../World/World.h"
+
+constexpr const char* RENDER_MODE_NAMES[] = {
+	"vertices",
+	"wireframe",
+	"wireframe_vertices",
+	"solid",
+	"solid_wireframe",
+	"textured",
+	"textured_wireframe",
+	"depth",
+	"overdraw",
+	"depth_rejections",
+	"tile_time",
+	"tile_triangles",
+};
+constexpr const char* SHADING_MODE_NAMES[] = { "none", "flat", "gouraud" };
+constexpr const char* TEXTURE_FORMAT_NAMES[] = { "argb8888", "bc1", "bc3" };
+
+template <typename T, size_t N>
+static bool parse_name(const std::string& name, const char* const (&names)[N], T& value)
+{
+	for (size_t i = 0; i < N; i++)
+	{
+		if (name == names[i])
+		{
+			value = (T)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool parse_render_mode(const std::string& name, ERenderMode& mode)
+{
+	return parse_name(name, RENDER_MODE_NAMES, mode);
+}
+
+bool parse_shading_mode(const std::string& name, EShadingMode& mode)
+{
+	return parse_name(name, SHADING_MODE_NAMES, mode);
+}
+
+bool parse_texture_format(const std::string& name, ETextureFormat& format)
+{
+	return parse_name(name, TEXTURE_FORMAT_NAMES, format);
+}
+
+const char* get_render_mode_name(ERenderMode mode)
+{
+	return RENDER_MODE_NAMES[mode];
+}
+
+const char* get_shading_mode_name(EShadingMode mode)
+{
+	return SHADING_MODE_NAMES[mode];
+}
+
+struct StageStats
+{
+	double mean;
+	double p50;
+	double p95;
+	double p99;
+};
+
+/** Nearest rank percentiles */
+static StageStats get_stats(std::vector<double>& samples)
+{
+	StageStats stats = {};
+	if (samples.empty())
+	{
+		return stats;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	double sum = 0.0;
+	for (const double sample : samples)
+	{
+		sum += sample;
+	}
+	auto percentile = [&samples](double p)
+	{
+		const size_t rank = (size_t)ceil(p * (double)samples.size());
+		return samples[std::clamp(rank, (size_t)1, samples.size()) - 1];
+	};
+
+	stats.mean = sum / (double)samples.size();
+	stats.p50 = percentile(0.50);
+	stats.p95 = percentile(0.95);
+	stats.p99 = percentile(0.99);
+	return stats;
+}
+
+/**
+ * Prints the statistics of each stage and of the whole frame, and writes them
+ * to the JSON and CSV files of the options. samples holds the milliseconds of
+ * every measured frame, one vector per stage followed by one for the total.
+ * The pipeline counters summed over the measured frames are reported per frame,
+ * in the console and the JSON file
+ */
+static void report_frame_times(
+	const BenchmarkOptions& options,
+	int width,
+	int height,
+	std::vector<std::vector<double>>& samples,
+	const PipelineStats& pipeline_totals
+)
+{
+	std::vector<StageStats> stats;
+	for (std::vector<double>& stage_samples : samples)
+	{
+		stats.push_back(get_stats(stage_samples));
+	}
+	auto get_name = [](int stage) { return stage < NUM_FRAME_STAGES ? FRAME_STAGE_NAMES[stage] : "total"; };
+	const int num_measured = (int)samples[NUM_FRAME_STAGES].size();
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << std::left << std::setw(16) << "stage" << std::right
+			  << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << "  (ms)\n";
+	for (int stage = 0; stage <= NUM_FRAME_STAGES; stage++)
+	{
+		std::cout << std::left << std::setw(16) << get_name(stage) << std::right
+				  << std::setw(10) << stats[stage].mean << std::setw(10) << stats[stage].p50
+				  << std::setw(10) << stats[stage].p95 << std::setw(10) << stats[stage].p99 << "\n";
+	}
+
+	const double frames = (double)std::max(num_measured, 1);
+	uint64 num_sized = 0;
+	for (const uint64 count : pipeline_totals.triangle_sizes)
+	{
+		num_sized += count;
+	}
+	std::cout << "\n" << std::left << std::setw(28) << "counter" << std::right << std::setw(14) << "per frame" << "\n";
+	for (int counter = 0; counter < NUM_PIPELINE_COUNTERS; counter++)
+	{
+		std::cout << std::left << std::setw(28) << PIPELINE_COUNTER_NAMES[counter] << std::right
+				  << std::setw(14) << std::setprecision(1) << (double)pipeline_totals.counters[counter] / frames << "\n";
+	}
+	std::cout << std::left << std::setw(28) << "overdraw" << std::right << std::setw(14) << std::setprecision(3) << pipeline_totals.get_overdraw() << "\n";
+	std::cout << "triangle sizes (pixels):";
+	for (int bucket = 0; bucket < NUM_TRIANGLE_SIZE_BUCKETS; bucket++)
+	{
+		if (pipeline_totals.triangle_sizes[bucket] > 0)
+		{
+			std::cout << " " << get_triangle_size_bucket_name(bucket) << ": " << std::setprecision(1)
+					  << 100.0 * (double)pipeline_totals.triangle_sizes[bucket] / (double)num_sized << "%";
+		}
+	}
+	std::cout << "\n" << std::setprecision(3);
+
+	if (!options.csv_filename.empty())
+	{
+		std::ofstream csv(options.csv_filename);
+		csv << std::fixed << std::setprecision(4);
+		csv << "stage,mean_ms,p50_ms,p95_ms,p99_ms\n";
+		for (int stage = 0; stage <= NUM_FRAME_STAGES; stage++)
+		{
+			csv << get_name(stage) << "," << stats[stage].mean << "," << stats[stage].p50 << "," << stats[stage].p95 << "," << stats[stage].p99 << "\n";
+		}
+		if (!csv)
+		{
+			std::cerr << "Failed to write " << options.csv_filename << ".\n";
+		}
+	}
+
+	if (!options.json_filename.empty())
+	{
+		std::ofstream json(options.json_filename);
+		json << std::fixed << std::setprecision(4);
+		json << "{\n";
+		json << "  \"frames\": " << num_measured << ",\n";
+		json << "  \"width\": " << width << ",\n";
+		json << "  \"height\": " << height << ",\n";
+		json << "  \"threads\": " << (options.num_threads > 0 ? options.num_threads : omp_get_max_threads()) << ",\n";
+		json << "  \"render_mode\": \"" << get_render_mode_name(options.render_mode) << "\",\n";
+		json << "  \"shading_mode\": \"" << get_shading_mode_name(options.shading_mode) << "\",\n";
+		json << "  \"texture_format\": \"" << TEXTURE_FORMAT_NAMES[options.texture_format] << "\",\n";
+		json << "  \"models\": [";
+		for (size_t i = 0; i < options.models.size(); i++)
+		{
+			json << (i > 0 ? ", " : "") << "\"" << options.models[i] << "\"";
+		}
+		json << "],\n";
+		json << "  \"stages_ms\": {\n";
+		for (int stage = 0; stage <= NUM_FRAME_STAGES; stage++)
+		{
+			json << "    \"" << get_name(stage) << "\": { \"mean\": " << stats[stage].mean << ", \"p50\": " << stats[stage].p50
+				 << ", \"p95\": " << stats[stage].p95 << ", \"p99\": " << stats[stage].p99 << " }"
+				 << (stage < NUM_FRAME_STAGES ? "," : "") << "\n";
+		}
+		json << "  },\n";
+		json << "  \"pipeline_per_frame\": {\n";
+		for (int counter = 0; counter < NUM_PIPELINE_COUNTERS; counter++)
+		{
+			json << "    \"" << PIPELINE_COUNTER_NAMES[counter] << "\": " << (double)pipeline_totals.counters[counter] / frames << ",\n";
+		}
+		json << "    \"overdraw\": " << pipeline_totals.get_overdraw() << "\n";
+		json << "  },\n";
+		json << "  \"triangle_sizes_per_frame\": {\n";
+		for (int bucket = 0; bucket < NUM_TRIANGLE_SIZE_BUCKETS; bucket++)
+		{
+			json << "    \"" << get_triangle_size_bucket_name(bucket) << "\": " << (double)pipeline_totals.triangle_sizes[bucket] / frames
+				 << (bucket < NUM_TRIANGLE_SIZE_BUCKETS - 1 ? "," : "") << "\n";
+		}
+		json << "  }\n";
+		json << "}\n";
+		if (!json)
+		{
+			std::cerr << "Failed to write " << options.json_filename << ".\n";
+		}
+	}
+}
+
+/**
+ * One orbit around the scene over the whole run. The camera also moves in and
+ * out twice, so the levels of detail change along the way
+ */
+static void place_camera(Camera& camera, const glm::vec3& center, float radius, int frame, int num_frames)
+{
+	const float t = (float)frame / (float)std::max(num_frames, 1);
+	const float angle = t * 2.0f * glm::pi<float>();
+	const float distance = radius * (2.2f + 1.2f * cosf(2.0f * angle));
+	const glm::vec3 eye = center + glm::vec3(cosf(angle) * distance, radius * 0.6f, sinf(angle) * distance);
+	const glm::vec3 direction = glm::normalize(center - eye);
+
+	camera.translation = eye;
+	camera.rotation.yaw = glm::degrees(atan2f(direction.z, direction.x));
+	camera.rotation.pitch = glm::degrees(asinf(direction.y));
+}
+
+void run_benchmark(Application& app, const BenchmarkOptions& options)
+{
+	World& world = *app.world;
+	Renderer& renderer = *app.renderer;
+
+	if (options.num_threads > 0)
+	{
+		omp_set_num_threads(options.num_threads);
+		renderer.num_threads = options.num_threads;
+	}
+	world.texture_options.format = options.texture_format;
+	renderer.render_mode = options.render_mode;
+	renderer.shading_mode = options.shading_mode;
+
+	app.setup();
+	world.camera.input_mode = INPUT_DISABLED;
+
+	// Line the models up along the x axis, in place of the starting level
+	if (!options.models.empty())
+	{
+		world.wait_for_assets();
+		world.spawn_crowd(nullptr, 0);
+		float x = 0.0f;
+		for (const std::string& filename : options.models)
+		{
+			std::unique_ptr<Mesh> mesh = create_mesh(filename.c_str(), world.texture_options);
+			if (mesh->triangles.empty())
+			{
+				std::cerr << "Failed to load " << filename << " for the benchmark.\n";
+				continue;
+			}
+			x += mesh->bounds_radius;
+			world.entities.create(mesh.get(), glm::vec3(x, 0.0f, 0.0f) - mesh->bounds_center);
+			x += mesh->bounds_radius * 1.5f;
+			world.add_mesh(std::move(mesh));
+		}
+	}
+	world.wait_for_assets();
+
+	// Orbit the bounds of everything placed
+	world.entities.update_transforms();
+	glm::vec3 min_p(FLT_MAX);
+	glm::vec3 max_p(-FLT_MAX);
+	for (int i = 0; i < world.entities.size(); i++)
+	{
+		if (world.entities.meshes[i])
+		{
+			const glm::vec3 center = world.entities.get_bounds_center(i);
+			min_p = glm::min(min_p, center - world.entities.radius[i]);
+			max_p = glm::max(max_p, center + world.entities.radius[i]);
+		}
+	}
+	if (min_p.x > max_p.x)
+	{
+		min_p = glm::vec3(-1.0f);
+		max_p = glm::vec3(1.0f);
+	}
+	const glm::vec3 center = (min_p + max_p) * 0.5f;
+	const float radius = std::max(glm::length(max_p - center), 0.1f);
+
+	// Keep the whole scene between the clipping planes at the farthest point
+	// of the orbit
+	world.camera.zfar = std::max(world.camera.zfar, radius * 6.0f);
+	world.camera.set_projection(PERSPECTIVE);
+
+	std::cout << "Benchmarking " << options.num_frames << " frames at " << app.viewport->width << "x" << app.viewport->height << "\n";
+
+	std::vector<std::vector<double>> samples(NUM_FRAME_STAGES + 1);
+	PipelineStats pipeline_totals;
+	const int total_frames = options.warmup_frames + options.num_frames;
+	for (int i = 0; i < total_frames; i++)
+	{
+		if (!app.headless)
+		{
+			app.input();
+			if (!app.running)
+			{
+				break;
+			}
+		}
+
+		const int frame = std::max(i - options.warmup_frames, 0);
+		place_camera(world.camera, center, radius, frame, options.num_frames);
+
+		const auto start = std::chrono::steady_clock::now();
+		app.update();
+		app.render();
+		const auto end = std::chrono::steady_clock::now();
+
+		if (i >= options.warmup_frames)
+		{
+			for (int stage = 0; stage < NUM_FRAME_STAGES; stage++)
+			{
+				samples[stage].push_back(frame_stage_ms[stage]);
+			}
+			samples[NUM_FRAME_STAGES].push_back(std::chrono::duration<double, std::milli>(end - start).count());
+			pipeline_totals.add(frame_pipeline_stats);
+		}
+	}
+
+	report_frame_times(options, app.viewport->width, app.viewport->height, samples, pipeline_totals);
+}
+
+void run_replay(Application& app, const FrameCapture& capture, const BenchmarkOptions& options)
+{
+	World& world = *app.world;
+	Renderer& renderer = *app.renderer;
+
+	if (options.num_threads > 0)
+	{
+		omp_set_num_threads(options.num_threads);
+		renderer.num_threads = options.num_threads;
+	}
+	renderer.render_mode = capture.render_mode;
+	renderer.shading_mode = capture.shading_mode;
+	renderer.texture_filter = capture.texture_filter;
+	renderer.backface_culling = capture.backface_culling;
+	world.camera.projection_matrix = capture.projection_matrix;
+
+	std::cout << "Replaying " << capture.triangles.size() << " triangles and " << capture.lines.size() << " lines "
+			  << options.num_frames << " times at " << capture.width << "x" << capture.height << "\n";
+
+	std::vector<std::vector<double>> samples(NUM_FRAME_STAGES + 1);
+	PipelineStats pipeline_totals;
+	const int total_frames = options.warmup_frames + options.num_frames;
+	for (int i = 0; i < total_frames; i++)
+	{
+		// The renderer consumes the triangles and lines of the frame
+		world.triangles_in_scene = capture.triangles;
+		world.lines_in_scene = capture.lines;
+		begin_trace_frame();
+		reset_frame_timings();
+		reset_pipeline_stats();
+
+		const auto start = std::chrono::steady_clock::now();
+		renderer.render();
+		const auto end = std::chrono::steady_clock::now();
+		FrameMark; // for tracy
+
+		if (i >= options.warmup_frames)
+		{
+			for (int stage = 0; stage < NUM_FRAME_STAGES; stage++)
+			{
+				samples[stage].push_back(frame_stage_ms[stage]);
+			}
+			samples[NUM_FRAME_STAGES].push_back(std::chrono::duration<double, std::milli>(end - start).count());
+			pipeline_totals.add(frame_pipeline_stats);
+		}
+	}
+
+	BenchmarkOptions replay_options = options;
+	replay_options.render_mode = capture.render_mode;
+	replay_options.shading_mode = capture.shading_mode;
+	report_frame_times(replay_options, capture.width, capture.height, samples, pipeline_totals);
+}
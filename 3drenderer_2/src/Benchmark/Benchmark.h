@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../Mesh/Texture.h"
+#include "../Renderer/RenderMode.h"
+#include "../Renderer/ShadingMode.h"
+
+struct Application;
+struct FrameCapture;
+
+struct BenchmarkOptions
+{
+	std::vector<std::string> models; // OBJ files placed side by side, the starting level if empty
+	int num_frames = 500; // measured
+	int warmup_frames = 10; // rendered before measuring
+	int num_threads = 0; // OpenMP threads of every stage, 0 keeps the defaults
+	ERenderMode render_mode = TEXTURED;
+	EShadingMode shading_mode = GOURAUD;
+	ETextureFormat texture_format = TEXTURE_FORMAT_ARGB8888;
+	std::string json_filename; // results, not written if empty
+	std::string csv_filename;
+};
+
+/**
+ * Renders the models uncapped while the camera flies a fixed orbit around
+ * them, then reports the mean, median, 95th and 99th percentile of the time
+ * spent in each stage of the frame (see EFrameStage) and in the whole frame.
+ * The orbit only depends on the bounds of the models and the frame number, so
+ * runs on different builds and machines render the same frames
+ */
+void run_benchmark(Application& app, const BenchmarkOptions& options);
+
+/**
+ * Renders the captured frame over and over, straight from its triangles and
+ * lines, and reports the same statistics as run_benchmark(). Only the thread
+ * count, the frame counts and the output files of the options are used, the
+ * rest comes from the capture. The framebuffer has to be the size of the
+ * capture
+ */
+void run_replay(Application& app, const FrameCapture& capture, const BenchmarkOptions& options);
+
+/** Parse the names used on the command line, false if the name is unknown */
+bool parse_render_mode(const std::string& name, ERenderMode& mode);
+bool parse_shading_mode(const std::string& name, EShadingMode& mode);
+bool parse_texture_format(const std::string& name, ETextureFormat& format);
+const char* get_render_mode_name(ERenderMode mode);
+const char* get_shading_mode_name(EShadingMode mode);
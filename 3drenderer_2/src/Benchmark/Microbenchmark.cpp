@@ -0,0 +1,463 @@
+#include "Microbenchmark.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/constants.hpp>
+
+#include "../Clipping/Clipper.h"
+#include "../Graphics/Graphics.h"
+#include "../Math/Math3D.h"
+#include "../Mesh/Texture.h"
+#include "../Triangle/Triangle.h"
+#include "../Utils/Colors.h"
+#include "../Viewport/Viewport.h"
+
+struct MicrobenchmarkResult
+{
+	std::string kernel;
+	std::string input;
+	const char* item; // what ns_per_item counts
+	double ns_per_item;
+	double pixels_per_second; // 0 for the kernels that don't draw
+	double bytes_per_second;
+};
+
+/**
+ * Same numbers on every platform and standard library, unlike the std
+ * distributions
+ */
+struct Random
+{
+	std::mt19937 engine{ 1234 };
+
+	float next(float min, float max)
+	{
+		return min + (max - min) * (float)(engine() >> 8) * (1.0f / 16777216.0f);
+	}
+};
+
+/**
+ * Fastest of the runs, repeated until min_seconds have been spent in the
+ * kernel. reset() puts the input back in place between runs and isn't timed
+ */
+template <typename Reset, typename Kernel>
+static double measure(double min_seconds, Reset reset, Kernel kernel)
+{
+	double best = DBL_MAX;
+	double total = 0.0;
+	for (int run = 0; run < 3 || total < min_seconds; run++)
+	{
+		reset();
+		const auto start = std::chrono::steady_clock::now();
+		kernel();
+		const auto end = std::chrono::steady_clock::now();
+		const double seconds = std::chrono::duration<double>(end - start).count();
+		best = std::min(best, seconds);
+		total += seconds;
+	}
+	return best;
+}
+
+static MicrobenchmarkResult make_result(
+	const std::string& kernel,
+	const std::string& input,
+	const char* item,
+	double seconds,
+	double num_items,
+	double num_pixels,
+	double num_bytes
+)
+{
+	return { kernel, input, item, seconds * 1e9 / num_items, num_pixels / seconds, num_bytes / seconds };
+}
+
+/**
+ * Screen space triangles as the rasterizer gets them, fully inside the
+ * viewport and wound so their area is positive. Every triangle is in front of
+ * the ones before it, so each run draws all of their pixels
+ */
+static std::vector<Triangle> make_screen_triangles(
+	const Viewport& viewport,
+	int count,
+	float size,
+	float texture_size,
+	Random& random,
+	double& num_pixels
+)
+{
+	std::vector<Triangle> triangles(count);
+	num_pixels = 0.0;
+	const float margin = size + 1.0f;
+	for (int i = 0; i < count; i++)
+	{
+		Triangle& triangle = triangles[i];
+		const glm::vec2 center(
+			random.next(margin, (float)viewport.width - margin),
+			random.next(margin, (float)viewport.height - margin)
+		);
+		const float angle = random.next(0.0f, 2.0f * glm::pi<float>());
+		const float depth = 0.9f - 0.8f * (float)i / (float)count;
+		for (int j = 0; j < 3; j++)
+		{
+			const float vertex_angle = angle + (float)j * 2.0f * glm::pi<float>() / 3.0f;
+			const float radius = size * random.next(0.7f, 1.0f);
+			Vertex& vertex = triangle.vertices[j];
+			vertex.position = glm::vec4(center.x + cosf(vertex_angle) * radius, center.y + sinf(vertex_angle) * radius, depth, 1.0f);
+			// One texel per pixel on the largest level
+			vertex.uv = { vertex.position.x / texture_size, vertex.position.y / texture_size };
+			vertex.gouraud = random.next(0.3f, 1.0f);
+		}
+
+		glm::vec2 v0(triangle.vertices[0].position);
+		glm::vec2 v1(triangle.vertices[1].position);
+		const glm::vec2 v2(triangle.vertices[2].position);
+		float area2 = Math3D::orient2d_f(v0, v1, v2);
+		if (area2 < 0.0f)
+		{
+			std::swap(triangle.vertices[1], triangle.vertices[2]);
+			area2 = -area2;
+		}
+		num_pixels += area2 * 0.5f;
+
+		triangle.color = Colors::WHITE;
+		triangle.flat_value = random.next(0.3f, 1.0f);
+	}
+	return triangles;
+}
+
+/**
+ * Clip space triangles with w between 1 and 10. The given ratio of them
+ * straddles one of the side, near or far planes, the rest is inside all of them
+ */
+static std::vector<Triangle> make_clip_triangles(int count, float straddling_ratio, Random& random)
+{
+	std::vector<Triangle> triangles(count);
+	const int num_straddling = (int)((float)count * straddling_ratio);
+	for (int i = 0; i < count; i++)
+	{
+		const float w = random.next(1.0f, 10.0f);
+		glm::vec3 center(random.next(-0.8f, 0.8f) * w, random.next(-0.8f, 0.8f) * w, random.next(-0.8f, 0.8f) * w);
+		// Spread the straddling triangles evenly over the input
+		if ((long long)i * num_straddling / count != (long long)(i + 1) * num_straddling / count)
+		{
+			switch (i % 6)
+			{
+				case 0: center.x = w; break;
+				case 1: center.x = -w; break;
+				case 2: center.y = w; break;
+				case 3: center.y = -w; break;
+				case 4: center.z = -w; break;
+				case 5: center.z = w; break;
+			}
+		}
+
+		Triangle& triangle = triangles[i];
+		for (Vertex& vertex : triangle.vertices)
+		{
+			const glm::vec3 offset(random.next(-0.1f, 0.1f), random.next(-0.1f, 0.1f), random.next(-0.1f, 0.1f));
+			vertex.position = glm::vec4(center + offset * w, w);
+			vertex.uv = { random.next(0.0f, 1.0f), random.next(0.0f, 1.0f) };
+			vertex.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+			vertex.gouraud = 1.0f;
+		}
+		triangle.color = Colors::WHITE;
+		triangle.flat_value = 1.0f;
+	}
+	return triangles;
+}
+
+/** Checkerboard with a gradient, so neighbouring texels differ */
+static std::shared_ptr<Texture> make_texture(int size, ETextureFormat format)
+{
+	std::vector<uint32> pixels((size_t)size * size);
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			const uint32 checker = ((x >> 3) ^ (y >> 3)) & 1 ? 0xFF : 0x40;
+			pixels[(size_t)y * size + x] = 0xFF000000 | (checker << 16) | ((uint32)(x * 255 / size) << 8) | (uint32)(y * 255 / size);
+		}
+	}
+	TextureLoadOptions options;
+	options.format = format;
+	return create_texture(pixels.data(), size, size, size * (int)sizeof(uint32), options);
+}
+
+void run_microbenchmarks(const Viewport& viewport, const MicrobenchmarkOptions& options)
+{
+	std::vector<MicrobenchmarkResult> results;
+	auto is_enabled = [&options](const char* kernel)
+	{
+		return options.filter.empty() || std::string(kernel).find(options.filter) != std::string::npos;
+	};
+	auto report = [&results](const MicrobenchmarkResult& result)
+	{
+		results.push_back(result);
+		std::cout << std::left << std::setw(24) << result.kernel << std::setw(24) << result.input << std::right
+				  << std::fixed << std::setprecision(2) << std::setw(12) << result.ns_per_item << " ns/" << std::setw(8) << std::left << result.item
+				  << std::right << std::setw(12);
+		// Kernels that don't draw have no pixel rate rather than one of zero
+		if (result.pixels_per_second > 0.0)
+		{
+			std::cout << result.pixels_per_second * 1e-6;
+		}
+		else
+		{
+			std::cout << "-";
+		}
+		std::cout << " Mpixels/s" << std::setw(12) << result.bytes_per_second * 1e-9 << " GB/s\n";
+	};
+	auto no_reset = [] {};
+
+	const double min_seconds = options.min_seconds;
+	const double num_framebuffer_pixels = (double)viewport.width * viewport.height;
+	std::cout << "Microbenchmarks at " << viewport.width << "x" << viewport.height << ", fastest of runs over " << min_seconds << " s\n";
+
+	if (is_enabled("clear_framebuffer"))
+	{
+		const double seconds = measure(min_seconds, no_reset, [] { clear_framebuffer(Colors::BLACK); });
+		report(make_result("clear_framebuffer", "", "frame", seconds, 1.0, num_framebuffer_pixels, num_framebuffer_pixels * sizeof(uint32)));
+	}
+	if (is_enabled("clear_z_buffer"))
+	{
+		const double seconds = measure(min_seconds, no_reset, [] { clear_z_buffer(); });
+		report(make_result("clear_z_buffer", "", "frame", seconds, 1.0, num_framebuffer_pixels, num_framebuffer_pixels * sizeof(float)));
+	}
+
+	// Vertices are read and written back in place
+	constexpr int NUM_VERTICES = 1 << 20;
+	const glm::mat4 matrix = Math3D::create_world_matrix(glm::vec3(1.5f), rot3(30.0f, 45.0f, 10.0f), glm::vec3(1.0f, 2.0f, 3.0f));
+	if (is_enabled("transform_point"))
+	{
+		Random random;
+		std::vector<glm::vec4> source(NUM_VERTICES);
+		for (glm::vec4& point : source)
+		{
+			point = glm::vec4(random.next(-10.0f, 10.0f), random.next(-10.0f, 10.0f), random.next(-10.0f, 10.0f), 1.0f);
+		}
+		std::vector<glm::vec4> points;
+		const double seconds = measure(min_seconds,
+			[&] { points = source; },
+			[&]
+			{
+				for (glm::vec4& point : points)
+				{
+					Math3D::transform_point(point, matrix);
+				}
+			});
+		report(make_result("transform_point", "1M vertices", "vertex", seconds, NUM_VERTICES, 0.0, (double)NUM_VERTICES * 2 * sizeof(glm::vec4)));
+	}
+	if (is_enabled("rotate_normal"))
+	{
+		Random random;
+		std::vector<glm::vec3> source(NUM_VERTICES);
+		for (glm::vec3& normal : source)
+		{
+			normal = glm::vec3(random.next(-1.0f, 1.0f), random.next(-1.0f, 1.0f), random.next(-1.0f, 1.0f));
+		}
+		std::vector<glm::vec3> normals;
+		const double seconds = measure(min_seconds,
+			[&] { normals = source; },
+			[&]
+			{
+				for (glm::vec3& normal : normals)
+				{
+					Math3D::rotate_normal(normal, matrix);
+				}
+			});
+		report(make_result("rotate_normal", "1M normals", "vertex", seconds, NUM_VERTICES, 0.0, (double)NUM_VERTICES * 2 * sizeof(glm::vec3)));
+	}
+
+	if (is_enabled("clip_triangles"))
+	{
+		constexpr int NUM_CLIP_TRIANGLES = 1 << 16;
+		for (const float ratio : { 0.0f, 0.1f, 0.5f, 1.0f })
+		{
+			Random random;
+			const std::vector<Triangle> in_triangles = make_clip_triangles(NUM_CLIP_TRIANGLES, ratio, random);
+			std::vector<Triangle> out_triangles;
+			out_triangles.reserve(NUM_CLIP_TRIANGLES * 2);
+			const double seconds = measure(min_seconds, no_reset, [&] { clip_triangles(in_triangles, out_triangles); });
+			const double num_bytes = (double)(in_triangles.size() + out_triangles.size()) * sizeof(Triangle);
+			report(make_result("clip_triangles", std::to_string(lrintf(ratio * 100.0f)) + "% straddling", "triangle", seconds, NUM_CLIP_TRIANGLES, 0.0, num_bytes));
+		}
+	}
+
+	// About the same number of pixels for every size. The bytes are the color
+	// written and the depth read and written per pixel, texels aren't counted
+	struct TriangleSize
+	{
+		const char* name;
+		float size; // distance from the center to the vertices, in pixels
+		int count;
+	};
+	constexpr TriangleSize TRIANGLE_SIZES[] = {
+		{ "small", 2.0f, 1 << 17 },
+		{ "medium", 12.0f, 1 << 13 },
+		{ "large", 96.0f, 1 << 7 },
+	};
+	constexpr double BYTES_PER_PIXEL = sizeof(uint32) + 2 * sizeof(float);
+	const float max_size = (float)std::min(viewport.width, viewport.height) * 0.5f - 2.0f;
+
+	if (is_enabled("draw_solid"))
+	{
+		for (const TriangleSize& size : TRIANGLE_SIZES)
+		{
+			Random random;
+			double num_pixels;
+			const std::vector<Triangle> triangles = make_screen_triangles(viewport, size.count, std::min(size.size, max_size), 1.0f, random, num_pixels);
+			const double seconds = measure(min_seconds, clear_z_buffer,
+				[&]
+				{
+					for (const Triangle& triangle : triangles)
+					{
+						draw_solid(triangle, Colors::WHITE, GOURAUD);
+					}
+				});
+			report(make_result("draw_solid", std::string(size.name) + " gouraud", "triangle", seconds, size.count, num_pixels, num_pixels * BYTES_PER_PIXEL));
+		}
+	}
+
+	if (is_enabled("draw_textured"))
+	{
+		struct TexturedInput
+		{
+			int size_index;
+			int texture_size;
+			ETextureFormat format;
+		};
+		constexpr TexturedInput TEXTURED_INPUTS[] = {
+			{ 0, 256, TEXTURE_FORMAT_ARGB8888 },
+			{ 1, 256, TEXTURE_FORMAT_ARGB8888 },
+			{ 2, 256, TEXTURE_FORMAT_ARGB8888 },
+			{ 1, 64, TEXTURE_FORMAT_ARGB8888 },
+			{ 1, 1024, TEXTURE_FORMAT_ARGB8888 },
+			{ 1, 256, TEXTURE_FORMAT_BC1 },
+		};
+		constexpr const char* FORMAT_NAMES[] = { "", " bc1", " bc3" };
+		for (const TexturedInput& input : TEXTURED_INPUTS)
+		{
+			const TriangleSize& size = TRIANGLE_SIZES[input.size_index];
+			const std::shared_ptr<Texture> texture = make_texture(input.texture_size, input.format);
+			Random random;
+			double num_pixels;
+			std::vector<Triangle> triangles = make_screen_triangles(viewport, size.count, std::min(size.size, max_size), (float)input.texture_size, random, num_pixels);
+			for (Triangle& triangle : triangles)
+			{
+				triangle.texture = texture.get();
+			}
+
+			for (const ETextureFilter filter : { FILTER_POINT, FILTER_BILINEAR })
+			{
+				const double seconds = measure(min_seconds, clear_z_buffer,
+					[&]
+					{
+						for (const Triangle& triangle : triangles)
+						{
+							draw_textured(triangle, GOURAUD, filter);
+						}
+					});
+				const std::string name = std::string(size.name) + " " + std::to_string(input.texture_size) + FORMAT_NAMES[input.format]
+										 + (filter == FILTER_POINT ? " point" : " bilinear");
+				report(make_result("draw_textured", name, "triangle", seconds, size.count, num_pixels, num_pixels * BYTES_PER_PIXEL));
+			}
+		}
+	}
+
+	if (is_enabled("draw_line_bresenham_3d"))
+	{
+		struct LineLength
+		{
+			const char* name;
+			float length;
+			int count;
+		};
+		constexpr LineLength LINE_LENGTHS[] = {
+			{ "short", 8.0f, 1 << 16 },
+			{ "long", 512.0f, 1 << 10 },
+		};
+		for (const LineLength& length : LINE_LENGTHS)
+		{
+			Random random;
+			const float line_length = std::min(length.length, max_size * 2.0f);
+			std::vector<glm::ivec2> points(length.count * 2);
+			double num_pixels = 0.0;
+			for (int i = 0; i < length.count; i++)
+			{
+				const float angle = random.next(0.0f, 2.0f * glm::pi<float>());
+				const glm::vec2 offset(cosf(angle) * line_length * 0.5f, sinf(angle) * line_length * 0.5f);
+				const glm::vec2 center(
+					random.next(fabsf(offset.x) + 1.0f, (float)viewport.width - fabsf(offset.x) - 1.0f),
+					random.next(fabsf(offset.y) + 1.0f, (float)viewport.height - fabsf(offset.y) - 1.0f)
+				);
+				points[i * 2] = glm::ivec2(lrintf(center.x - offset.x), lrintf(center.y - offset.y));
+				points[i * 2 + 1] = glm::ivec2(lrintf(center.x + offset.x), lrintf(center.y + offset.y));
+				const glm::ivec2 delta = glm::abs(points[i * 2 + 1] - points[i * 2]);
+				num_pixels += std::max(delta.x, delta.y) + 1;
+			}
+			const double seconds = measure(min_seconds, clear_z_buffer,
+				[&]
+				{
+					for (int i = 0; i < length.count; i++)
+					{
+						const float depth = 0.9f - 0.8f * (float)i / (float)length.count;
+						draw_line_bresenham_3d(points[i * 2], points[i * 2 + 1], depth, depth, Colors::GREEN);
+					}
+				});
+			report(make_result("draw_line_bresenham_3d", std::string(length.name) + " " + std::to_string(lrintf(line_length)) + " px", "line", seconds, length.count, num_pixels, num_pixels * BYTES_PER_PIXEL));
+		}
+	}
+
+	if (results.empty())
+	{
+		std::cerr << "No microbenchmark matches " << options.filter << ".\n";
+		return;
+	}
+
+	if (!options.csv_filename.empty())
+	{
+		std::ofstream csv(options.csv_filename);
+		csv << std::fixed << std::setprecision(4);
+		csv << "kernel,input,item,ns_per_item,pixels_per_second,bytes_per_second\n";
+		for (const MicrobenchmarkResult& result : results)
+		{
+			csv << result.kernel << "," << result.input << "," << result.item << "," << result.ns_per_item << ","
+				<< result.pixels_per_second << "," << result.bytes_per_second << "\n";
+		}
+		if (!csv)
+		{
+			std::cerr << "Failed to write " << options.csv_filename << ".\n";
+		}
+	}
+
+	if (!options.json_filename.empty())
+	{
+		std::ofstream json(options.json_filename);
+		json << std::fixed << std::setprecision(4);
+		json << "{\n";
+		json << "  \"width\": " << viewport.width << ",\n";
+		json << "  \"height\": " << viewport.height << ",\n";
+		json << "  \"results\": [\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const MicrobenchmarkResult& result = results[i];
+			json << "    { \"kernel\": \"" << result.kernel << "\", \"input\": \"" << result.input << "\", \"item\": \"" << result.item
+				 << "\", \"ns_per_item\": " << result.ns_per_item << ", \"pixels_per_second\": " << result.pixels_per_second
+				 << ", \"bytes_per_second\": " << result.bytes_per_second << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		json << "  ]\n";
+		json << "}\n";
+		if (!json)
+		{
+			std::cerr << "Failed to write " << options.json_filename << ".\n";
+		}
+	}
+}
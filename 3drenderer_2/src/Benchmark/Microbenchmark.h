@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+struct Viewport;
+
+struct MicrobenchmarkOptions
+{
+	std::string filter; // only runs the kernels whose name contains it, all if empty
+	double min_seconds = 0.25; // spent in each kernel and input
+	std::string json_filename; // results, not written if empty
+	std::string csv_filename;
+};
+
+/**
+ * Times the clipper, transform, rasterizer, line and clear kernels on their own,
+ * on synthetic inputs generated from a fixed seed: triangles of several sizes,
+ * several ratios of triangles straddling the clip planes and several texture
+ * sizes. Each kernel runs on the whole input repeatedly until min_seconds have
+ * passed and the fastest run is reported, as nanoseconds per item (triangle,
+ * vertex, line or frame), pixels per second and bytes per second. The kernels
+ * draw into the framebuffer, which has to be initialized
+ */
+void run_microbenchmarks(const Viewport& viewport, const MicrobenchmarkOptions& options);
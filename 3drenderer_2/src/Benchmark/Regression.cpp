@@ -0,0 +1,281 @@
+#include "Regression.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+
+#include "Benchmark.h"
+#include "../Application.h"
+#include "../Graphics/Graphics.h"
+#include "../Mesh/Mesh.h"
+#include "../Renderer/Renderer.h"
+#include "../Utils/image_io.h"
+#include "../Viewport/Viewport.h"
+#include "../World/World.h"
+
+constexpr const char* MODELS_DIRECTORY = "assets/models";
+constexpr const char* TIMINGS_FILENAME = "timings.csv";
+
+/** Looking at the center of the model from these directions */
+struct RegressionCamera
+{
+	const char* name;
+	float yaw;
+	float pitch;
+};
+
+constexpr RegressionCamera REGRESSION_CAMERAS[] = {
+	{ "front", -90.0f, 0.0f },
+	{ "above", -45.0f, -35.0f },
+	{ "side", 180.0f, -10.0f },
+};
+
+/** Sorted, so the models are always rendered in the same order */
+static std::vector<std::string> find_models()
+{
+	std::vector<std::string> models;
+	std::error_code error;
+	for (const auto& entry : std::filesystem::recursive_directory_iterator(MODELS_DIRECTORY, error))
+	{
+		if (entry.is_regular_file() && entry.path().extension() == ".obj")
+		{
+			models.push_back(entry.path().generic_string());
+		}
+	}
+	std::sort(models.begin(), models.end());
+	return models;
+}
+
+/** assets/models/robot/robot.obj -> robot_robot */
+static std::string get_model_name(const std::string& filename)
+{
+	std::string name = std::filesystem::path(filename).lexically_relative(MODELS_DIRECTORY).replace_extension().generic_string();
+	std::replace(name.begin(), name.end(), '/', '_');
+	return name;
+}
+
+static std::map<std::string, double> load_timings(const std::string& filename)
+{
+	std::map<std::string, double> timings;
+	std::ifstream file(filename);
+	std::string line;
+	std::getline(file, line); // header
+	while (std::getline(file, line))
+	{
+		const size_t comma = line.find(',');
+		if (comma != std::string::npos)
+		{
+			timings[line.substr(0, comma)] = atof(line.c_str() + comma + 1);
+		}
+	}
+	return timings;
+}
+
+/**
+ * Pixels that don't match in red, over a dimmed copy of the rendered image.
+ * Returns the number of pixels that don't match
+ */
+static int compare_images(
+	const uint32* actual,
+	const std::vector<uint32>& expected,
+	int tolerance,
+	std::vector<uint32>& diff,
+	int& max_difference
+)
+{
+	int num_mismatched = 0;
+	max_difference = 0;
+	diff.resize(expected.size());
+	for (size_t i = 0; i < expected.size(); i++)
+	{
+		int difference = 0;
+		for (int shift = 0; shift < 24; shift += 8)
+		{
+			const int a = (int)((actual[i] >> shift) & 0xFF);
+			const int b = (int)((expected[i] >> shift) & 0xFF);
+			difference = std::max(difference, abs(a - b));
+		}
+		max_difference = std::max(max_difference, difference);
+
+		if (difference > tolerance)
+		{
+			diff[i] = 0xFFFF0000;
+			num_mismatched++;
+		}
+		else
+		{
+			const uint32 gray = (((actual[i] >> 16) & 0xFF) + ((actual[i] >> 8) & 0xFF) + (actual[i] & 0xFF)) / 9;
+			diff[i] = 0xFF000000 | (gray << 16) | (gray << 8) | gray;
+		}
+	}
+	return num_mismatched;
+}
+
+bool run_regression(Application& app, const RegressionOptions& options)
+{
+	World& world = *app.world;
+	Renderer& renderer = *app.renderer;
+	const int width = app.viewport->width;
+	const int height = app.viewport->height;
+
+	app.setup();
+	world.camera.input_mode = INPUT_DISABLED;
+	world.wait_for_assets();
+
+	const std::vector<std::string> models = find_models();
+	if (models.empty())
+	{
+		std::cerr << "No models found in " << MODELS_DIRECTORY << ".\n";
+		return false;
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(options.update_golden ? options.golden_directory : options.output_directory, error);
+	const std::string timings_filename = (std::filesystem::path(options.golden_directory) / TIMINGS_FILENAME).string();
+	const std::map<std::string, double> baseline = options.update_golden ? std::map<std::string, double>() : load_timings(timings_filename);
+	std::map<std::string, double> timings;
+
+	int num_images = 0;
+	int num_failed_images = 0;
+	int num_slower_models = 0;
+	std::vector<uint32> expected;
+	std::vector<uint32> diff;
+	for (const std::string& filename : models)
+	{
+		// Textures aren't virtual, so every frame samples the full levels
+		std::unique_ptr<Mesh> mesh = create_mesh(filename.c_str(), TextureLoadOptions());
+		if (mesh->triangles.empty())
+		{
+			std::cerr << "Failed to load " << filename << ", skipping it.\n";
+			continue;
+		}
+		const std::string model_name = get_model_name(filename);
+		world.spawn_crowd(mesh.get(), 1);
+
+		// Far enough for the bounds to fit in the field of view
+		const float radius = std::max(mesh->bounds_radius, 0.01f);
+		const float distance = radius / sinf(glm::radians(world.camera.fov) * 0.5f) * 1.1f;
+		world.camera.znear = std::max(distance - radius * 1.5f, distance * 0.01f);
+		world.camera.zfar = distance + radius * 1.5f;
+		world.camera.set_projection(PERSPECTIVE);
+
+		double model_ms = 0.0;
+		for (const RegressionCamera& camera : REGRESSION_CAMERAS)
+		{
+			const float yaw = glm::radians(camera.yaw);
+			const float pitch = glm::radians(camera.pitch);
+			const glm::vec3 direction(cosf(yaw) * cosf(pitch), sinf(pitch), sinf(yaw) * cosf(pitch));
+			world.camera.translation = mesh->bounds_center - direction * distance;
+			world.camera.rotation.yaw = camera.yaw;
+			world.camera.rotation.pitch = camera.pitch;
+
+			for (int render_mode = VERTICES_ONLY; render_mode <= TEXTURED_WIREFRAME; render_mode++)
+			{
+				for (int shading_mode = NONE; shading_mode <= GOURAUD; shading_mode++)
+				{
+					renderer.render_mode = (ERenderMode)render_mode;
+					renderer.shading_mode = (EShadingMode)shading_mode;
+					const std::string image_name = model_name + "_" + camera.name + "_"
+												   + get_render_mode_name(renderer.render_mode) + "_"
+												   + get_shading_mode_name(renderer.shading_mode);
+
+					double best_ms = DBL_MAX;
+					for (int i = 0; i < std::max(options.repeats, 1); i++)
+					{
+						const auto start = std::chrono::steady_clock::now();
+						app.update();
+						app.render();
+						const auto end = std::chrono::steady_clock::now();
+						best_ms = std::min(best_ms, std::chrono::duration<double, std::milli>(end - start).count());
+					}
+					model_ms += best_ms;
+					num_images++;
+
+					const std::string golden_filename = (std::filesystem::path(options.golden_directory) / (image_name + ".ppm")).string();
+					if (options.update_golden)
+					{
+						save_framebuffer_ppm(golden_filename.c_str());
+						continue;
+					}
+
+					int expected_width, expected_height;
+					if (!load_ppm(golden_filename.c_str(), expected, expected_width, expected_height))
+					{
+						std::cout << "FAIL " << image_name << ": no reference image " << golden_filename << "\n";
+						num_failed_images++;
+						continue;
+					}
+					if (expected_width != width || expected_height != height)
+					{
+						std::cout << "FAIL " << image_name << ": the reference is " << expected_width << "x" << expected_height
+								  << ", rendered at " << width << "x" << height << "\n";
+						num_failed_images++;
+						continue;
+					}
+
+					int max_difference;
+					const int num_mismatched = compare_images(get_framebuffer(), expected, options.tolerance, diff, max_difference);
+					if (num_mismatched > (int)(options.max_mismatch_ratio * (float)expected.size()))
+					{
+						const std::filesystem::path output = std::filesystem::path(options.output_directory) / image_name;
+						save_framebuffer_ppm((output.string() + ".ppm").c_str());
+						save_ppm((output.string() + "_diff.ppm").c_str(), diff.data(), width, height);
+						std::cout << "FAIL " << image_name << ": " << num_mismatched << " pixels differ ("
+								  << std::fixed << std::setprecision(3) << 100.0 * num_mismatched / (double)expected.size()
+								  << "%), by up to " << max_difference << ", see " << output.string() << "_diff.ppm\n";
+						num_failed_images++;
+					}
+				}
+			}
+		}
+		timings[model_name] = model_ms;
+
+		std::cout << std::fixed << std::setprecision(2) << model_name << ": " << model_ms << " ms";
+		const auto it = baseline.find(model_name);
+		if (it != baseline.end() && it->second > 0.0)
+		{
+			const double change = model_ms / it->second - 1.0;
+			std::cout << " (baseline " << it->second << " ms, " << std::showpos << change * 100.0 << std::noshowpos << "%)";
+			if (change > options.perf_threshold)
+			{
+				std::cout << " SLOWER";
+				num_slower_models++;
+			}
+		}
+		std::cout << "\n";
+		world.spawn_crowd(nullptr, 0);
+	}
+
+	if (options.update_golden)
+	{
+		std::ofstream file(timings_filename);
+		file << std::fixed << std::setprecision(4) << "model,ms\n";
+		for (const auto& [name, ms] : timings)
+		{
+			file << name << "," << ms << "\n";
+		}
+		if (!file)
+		{
+			std::cerr << "Failed to write " << timings_filename << ".\n";
+			return false;
+		}
+		std::cout << "Wrote " << num_images << " reference images and the timings of " << timings.size() << " models to " << options.golden_directory << "\n";
+		return true;
+	}
+
+	std::cout << num_images - num_failed_images << " of " << num_images << " images match, "
+			  << num_slower_models << " models slower than the baseline by more than "
+			  << lrintf(options.perf_threshold * 100.0f) << "%\n";
+	return num_failed_images == 0 && num_slower_models == 0;
+}
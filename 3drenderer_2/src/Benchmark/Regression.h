@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+struct Application;
+
+struct RegressionOptions
+{
+	std::string golden_directory = "assets/golden"; // reference images and timings.csv
+	std::string output_directory = "regression"; // rendered and diff images of the failures
+	bool update_golden = false; // write the references instead of comparing against them
+	int tolerance = 8; // largest difference of a color channel that still matches
+	float max_mismatch_ratio = 0.001f; // of the pixels of an image that may differ
+	float perf_threshold = 0.25f; // fraction a model may be slower than its baseline
+	int repeats = 3; // renders of each image, the fastest is timed
+};
+
+/**
+ * Renders every OBJ file under assets/models on its own, headless, from a few
+ * fixed cameras around its bounds in every render and shading mode, and
+ * compares each frame against the reference image of the same name in the
+ * golden directory. The rendering times of each model are compared against the
+ * baseline in timings.csv there. Images that differ are written to the output
+ * directory along with an image of the pixels that don't match. With
+ * update_golden the frames and times become the new references instead.
+ * Returns false if any image differs or any model got slower than the threshold
+ */
+bool run_regression(Application& app, const RegressionOptions& options);
@@ -6,12 +6,6 @@
 #include "../Utils/string_ops.h"
 #include <glm/gtc/matrix_transform.hpp>
 
-#ifdef _MSC_VER // Windows
-#include <SDL.h>
-#else // Linux
-#include <SDL2/SDL.h>
-#endif
-
 Camera::Camera(glm::vec3 position, rot3 rotation)
 	: Entity(glm::vec3(1.0f), rotation, position)
 {
@@ -37,14 +31,12 @@ void Camera::process_mouse_movement()
 	}
 
 	// Get the x and y coordinates of the mouse
-	int x, y;
-
-	SDL_GetRelativeMouseState(&x, &y);
+	int x = mouse_delta.x;
+	int y = mouse_delta.y;
 
 	// Set the mouse focus manually when the window is first clicked
 	if (window_clicked && !mouse_has_position)
 	{
-		SDL_GetRelativeMouseState(&x, &y);
 		x = 0;
 		y = 0;
 		mouse_has_position = true;
@@ -156,12 +148,12 @@ void Camera::set_projection(ProjectionMode mode)
 	// Set perspective
 	if (mode & PERSPECTIVE)
 	{
-		projection_mode |= PERSPECTIVE;
+		projection_mode = PERSPECTIVE;
 		projection_matrix = glm::perspective(glm::radians(fov), aspect, znear, zfar);
 	}
 	if (mode & ORTHOGRAPHIC)
 	{
-		projection_mode |= ORTHOGRAPHIC;
+		projection_mode = ORTHOGRAPHIC;
 		projection_matrix = glm::ortho(-ortho_dist * aspect, ortho_dist * aspect, -ortho_dist, ortho_dist, znear, zfar);
 	}
 }
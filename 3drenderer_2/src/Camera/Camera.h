@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 
 #include "../Entity/Entity.h"
@@ -70,6 +71,7 @@ struct Camera : public Entity
 	ProjectionMode projection_mode = PERSPECTIVE;
 
 	float mouse_sensitivity = 0.15f;
+	glm::ivec2 mouse_delta = glm::ivec2(0); // relative mouse motion of this frame, set by the application
 	bool window_clicked = false;
 	bool mouse_has_position = false;
 
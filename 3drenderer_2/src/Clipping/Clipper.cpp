@@ -3,13 +3,15 @@
 #include <glm/gtc/matrix_access.hpp>
 #include <glm/gtx/compatibility.hpp>
 #include <glm/vec4.hpp>
-#include <tracy/tracy/Tracy.hpp>
 
 #include "../Line/Line3D.h"
 #include "../Logger/Logger.h"
 #include "../Mesh/tex2.h"
 #include "../Triangle/Triangle.h"
 #include "../Utils/Constants.h"
+#include "../Utils/CycleCounters.h"
+#include "../Utils/PipelineStats.h"
+#include "../Utils/TraceRecorder.h"
 #include "../Utils/string_ops.h"
 
 void clip_line(Line3D& line)
@@ -210,14 +212,14 @@ constexpr int MAX_TRIANGLES_PER_CLIP = 50;
 
 void clip_triangles(
 	const std::vector<Triangle>& in_tris,
-	Triangle* out_tris,
-	int& out_tri_count
+	std::vector<Triangle>& out_tris
 )
 {
 	ZoneScoped; // for tracy
+	TIMED_BLOCK("Clipping");
 
-	// Number of triangles that are left after clipping
-	out_tri_count = 0;
+	// Triangles that are left after clipping
+	out_tris.clear();
 	// The triangles created for single triangle after clipping against all clip
 	// planes
 	std::array<Triangle, MAX_TRIANGLES_PER_CLIP> tris_current_clip;
@@ -225,6 +227,10 @@ void clip_triangles(
 	// Temporary container to store the triangles clipped from a single plane in
 	std::array<Triangle, MAX_TRIANGLES_PER_CLIP> tmp;
 
+	uint64 num_culled = 0;
+	uint64 num_clipped = 0;
+	uint64 num_generated = 0;
+
 	int i, j;
 	// Loop over each triangle
 	for (const Triangle& triangle : in_tris)
@@ -255,15 +261,31 @@ void clip_triangles(
 		// final array of triangles
 		for (i = 0; i < num_tris_current_clip; i++)
 		{
-			out_tris[(size_t)out_tri_count + (size_t)i] = tris_current_clip[i];
+			out_tris.push_back(tris_current_clip[i]);
+		}
+
+		// A single triangle left with the same corners went through untouched
+		if (num_tris_current_clip == 0)
+		{
+			num_culled++;
+		}
+		else if (num_tris_current_clip > 1
+				 || tris_current_clip[0].vertices[0].position != triangle.vertices[0].position
+				 || tris_current_clip[0].vertices[1].position != triangle.vertices[1].position
+				 || tris_current_clip[0].vertices[2].position != triangle.vertices[2].position)
+		{
+			num_clipped++;
+			num_generated += num_tris_current_clip - 1;
 		}
-		// Increment the final triangle amount by the number of triangles
-		// created from the current clip
-		out_tri_count += num_tris_current_clip;
 		// Reset the clip counter
 		num_tris_current_clip = 0;
 	}
-	Logger::print(LOG_CATEGORY_CLIPPING, "Out triangles: " + std::to_string(out_tri_count));
+
+	PipelineStats& stats = get_thread_pipeline_stats();
+	stats.counters[PIPELINE_TRIANGLES_FRUSTUM_CULLED] += num_culled;
+	stats.counters[PIPELINE_TRIANGLES_CLIPPED] += num_clipped;
+	stats.counters[PIPELINE_TRIANGLES_GENERATED] += num_generated;
+	Logger::print(LOG_CATEGORY_CLIPPING, "Out triangles: " + std::to_string(out_tris.size()));
 }
 
 void clip_triangles_to_plane(
@@ -273,7 +295,7 @@ void clip_triangles_to_plane(
 	const EClipPlane plane
 )
 {
-	ZoneScoped; // for tracy
+	ZoneScopedTriangle; // for tracy
 
 	// Counts the number of triangles that will exist after the current clip
 	int num_new_tris = 0;
@@ -370,7 +392,7 @@ void clip_triangle_to_plane(
 	int& num_clip_verts
 )
 {
-	ZoneScoped; // for tracy
+	ZoneScopedTriangle; // for tracy
 
 	// Extract the vertices
 	std::array<glm::vec4, NUM_VERTICES_PER_TRIANGLE> vertices;
@@ -26,8 +26,7 @@ void clip_line(Line3D& line);
 
 void clip_triangles(
 	const std::vector<Triangle>& in_tris,
-	Triangle* out_tris, 
-	int& out_tri_count
+	std::vector<Triangle>& out_tris
 );
 void clip_triangles_to_plane(
 	Triangle* tmp,
@@ -0,0 +1,205 @@
+#include "InputRecording.h"
+
+#include <cmath>
+#include <array>
+#include <cstring>
+#include <iostream>
+
+#include "../Camera/Camera.h"
+#include "../Light/Light.h"
+#include "../Utils/MappedFile.h"
+
+#ifdef _MSC_VER // Windows
+#include <SDL.h>
+#else // Linux
+#include <SDL2/SDL.h>
+#endif
+
+constexpr char INPUT_RECORDING_MAGIC[4] = { 'I', 'N', 'P', 'T' };
+constexpr uint32 INPUT_RECORDING_VERSION = 1;
+constexpr uint32 INPUT_RECORDING_LAYOUT = (uint32)(sizeof(SDL_Event) + sizeof(InputFrameState));
+
+// Replays that drift further than this from the recorded state don't match
+constexpr float INPUT_STATE_TOLERANCE = 1e-4f;
+
+InputFrameState get_input_frame_state(const Camera& camera, const Light& light)
+{
+	InputFrameState state;
+	state.camera_translation = camera.translation;
+	state.camera_rotation = camera.rotation;
+	state.camera_speed = camera.speed;
+	state.light_translation = light.translation;
+	state.light_rotation = light.rotation;
+	state.light_intensity = light.intensity;
+	return state;
+}
+
+bool InputRecorder::open(const char* filename_)
+{
+	filename = filename_;
+	writer.file.open(filename, std::ios::binary | std::ios::trunc);
+	if (!writer.file)
+	{
+		std::cerr << "Failed to create the input recording " << filename << ".\n";
+		return false;
+	}
+	writer.write(INPUT_RECORDING_MAGIC);
+	writer.write(INPUT_RECORDING_VERSION);
+	writer.write(INPUT_RECORDING_LAYOUT);
+	num_frames = 0;
+	return true;
+}
+
+void InputRecorder::close()
+{
+	if (!writer.file.is_open())
+	{
+		return;
+	}
+	writer.file.close();
+	if (!writer.file)
+	{
+		std::cerr << "Failed to write the input recording " << filename << ".\n";
+		return;
+	}
+	std::cout << "Recorded " << num_frames << " frames of input to " << filename << "\n";
+}
+
+void InputRecorder::begin_frame(const std::vector<SDL_Event>& events, glm::ivec2 mouse_delta)
+{
+	uint32 num_events = 0;
+	for (const SDL_Event& event : events)
+	{
+		num_events += event.type != SDL_DROPFILE && event.type != SDL_DROPTEXT && event.type != SDL_SYSWMEVENT;
+	}
+
+	writer.write(num_events);
+	for (const SDL_Event& event : events)
+	{
+		if (event.type != SDL_DROPFILE && event.type != SDL_DROPTEXT && event.type != SDL_SYSWMEVENT)
+		{
+			writer.write(event);
+		}
+	}
+	writer.write(mouse_delta);
+}
+
+void InputRecorder::end_frame(const InputFrameState& state)
+{
+	writer.write(state);
+	num_frames++;
+}
+
+bool InputPlayer::load(const char* filename_)
+{
+	filename = filename_;
+	MappedFile file;
+	if (!file.open(filename_))
+	{
+		std::cerr << "Failed to open the input recording " << filename << ".\n";
+		return false;
+	}
+	CacheReader reader{ file.data, file.size };
+
+	const std::array<char, 4> magic = reader.read<std::array<char, 4>>();
+	const uint32 version = reader.read<uint32>();
+	const uint32 layout = reader.read<uint32>();
+	if (!reader.is_valid || memcmp(magic.data(), INPUT_RECORDING_MAGIC, sizeof(INPUT_RECORDING_MAGIC)) != 0
+		|| version != INPUT_RECORDING_VERSION || layout != INPUT_RECORDING_LAYOUT)
+	{
+		std::cerr << filename << " isn't an input recording of this version of the renderer.\n";
+		return false;
+	}
+
+	// A frame cut off by the application closing is dropped
+	events.clear();
+	frames.clear();
+	while (reader.offset < reader.size)
+	{
+		RecordedFrame frame;
+		frame.first_event = events.size() / sizeof(SDL_Event);
+		frame.num_events = reader.read<uint32>();
+		const uint8* bytes = reader.read_bytes(frame.num_events * sizeof(SDL_Event));
+		frame.mouse_delta = reader.read<glm::ivec2>();
+		frame.state = reader.read<InputFrameState>();
+		if (!reader.is_valid)
+		{
+			break;
+		}
+		events.insert(events.end(), bytes, bytes + frame.num_events * sizeof(SDL_Event));
+		frames.push_back(frame);
+	}
+
+	current_frame = -1;
+	is_frame_pending = false;
+	first_mismatch = -1;
+	std::cout << "Replaying " << frames.size() << " frames of input from " << filename << "\n";
+	return true;
+}
+
+bool InputPlayer::begin_frame(std::vector<SDL_Event>& frame_events, glm::ivec2& mouse_delta)
+{
+	if (current_frame + 1 >= (int)frames.size())
+	{
+		return false;
+	}
+	current_frame++;
+
+	const RecordedFrame& frame = frames[current_frame];
+	frame_events.resize(frame.num_events);
+	if (frame.num_events > 0)
+	{
+		memcpy(frame_events.data(), &events[frame.first_event * sizeof(SDL_Event)], frame.num_events * sizeof(SDL_Event));
+	}
+	mouse_delta = frame.mouse_delta;
+	is_frame_pending = true;
+	return true;
+}
+
+static bool is_near(const glm::vec3& a, const glm::vec3& b)
+{
+	return fabsf(a.x - b.x) <= INPUT_STATE_TOLERANCE && fabsf(a.y - b.y) <= INPUT_STATE_TOLERANCE && fabsf(a.z - b.z) <= INPUT_STATE_TOLERANCE;
+}
+
+static bool is_near(const rot3& a, const rot3& b)
+{
+	return is_near(glm::vec3(a.pitch, a.yaw, a.roll), glm::vec3(b.pitch, b.yaw, b.roll));
+}
+
+void InputPlayer::end_frame(const InputFrameState& state)
+{
+	if (!is_frame_pending)
+	{
+		return;
+	}
+	is_frame_pending = false;
+	if (first_mismatch >= 0)
+	{
+		return;
+	}
+
+	const InputFrameState& expected = frames[current_frame].state;
+	const bool is_match = is_near(state.camera_translation, expected.camera_translation)
+						  && is_near(state.camera_rotation, expected.camera_rotation)
+						  && fabsf(state.camera_speed - expected.camera_speed) <= INPUT_STATE_TOLERANCE
+						  && is_near(state.light_translation, expected.light_translation)
+						  && is_near(state.light_rotation, expected.light_rotation)
+						  && fabsf(state.light_intensity - expected.light_intensity) <= INPUT_STATE_TOLERANCE;
+	if (!is_match)
+	{
+		first_mismatch = current_frame;
+		std::cerr << "The replay of " << filename << " stopped matching the recording at frame " << current_frame << ".\n";
+	}
+}
+
+void InputPlayer::report() const
+{
+	if (first_mismatch < 0)
+	{
+		std::cout << "Replayed " << current_frame + 1 << " of " << frames.size() << " frames of input, the camera and the light matched the recording\n";
+	}
+	else
+	{
+		std::cout << "Replayed " << current_frame + 1 << " of " << frames.size() << " frames of input, diverging from frame " << first_mismatch << "\n";
+	}
+}
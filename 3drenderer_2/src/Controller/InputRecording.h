@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include "../Math/Rotator.h"
+#include "../Mesh/AssetCache.h"
+
+struct Camera;
+struct Light;
+union SDL_Event;
+
+/**
+ * What the camera and the light ended up as after a frame, so a replay can
+ * tell when it stops matching the recording
+ */
+struct InputFrameState
+{
+	glm::vec3 camera_translation;
+	rot3 camera_rotation;
+	float camera_speed;
+	glm::vec3 light_translation;
+	rot3 light_rotation;
+	float light_intensity;
+};
+
+InputFrameState get_input_frame_state(const Camera& camera, const Light& light);
+
+/**
+ * Writes every SDL event and the relative mouse motion of each frame to a
+ * file, followed by the state the camera and the light ended up in once the
+ * frame was updated. Events that carry pointers (dropped files, window system
+ * messages) are left out
+ */
+struct InputRecorder
+{
+	bool open(const char* filename_);
+	void close();
+
+	/** Between Application::input and Application::update */
+	void begin_frame(const std::vector<SDL_Event>& events, glm::ivec2 mouse_delta);
+	/** After Application::update */
+	void end_frame(const InputFrameState& state);
+
+	std::string filename;
+	CacheWriter writer;
+	int num_frames = 0;
+};
+
+/**
+ * Plays a recording back one recorded frame per frame, in place of the live
+ * SDL events and mouse motion. The camera and everything else driven by input
+ * only move by a fixed step each frame, so the replay repeats the session
+ * exactly however long its frames take. Each frame is checked against the
+ * state recorded for it
+ */
+struct InputPlayer
+{
+	bool load(const char* filename_);
+
+	/** Returns false once the recording has run out */
+	bool begin_frame(std::vector<SDL_Event>& events, glm::ivec2& mouse_delta);
+	void end_frame(const InputFrameState& state);
+	/** Prints whether the replay matched the recording */
+	void report() const;
+
+	struct RecordedFrame
+	{
+		size_t first_event;
+		size_t num_events;
+		glm::ivec2 mouse_delta;
+		InputFrameState state;
+	};
+
+	std::string filename;
+	std::vector<uint8> events; // SDL_Events, raw
+	std::vector<RecordedFrame> frames;
+	int current_frame = -1;
+	bool is_frame_pending = false; // begun but not ended yet
+	int first_mismatch = -1; // frame whose state didn't match, -1 if all did
+};
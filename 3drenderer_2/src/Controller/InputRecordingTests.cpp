@@ -0,0 +1,143 @@
+#include "InputRecording.h"
+
+#include <filesystem>
+#include <vector>
+
+#include "../Camera/Camera.h"
+#include "../Light/Light.h"
+#include "../Utils/UnitTests.h"
+
+#ifdef _MSC_VER // Windows
+#include <SDL.h>
+#else // Linux
+#include <SDL2/SDL.h>
+#endif
+
+constexpr int NUM_RECORDED_FRAMES = 40;
+
+static SDL_Event make_key_event(uint32 type, SDL_Keycode key)
+{
+	SDL_Event event = {};
+	event.type = type;
+	event.key.keysym.sym = key;
+	return event;
+}
+
+/** The keys and mouse motion of a short session, moving and turning the camera */
+static std::vector<SDL_Event> get_session_events(int frame)
+{
+	std::vector<SDL_Event> events;
+	if (frame == 2)
+	{
+		events.push_back(make_key_event(SDL_KEYDOWN, SDLK_w));
+	}
+	if (frame == 5)
+	{
+		// Carries a pointer, never recorded
+		SDL_Event drop = {};
+		drop.type = SDL_DROPFILE;
+		events.push_back(drop);
+	}
+	if (frame == 10)
+	{
+		events.push_back(make_key_event(SDL_KEYDOWN, SDLK_d));
+	}
+	if (frame == 20)
+	{
+		events.push_back(make_key_event(SDL_KEYUP, SDLK_w));
+	}
+	if (frame == 30)
+	{
+		events.push_back(make_key_event(SDL_KEYUP, SDLK_d));
+	}
+	return events;
+}
+
+/** What PlayerController and World::update() do with the input of a frame, for the camera */
+static void update_camera(Camera& camera, const std::vector<SDL_Event>& events, glm::ivec2 mouse_delta)
+{
+	for (const SDL_Event& event : events)
+	{
+		if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
+		{
+			const EMovementState state = event.key.keysym.sym == SDLK_w ? FORWARD : RIGHT;
+			camera.set_move_state(state, event.type == SDL_KEYDOWN);
+		}
+	}
+	camera.mouse_delta = mouse_delta;
+	camera.update();
+}
+
+static Camera make_camera()
+{
+	Camera camera(glm::vec3(0.0f, 8.0f, 15.0f), rot3(0.0f, -90.0f, 0.0f));
+	camera.input_mode = INPUT_ENABLED;
+	return camera;
+}
+
+/**
+ * Replays the recording onto a new camera, nudging its speed at
+ * perturbed_frame. Returns the first frame that didn't match
+ */
+static int replay(const char* filename, int perturbed_frame, int& num_frames, int& num_drop_events)
+{
+	InputPlayer player;
+	CHECK(player.load(filename));
+	Camera camera = make_camera();
+	const Light light(glm::vec3(0.0f), rot3(0.0f, 0.0f, 0.0f), 1.0f);
+
+	std::vector<SDL_Event> events;
+	glm::ivec2 mouse_delta;
+	num_frames = 0;
+	num_drop_events = 0;
+	while (player.begin_frame(events, mouse_delta))
+	{
+		for (const SDL_Event& event : events)
+		{
+			num_drop_events += event.type == SDL_DROPFILE;
+		}
+		if (num_frames == perturbed_frame)
+		{
+			camera.speed += 0.01f;
+		}
+		update_camera(camera, events, mouse_delta);
+		player.end_frame(get_input_frame_state(camera, light));
+		num_frames++;
+	}
+	return player.first_mismatch;
+}
+
+UNIT_TEST("input recording: a replay repeats the recorded session exactly")
+{
+	const std::string filename = (std::filesystem::temp_directory_path() / "input_recording_test.bin").string();
+
+	InputRecorder recorder;
+	CHECK(recorder.open(filename.c_str()));
+	Camera camera = make_camera();
+	const Light light(glm::vec3(0.0f), rot3(0.0f, 0.0f, 0.0f), 1.0f);
+	for (int frame = 0; frame < NUM_RECORDED_FRAMES; frame++)
+	{
+		const std::vector<SDL_Event> events = get_session_events(frame);
+		const glm::ivec2 mouse_delta(frame % 7 - 3, frame % 5 - 2);
+		recorder.begin_frame(events, mouse_delta);
+		update_camera(camera, events, mouse_delta);
+		recorder.end_frame(get_input_frame_state(camera, light));
+	}
+	recorder.close();
+
+	// Every replay matches, however many times it runs
+	for (int run = 0; run < 2; run++)
+	{
+		int num_frames, num_drop_events;
+		CHECK(replay(filename.c_str(), -1, num_frames, num_drop_events) == -1);
+		CHECK(num_frames == NUM_RECORDED_FRAMES);
+		CHECK(num_drop_events == 0);
+	}
+
+	// A replay that drifts is caught on the frame it drifted
+	int num_frames, num_drop_events;
+	CHECK(replay(filename.c_str(), 25, num_frames, num_drop_events) == 25);
+
+	std::error_code error;
+	std::filesystem::remove(filename, error);
+}
@@ -123,6 +123,13 @@ void PlayerController::process_input(SDL_Event& event) const
 				renderer->set_render_mode(TEXTURED_WIREFRAME);
 				break;
 			}
+			if (event.key.keysym.sym == SDLK_8)
+			{
+				// Depth, overdraw, rejections, tile time and tile triangles
+				renderer->backface_culling = true;
+				renderer->cycle_debug_view();
+				break;
+			}
 			if (event.key.keysym.sym == SDLK_n)
 			{
 				// Toggle
@@ -147,6 +154,18 @@ void PlayerController::process_input(SDL_Event& event) const
 				renderer->set_shading_mode(GOURAUD);
 				break;
 			}
+			// Point -> bilinear -> trilinear -> point
+			if (event.key.keysym.sym == SDLK_t)
+			{
+				renderer->cycle_texture_filter();
+				break;
+			}
+			// Write the next frame out for --replay
+			if (event.key.keysym.sym == SDLK_F12)
+			{
+				renderer->capture_next_frame = true;
+				break;
+			}
 		/*
 		* Camera controls
 		* Note: The camera controls are handled by ORing together
@@ -0,0 +1,381 @@
+#include "EntityStore.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <glm/gtc/constants.hpp>
+#include <vectorclass/vectorclass.h>
+#include <vectorclass/vectormath_trig.h>
+
+#include "../Mesh/Mesh.h"
+#include "../Utils/TraceRecorder.h"
+
+// Number of entities processed by each iteration of the SIMD loops
+constexpr int ENTITIES_PER_LANE = 8;
+static_assert(ENTITIES_PER_LANE == sizeof(uint64), "a lane of flags is tested as one uint64");
+
+// Whether any entity in the lane starting at entity has the flag set
+static bool lane_has_flag(const std::vector<uint8>& flags, int entity, uint8 flag)
+{
+	uint64 lane;
+	memcpy(&lane, &flags[entity], sizeof(lane));
+	return (lane & (0x0101010101010101ull * flag)) != 0;
+}
+
+static void resize_components(EntityStore& store, size_t size)
+{
+	store.translation_x.resize(size);
+	store.translation_y.resize(size);
+	store.translation_z.resize(size);
+	store.pitch.resize(size);
+	store.yaw.resize(size);
+	store.roll.resize(size);
+	store.scale_x.resize(size);
+	store.scale_y.resize(size);
+	store.scale_z.resize(size);
+	for (std::vector<float>& element : store.local)
+	{
+		element.resize(size);
+	}
+	for (std::vector<float>& element : store.world)
+	{
+		element.resize(size);
+	}
+	store.parent.resize(size);
+	store.transform_flags.resize(size);
+	store.local_center_x.resize(size);
+	store.local_center_y.resize(size);
+	store.local_center_z.resize(size);
+	store.local_radius.resize(size);
+	store.center_x.resize(size);
+	store.center_y.resize(size);
+	store.center_z.resize(size);
+	store.radius.resize(size);
+	store.meshes.resize(size);
+	store.current_lod.resize(size);
+	store.tints.resize(size);
+	store.render_flags.resize(size);
+}
+
+int EntityStore::create(
+	Mesh* mesh,
+	glm::vec3 translation,
+	rot3 rotation,
+	glm::vec3 scale,
+	uint32 tint,
+	int parent_
+)
+{
+	const int entity = count;
+	count++;
+
+	// The transform passes rely on parents coming before their children
+	if (parent_ >= entity)
+	{
+		std::cerr << "Entity " << entity << " can't be attached to entity " << parent_ << ".\n";
+		parent_ = -1;
+	}
+
+	// Grow a whole lane at a time so the arrays stay padded
+	const size_t padded_size = ((size_t)count + ENTITIES_PER_LANE - 1) & ~(size_t)(ENTITIES_PER_LANE - 1);
+	if (translation_x.size() < padded_size)
+	{
+		resize_components(*this, padded_size);
+	}
+
+	translation_x[entity] = translation.x;
+	translation_y[entity] = translation.y;
+	translation_z[entity] = translation.z;
+	pitch[entity] = rotation.pitch;
+	yaw[entity] = rotation.yaw;
+	roll[entity] = rotation.roll;
+	scale_x[entity] = scale.x;
+	scale_y[entity] = scale.y;
+	scale_z[entity] = scale.z;
+
+	local_center_x[entity] = mesh ? mesh->bounds_center.x : 0.0f;
+	local_center_y[entity] = mesh ? mesh->bounds_center.y : 0.0f;
+	local_center_z[entity] = mesh ? mesh->bounds_center.z : 0.0f;
+	local_radius[entity] = mesh ? mesh->bounds_radius : 0.0f;
+
+	parent[entity] = parent_;
+	meshes[entity] = mesh;
+	current_lod[entity] = 0;
+	tints[entity] = tint;
+	render_flags[entity] = mesh ? RENDER_FLAG_VISIBLE : 0;
+	mark_dirty(entity);
+
+	return entity;
+}
+
+void EntityStore::clear()
+{
+	count = 0;
+	has_dirty = false;
+	resize_components(*this, 0);
+}
+
+int EntityStore::size() const
+{
+	return count;
+}
+
+void EntityStore::set_translation(int entity, glm::vec3 translation)
+{
+	translation_x[entity] = translation.x;
+	translation_y[entity] = translation.y;
+	translation_z[entity] = translation.z;
+	mark_dirty(entity);
+}
+
+void EntityStore::set_rotation(int entity, rot3 rotation)
+{
+	pitch[entity] = rotation.pitch;
+	yaw[entity] = rotation.yaw;
+	roll[entity] = rotation.roll;
+	mark_dirty(entity);
+}
+
+void EntityStore::set_scale(int entity, glm::vec3 scale)
+{
+	scale_x[entity] = scale.x;
+	scale_y[entity] = scale.y;
+	scale_z[entity] = scale.z;
+	mark_dirty(entity);
+}
+
+void EntityStore::set_mesh(int entity, Mesh* mesh)
+{
+	local_center_x[entity] = mesh ? mesh->bounds_center.x : 0.0f;
+	local_center_y[entity] = mesh ? mesh->bounds_center.y : 0.0f;
+	local_center_z[entity] = mesh ? mesh->bounds_center.z : 0.0f;
+	local_radius[entity] = mesh ? mesh->bounds_radius : 0.0f;
+
+	meshes[entity] = mesh;
+	current_lod[entity] = 0;
+	if (mesh)
+	{
+		render_flags[entity] |= RENDER_FLAG_VISIBLE;
+	}
+	else
+	{
+		render_flags[entity] &= ~RENDER_FLAG_VISIBLE;
+	}
+	// The world space bounds follow the new local bounds
+	mark_dirty(entity);
+}
+
+void EntityStore::mark_dirty(int entity)
+{
+	transform_flags[entity] |= TRANSFORM_LOCAL_DIRTY;
+	has_dirty = true;
+}
+
+void EntityStore::update_transforms()
+{
+	ZoneScoped; // for tracy
+
+	// Nothing has moved since the last update, so every cached matrix and
+	// bounding sphere is still valid
+	if (!has_dirty)
+	{
+		return;
+	}
+	has_dirty = false;
+
+	update_local_matrices();
+	update_world_matrices();
+	update_bounds();
+}
+
+void EntityStore::update_local_matrices()
+{
+	ZoneScoped; // for tracy
+
+	const Vec8f degrees_to_radians(glm::pi<float>() / 180.0f);
+
+	for (int i = 0; i < count; i += ENTITIES_PER_LANE)
+	{
+		// Rebuilding the whole lane is as cheap as rebuilding a single entity
+		if (!lane_has_flag(transform_flags, i, TRANSFORM_LOCAL_DIRTY))
+		{
+			continue;
+		}
+
+		const Vec8f sx = Vec8f().load(&scale_x[i]);
+		const Vec8f sy = Vec8f().load(&scale_y[i]);
+		const Vec8f sz = Vec8f().load(&scale_z[i]);
+
+		Vec8f cos_x, cos_y, cos_z;
+		const Vec8f sin_x = sincos(&cos_x, Vec8f().load(&pitch[i]) * degrees_to_radians);
+		const Vec8f sin_y = sincos(&cos_y, Vec8f().load(&yaw[i]) * degrees_to_radians);
+		const Vec8f sin_z = sincos(&cos_z, Vec8f().load(&roll[i]) * degrees_to_radians);
+
+		// translation * rotation x * rotation y * rotation z * scale, the same
+		// as Math3D::create_world_matrix, multiplied out by hand
+		const Vec8f m00 = cos_y * cos_z * sx;
+		const Vec8f m01 = -cos_y * sin_z * sy;
+		const Vec8f m02 = sin_y * sz;
+		const Vec8f m10 = (cos_x * sin_z + sin_x * sin_y * cos_z) * sx;
+		const Vec8f m11 = (cos_x * cos_z - sin_x * sin_y * sin_z) * sy;
+		const Vec8f m12 = -sin_x * cos_y * sz;
+		const Vec8f m20 = (sin_x * sin_z - cos_x * sin_y * cos_z) * sx;
+		const Vec8f m21 = (sin_x * cos_z + cos_x * sin_y * sin_z) * sy;
+		const Vec8f m22 = cos_x * cos_y * sz;
+		const Vec8f m03 = Vec8f().load(&translation_x[i]);
+		const Vec8f m13 = Vec8f().load(&translation_y[i]);
+		const Vec8f m23 = Vec8f().load(&translation_z[i]);
+
+		m00.store(&local[0][i]);
+		m01.store(&local[1][i]);
+		m02.store(&local[2][i]);
+		m03.store(&local[3][i]);
+		m10.store(&local[4][i]);
+		m11.store(&local[5][i]);
+		m12.store(&local[6][i]);
+		m13.store(&local[7][i]);
+		m20.store(&local[8][i]);
+		m21.store(&local[9][i]);
+		m22.store(&local[10][i]);
+		m23.store(&local[11][i]);
+	}
+}
+
+void EntityStore::update_world_matrices()
+{
+	ZoneScoped; // for tracy
+
+	// Parents come before their children, so by the time we reach an entity
+	// we already know whether its parent moved this frame
+	for (int i = 0; i < count; i++)
+	{
+		const int p = parent[i];
+		const bool changed = (transform_flags[i] & TRANSFORM_LOCAL_DIRTY)
+							 || (p >= 0 && (transform_flags[p] & TRANSFORM_WORLD_CHANGED));
+		transform_flags[i] = changed ? TRANSFORM_WORLD_CHANGED : 0;
+		if (!changed)
+		{
+			continue;
+		}
+
+		if (p < 0)
+		{
+			for (int element = 0; element < 12; element++)
+			{
+				world[element][i] = local[element][i];
+			}
+			continue;
+		}
+
+		// world = parent world * local, treating both as affine 4x4 matrices
+		for (int row = 0; row < 3; row++)
+		{
+			const float p0 = world[row * 4 + 0][p];
+			const float p1 = world[row * 4 + 1][p];
+			const float p2 = world[row * 4 + 2][p];
+			const float p3 = world[row * 4 + 3][p];
+			for (int column = 0; column < 4; column++)
+			{
+				float value = p0 * local[0 + column][i]
+							+ p1 * local[4 + column][i]
+							+ p2 * local[8 + column][i];
+				if (column == 3)
+				{
+					value += p3;
+				}
+				world[row * 4 + column][i] = value;
+			}
+		}
+	}
+}
+
+void EntityStore::update_bounds()
+{
+	ZoneScoped; // for tracy
+
+	for (int i = 0; i < count; i += ENTITIES_PER_LANE)
+	{
+		if (!lane_has_flag(transform_flags, i, TRANSFORM_WORLD_CHANGED))
+		{
+			continue;
+		}
+
+		const Vec8f m00 = Vec8f().load(&world[0][i]);
+		const Vec8f m01 = Vec8f().load(&world[1][i]);
+		const Vec8f m02 = Vec8f().load(&world[2][i]);
+		const Vec8f m03 = Vec8f().load(&world[3][i]);
+		const Vec8f m10 = Vec8f().load(&world[4][i]);
+		const Vec8f m11 = Vec8f().load(&world[5][i]);
+		const Vec8f m12 = Vec8f().load(&world[6][i]);
+		const Vec8f m13 = Vec8f().load(&world[7][i]);
+		const Vec8f m20 = Vec8f().load(&world[8][i]);
+		const Vec8f m21 = Vec8f().load(&world[9][i]);
+		const Vec8f m22 = Vec8f().load(&world[10][i]);
+		const Vec8f m23 = Vec8f().load(&world[11][i]);
+
+		// Move the bounding sphere into world space
+		const Vec8f lx = Vec8f().load(&local_center_x[i]);
+		const Vec8f ly = Vec8f().load(&local_center_y[i]);
+		const Vec8f lz = Vec8f().load(&local_center_z[i]);
+		mul_add(m00, lx, mul_add(m01, ly, mul_add(m02, lz, m03))).store(&center_x[i]);
+		mul_add(m10, lx, mul_add(m11, ly, mul_add(m12, lz, m13))).store(&center_y[i]);
+		mul_add(m20, lx, mul_add(m21, ly, mul_add(m22, lz, m23))).store(&center_z[i]);
+
+		// Rotation doesn't change the radius, so only the longest axis of the
+		// world matrix (the largest accumulated scale) matters
+		const Vec8f axis_x = m00 * m00 + m10 * m10 + m20 * m20;
+		const Vec8f axis_y = m01 * m01 + m11 * m11 + m21 * m21;
+		const Vec8f axis_z = m02 * m02 + m12 * m12 + m22 * m22;
+		const Vec8f max_scale = sqrt(max(max(axis_x, axis_y), axis_z));
+		(Vec8f().load(&local_radius[i]) * max_scale).store(&radius[i]);
+	}
+}
+
+void EntityStore::cull(const glm::vec4* frustum_planes)
+{
+	ZoneScoped; // for tracy
+
+	for (int i = 0; i < count; i += ENTITIES_PER_LANE)
+	{
+		const Vec8f cx = Vec8f().load(&center_x[i]);
+		const Vec8f cy = Vec8f().load(&center_y[i]);
+		const Vec8f cz = Vec8f().load(&center_z[i]);
+		const Vec8f r = Vec8f().load(&radius[i]);
+
+		// An entity is in view unless its bounding sphere lies completely
+		// behind one of the planes
+		Vec8fb in_view(true);
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4& plane = frustum_planes[p];
+			const Vec8f distance = mul_add(Vec8f(plane.x), cx, mul_add(Vec8f(plane.y), cy, mul_add(Vec8f(plane.z), cz, Vec8f(plane.w))));
+			in_view &= distance >= -r;
+		}
+
+		const uint8 bits = to_bits(in_view);
+		for (int k = 0; k < ENTITIES_PER_LANE; k++)
+		{
+			uint8& flags = render_flags[(size_t)i + k];
+			flags = (uint8)((flags & ~RENDER_FLAG_IN_VIEW) | (((bits >> k) & 1) ? RENDER_FLAG_IN_VIEW : 0));
+		}
+	}
+}
+
+glm::mat4 EntityStore::get_transform(int entity) const
+{
+	// glm matrices are column major
+	glm::mat4 transform(1.0f);
+	for (int row = 0; row < 3; row++)
+	{
+		for (int column = 0; column < 4; column++)
+		{
+			transform[column][row] = world[(size_t)row * 4 + column][entity];
+		}
+	}
+	return transform;
+}
+
+glm::vec3 EntityStore::get_bounds_center(int entity) const
+{
+	return glm::vec3(center_x[entity], center_y[entity], center_z[entity]);
+}
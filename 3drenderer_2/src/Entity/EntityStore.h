@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include "../Math/Rotator.h"
+#include "../Utils/3d_types.h"
+#include "../Utils/Colors.h"
+
+struct Mesh;
+
+// Bits of EntityStore::render_flags
+enum ERenderFlag : uint8
+{
+	RENDER_FLAG_VISIBLE = 1 << 0, // cleared to hide the entity
+	RENDER_FLAG_IN_VIEW = 1 << 1, // set by the culling pass
+};
+
+// Bits of EntityStore::transform_flags
+enum ETransformFlag : uint8
+{
+	TRANSFORM_LOCAL_DIRTY = 1 << 0, // translation, rotation or scale changed
+	TRANSFORM_WORLD_CHANGED = 1 << 1, // world matrix was rebuilt by the last update
+};
+
+/**
+ * Every mesh placed in the world, stored as one array per component rather
+ * than one object per entity. An entity is just an index into the arrays.
+ * The per-frame passes walk the arrays front to back eight entities at a time,
+ * so they are limited by memory bandwidth rather than by chasing pointers.
+ * The arrays are padded to a multiple of eight with hidden entities, which
+ * lets the SIMD loops run without a scalar tail.
+ *
+ * Entities form a hierarchy through their parent index. A parent is always
+ * created before its children, so walking the arrays in order visits every
+ * parent before any of its children. Local and world matrices are cached and
+ * only rebuilt when the entity or one of its ancestors has been marked dirty
+ */
+struct EntityStore
+{
+	int create(
+		Mesh* mesh,
+		glm::vec3 translation = glm::vec3(0.0f),
+		rot3 rotation = rot3(0.0f),
+		glm::vec3 scale = glm::vec3(1.0f),
+		uint32 tint = Colors::WHITE,
+		int parent_ = -1
+	);
+	void clear();
+	int size() const;
+
+	void set_translation(int entity, glm::vec3 translation);
+	void set_rotation(int entity, rot3 rotation);
+	void set_scale(int entity, glm::vec3 scale);
+	/** Swaps the mesh drawn by the entity, along with its bounds. A null mesh hides it */
+	void set_mesh(int entity, Mesh* mesh);
+	/** Must be called after writing to the transform arrays directly */
+	void mark_dirty(int entity);
+
+	/**
+	 * Rebuilds the matrices and world space bounds of the entities that were
+	 * marked dirty, along with everything attached to them
+	 */
+	void update_transforms();
+	/** Sets RENDER_FLAG_IN_VIEW on the entities whose bounds touch the frustum */
+	void cull(const glm::vec4* frustum_planes);
+
+	glm::mat4 get_transform(int entity) const;
+	glm::vec3 get_bounds_center(int entity) const;
+
+	void update_local_matrices();
+	void update_world_matrices();
+	void update_bounds();
+
+	int count = 0;
+
+	// Transform
+	std::vector<float> translation_x, translation_y, translation_z;
+	std::vector<float> pitch, yaw, roll; // in degrees
+	std::vector<float> scale_x, scale_y, scale_z;
+
+	/**
+	 * Local and world matrices, row major. Only the top three rows are stored,
+	 * the bottom row is always (0, 0, 0, 1)
+	 */
+	std::array<std::vector<float>, 12> local;
+	std::array<std::vector<float>, 12> world;
+
+	// Hierarchy
+	std::vector<int> parent; // -1 for entities attached to the world
+	std::vector<uint8> transform_flags;
+	bool has_dirty = false; // skips the transform passes when nothing moved
+
+	// Bounds. The local bounding sphere is copied from the mesh on creation.
+	// Entities without a mesh have an empty bounding sphere
+	std::vector<float> local_center_x, local_center_y, local_center_z, local_radius;
+	std::vector<float> center_x, center_y, center_z, radius; // world space
+
+	// Level of detail
+	std::vector<Mesh*> meshes;
+	std::vector<int> current_lod; // 0 is full resolution
+
+	// Rendering
+	std::vector<uint32> tints; // multiplied into the color of every pixel
+	std::vector<uint8> render_flags;
+};
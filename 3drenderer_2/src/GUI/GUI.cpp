@@ -1,12 +1,18 @@
 #include "GUI.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <string>
+
 #include <glm/trigonometric.hpp>
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_sdl.h>
 #include <imgui/imgui_impl_sdlrenderer.h>
-#include <tracy/tracy/Tracy.hpp>
 
 #include "../Logger/Logger.h"
+#include "../Mesh/TextureCache.h"
+#include "../Utils/PipelineStats.h"
+#include "../Utils/TraceRecorder.h"
 #include "../Window/Window.h"
 #include "../World/World.h"
 
@@ -99,13 +105,40 @@ void GUI::render() const
     }
     ImGui::End();
 
-    //// Performance counters log window
-    //if (ImGui::Begin("Performance Counters", nullptr, ImGuiWindowFlags_NoCollapse))
-    //{
-    //    std::vector<LogEntry>& perf_log = Logger::messages[LOG_CATEGORY_PERF_COUNTER];
-    //    print_log_messages(perf_log);
-    //}
-    //ImGui::End();
+    // Work done by each stage of the pipeline in the last frame
+    if (ImGui::Begin("Pipeline Statistics", nullptr, log_window_flags))
+    {
+        const PipelineStats& stats = frame_pipeline_stats;
+        for (int counter = 0; counter < NUM_PIPELINE_COUNTERS; counter++)
+        {
+            ImGui::Text("%s: %llu", PIPELINE_COUNTER_NAMES[counter], (unsigned long long)stats.counters[counter]);
+        }
+        ImGui::Text("overdraw: %.2f", stats.get_overdraw());
+
+        ImGui::Spacing();
+        ImGui::Separator();
+        ImGui::Spacing();
+
+        // Rasterized triangles by screen area, twice the area per bar
+        float triangle_sizes[NUM_TRIANGLE_SIZE_BUCKETS];
+        for (int bucket = 0; bucket < NUM_TRIANGLE_SIZE_BUCKETS; bucket++)
+        {
+            triangle_sizes[bucket] = (float)stats.triangle_sizes[bucket];
+        }
+        ImGui::Text("Triangle sizes, %s to %s pixels", get_triangle_size_bucket_name(0).c_str(), get_triangle_size_bucket_name(NUM_TRIANGLE_SIZE_BUCKETS - 1).c_str());
+        ImGui::PlotHistogram("##triangle sizes", triangle_sizes, NUM_TRIANGLE_SIZE_BUCKETS, 0, nullptr, 0.0f, FLT_MAX, ImVec2(260.0f, 80.0f));
+    }
+    ImGui::End();
+
+#ifdef PROFILING_ON
+    // Performance counters log window, the timed blocks of the last frame
+    if (ImGui::Begin("Performance Counters", nullptr, ImGuiWindowFlags_NoCollapse))
+    {
+        std::vector<LogEntry>& perf_log = Logger::messages[LOG_CATEGORY_PERF_COUNTER];
+        print_log_messages(perf_log);
+    }
+    ImGui::End();
+#endif
 
     // Light movement controls
     if (ImGui::Begin("Edit Light", nullptr, log_window_flags))
@@ -140,6 +173,196 @@ void GUI::render() const
     }
     ImGui::End();
 
+    // Level of detail controls
+    if (ImGui::Begin("Level of Detail", nullptr, log_window_flags))
+    {
+        ImGui::DragFloat("error threshold (px)", &world->lod_error_threshold, 0.05f, 0.0f, 100.0f, "%.2f");
+        ImGui::DragFloat("hysteresis", &world->lod_hysteresis, 0.01f, 0.0f, 0.95f, "%.2f");
+
+        ImGui::Spacing();
+        ImGui::Separator();
+        ImGui::Spacing();
+
+        // How many entities are drawn at each level
+        for (const std::unique_ptr<Mesh>& mesh : world->meshes)
+        {
+            for (int lod = 0; lod < mesh->num_lods(); lod++)
+            {
+                int num_entities = 0;
+                for (const int entity : world->visible_entities)
+                {
+                    num_entities += (world->entities.meshes[entity] == mesh.get() && world->entities.current_lod[entity] == lod) ? 1 : 0;
+                }
+                const int num_triangles = (int)mesh->get_lod_triangles(lod).size();
+                ImGui::Text("LOD %d (%d triangles): %d entities", lod, num_triangles, num_entities);
+            }
+        }
+    }
+    ImGui::End();
+
+    // Instancing controls
+    if (ImGui::Begin("Instances", nullptr, log_window_flags))
+    {
+        int crowd_size = world->crowd_size;
+        if (ImGui::DragInt("crowd size", &crowd_size, 1.0f, 1, 5000) && !world->meshes.empty())
+        {
+            world->spawn_crowd(world->meshes[0].get(), crowd_size);
+        }
+        ImGui::Text("%d entities, %d in view", world->entities.size(), (int)world->visible_entities.size());
+
+        ImGui::Spacing();
+        ImGui::Separator();
+        ImGui::Spacing();
+
+        // Models added here load in the background, a box stands in for them
+        // until they are ready
+        static const char* models[] = { "charizard", "crab", "cube", "drone", "efa", "f117", "f22", "koopa", "robot", "sphere" };
+        static int selected_model = 0;
+        ImGui::Combo("model", &selected_model, models, IM_ARRAYSIZE(models));
+        if (ImGui::Button("Place in front of the camera"))
+        {
+            const std::string filename = std::string("assets/models/") + models[selected_model] + "/" + models[selected_model] + ".obj";
+            world->spawn_async(filename.c_str(), world->camera.translation + world->camera.direction * 10.0f);
+        }
+        ImGui::Text("Loading: %d", world->asset_loader.num_loading);
+
+        ImGui::Spacing();
+        ImGui::Separator();
+        ImGui::Spacing();
+
+        // Meshes too large for memory, cut into chunks the first time they
+        // are opened and then streamed in around the camera
+        static char streamed_filename[256] = "assets/models/robot/robot.obj";
+        ImGui::InputText("out-of-core mesh", streamed_filename, sizeof(streamed_filename));
+        if (ImGui::Button("Stream in front of the camera"))
+        {
+            world->spawn_streamed(streamed_filename, world->camera.translation + world->camera.direction * 10.0f);
+        }
+        ImGui::DragInt("budget (MB)", &world->streaming_budget_mb, 1.0f, 1, 16384);
+        for (const StreamedMesh& streamed : world->streamed_meshes)
+        {
+            const ChunkedMesh& mesh = *streamed.mesh;
+            if (mesh.state == ASSET_LOADING)
+            {
+                ImGui::Text("%s: converting", mesh.filename.c_str());
+                continue;
+            }
+            ImGui::Text(
+                "%s: %d / %d chunks, %.1f MB",
+                mesh.filename.c_str(),
+                mesh.num_resident,
+                (int)mesh.chunks.size(),
+                (float)mesh.used_bytes / (1024.0f * 1024.0f)
+            );
+            ImGui::Text("Streaming: %d, loaded: %d, evicted: %d", mesh.num_in_flight, mesh.num_loaded, mesh.num_evicted);
+        }
+    }
+    ImGui::End();
+
+    // Cells of a large world loaded around the camera
+    if (ImGui::Begin("World Streaming", nullptr, log_window_flags))
+    {
+        static char world_filename[256] = "assets/worlds/sample.world";
+        ImGui::InputText("world", world_filename, sizeof(world_filename));
+        if (ImGui::Button("Load world"))
+        {
+            world->load_world(world_filename);
+        }
+
+        WorldStreamer& streamer = world->world_streamer;
+        ImGui::DragFloat("load radius", &streamer.load_radius, 1.0f, 0.0f, 10000.0f, "%.0f");
+        ImGui::DragFloat("unload radius", &streamer.unload_radius, 1.0f, streamer.load_radius, 10000.0f, "%.0f");
+        int budget_mb = (int)(streamer.memory_budget >> 20);
+        if (ImGui::DragInt("budget (MB)", &budget_mb, 1.0f, 1, 16384))
+        {
+            streamer.memory_budget = (size_t)budget_mb << 20;
+        }
+        ImGui::Text("Cells: %d loaded, %d loading, %d total", streamer.num_loaded, streamer.num_loading, (int)streamer.cells.size());
+        ImGui::Text("Meshes: %d, %.1f MB", (int)streamer.assets.size(), (float)streamer.used_bytes / (1024.0f * 1024.0f));
+    }
+    ImGui::End();
+
+    // Texture memory
+    if (ImGui::Begin("Textures", nullptr, log_window_flags))
+    {
+        static const char* format_names[] = { "ARGB8888", "BC1", "BC3" };
+        for (const std::unique_ptr<Mesh>& mesh : world->meshes)
+        {
+            for (const std::shared_ptr<Texture>& texture : mesh->textures)
+            {
+                if (!texture)
+                {
+                    continue;
+                }
+                ImGui::Text(
+                    "%dx%d %s, %d levels: %.1f KB",
+                    texture->width,
+                    texture->height,
+                    format_names[texture->format],
+                    (int)texture->mips.size(),
+                    (float)texture->memory_size / 1024.0f
+                );
+            }
+        }
+
+        // Textures shared between meshes only count once here
+        const TextureCacheStats stats = get_texture_cache_stats();
+        ImGui::Text("Total: %d textures, %.2f MB", stats.num_textures, (float)stats.memory_size / (1024.0f * 1024.0f));
+        ImGui::Text("Decoded: %d, reused: %d", stats.num_misses, stats.num_hits);
+
+        ImGui::Spacing();
+        ImGui::Separator();
+        ImGui::Spacing();
+
+        // Virtual texture pages
+        const VirtualTextureCache& cache = world->virtual_textures;
+        const float page_size = (float)(VIRTUAL_PAGE_TEXELS * sizeof(uint32)) / (1024.0f * 1024.0f);
+        ImGui::Text("Pages: %d / %d (%.2f MB)", cache.num_resident, cache.max_pages, (float)cache.max_pages * page_size);
+        ImGui::Text("Missing: %d, streaming: %d", cache.num_missing, cache.num_in_flight);
+        ImGui::Text("Loaded: %d, evicted: %d", cache.num_loaded, cache.num_evicted);
+    }
+    ImGui::End();
+
+    // Entity movement controls
+    if (ImGui::Begin("Edit Entity", nullptr, log_window_flags))
+    {
+        EntityStore& entities = world->entities;
+
+        static int selected = 0;
+        ImGui::DragInt("entity", &selected, 0.1f, 0, std::max(entities.size() - 1, 0));
+        selected = std::clamp(selected, 0, std::max(entities.size() - 1, 0));
+
+        if (selected < entities.size())
+        {
+            ImGui::Text("Parent: %d", entities.parent[selected]);
+
+            ImGui::Spacing();
+            ImGui::Separator();
+            ImGui::Spacing();
+
+            // Only mark the entity dirty when a value was actually edited, so
+            // static entities stay free in the transform stage
+            glm::vec3 translation(entities.translation_x[selected], entities.translation_y[selected], entities.translation_z[selected]);
+            if (ImGui::DragFloat3("position", &translation.x, 0.01f, 0.0f, 0.0f, "%.2f"))
+            {
+                entities.set_translation(selected, translation);
+            }
+
+            glm::vec3 rotation(entities.pitch[selected], entities.yaw[selected], entities.roll[selected]);
+            if (ImGui::DragFloat3("rotation", &rotation.x, 0.5f, 0.0f, 0.0f, "%.2f"))
+            {
+                entities.set_rotation(selected, rot3(rotation.x, rotation.y, rotation.z));
+            }
+
+            glm::vec3 scale(entities.scale_x[selected], entities.scale_y[selected], entities.scale_z[selected]);
+            if (ImGui::DragFloat3("scale", &scale.x, 0.01f, 0.0f, 0.0f, "%.2f"))
+            {
+                entities.set_scale(selected, scale);
+            }
+        }
+    }
+    ImGui::End();
+
     //ImGui::ShowDemoWindow();
 
     ImGui::Render();
@@ -1,11 +1,11 @@
 #include "Graphics.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <limits>
 
-#include <tracy/tracy/Tracy.hpp>
 #include <vectorclass/vectorclass.h>
 
 #include "../Math/Math3D.h"
@@ -15,6 +15,10 @@
 #include "../Viewport/Viewport.h"
 #include "../Triangle/Triangle.h"
 #include "../Utils/Colors.h"
+#include "../Utils/CycleCounters.h"
+#include "../Utils/PipelineStats.h"
+#include "../Utils/TraceRecorder.h"
+#include "../Utils/image_io.h"
 
 #ifdef _MSC_VER // Windows
 #include <SDL.h>
@@ -27,6 +31,7 @@ SDL_Renderer* renderer = nullptr;
 uint32* framebuffer = nullptr;
 SDL_Texture* framebuffer_texture = nullptr;
 float* depth_buffer = nullptr;
+uint32* pixel_counts = nullptr; // per pixel, for the debug views
 
 void graphics_init(SDL_Renderer* renderer_, Viewport* viewport_)
 {
@@ -39,17 +44,23 @@ void initialize_framebuffer()
 	framebuffer = new uint32[(size_t)viewport->width * viewport->height];
 	assert(framebuffer);
 
-	framebuffer_texture = SDL_CreateTexture(
-		renderer,
-		SDL_PIXELFORMAT_ARGB8888,
-		SDL_TEXTUREACCESS_STREAMING,
-		viewport->width,
-		viewport->height
-	);
-	assert(framebuffer_texture);
+	// Without an SDL renderer the frames are only kept in memory
+	if (renderer)
+	{
+		framebuffer_texture = SDL_CreateTexture(
+			renderer,
+			SDL_PIXELFORMAT_ARGB8888,
+			SDL_TEXTUREACCESS_STREAMING,
+			viewport->width,
+			viewport->height
+		);
+		assert(framebuffer_texture);
+	}
 
 	depth_buffer = new float[(size_t)viewport->width * viewport->height];
 	assert(framebuffer);
+
+	pixel_counts = new uint32[(size_t)viewport->width * viewport->height]();
 }
 
 void free_framebuffer()
@@ -57,7 +68,30 @@ void free_framebuffer()
 	// Free the resources allocated
 	delete[] framebuffer;
 	delete[] depth_buffer;
-	SDL_DestroyTexture(framebuffer_texture);
+	delete[] pixel_counts;
+	if (framebuffer_texture)
+	{
+		SDL_DestroyTexture(framebuffer_texture);
+	}
+	framebuffer = nullptr;
+	depth_buffer = nullptr;
+	pixel_counts = nullptr;
+	framebuffer_texture = nullptr;
+}
+
+const uint32* get_framebuffer()
+{
+	return framebuffer;
+}
+
+const float* get_depth_buffer()
+{
+	return depth_buffer;
+}
+
+bool save_framebuffer_ppm(const char* filename)
+{
+	return save_ppm(filename, framebuffer, viewport->width, viewport->height);
 }
 
 void clear_framebuffer(uint32 color)
@@ -84,6 +118,9 @@ void clear_framebuffer(uint32 color)
 	}
 }
 
+// Pixels that still hold this depth haven't been drawn to this frame
+constexpr float CLEARED_DEPTH = std::numeric_limits<float>::max();
+
 void clear_z_buffer()
 {
 	ZoneScoped; // for tracy
@@ -91,11 +128,9 @@ void clear_z_buffer()
 	const size_t size = (size_t)viewport->width * viewport->height;
 	const size_t loop_count = size / 8;
 
-	constexpr float MAX = std::numeric_limits<float>::max();
-
 	// Set up a register with 8 float values set to the max possible value for a
 	// float. We'll only render pixels if they are in front (less) of this value
-	const Vec8f v(MAX);
+	const Vec8f v(CLEARED_DEPTH);
 
 	size_t i;
 	// Eight pixels at a time until we have less than eight remaining
@@ -107,14 +142,26 @@ void clear_z_buffer()
 	// Clear the remaining values in the buffer
 	for (; i < size; i++)
 	{
-		depth_buffer[i] = MAX;
+		depth_buffer[i] = CLEARED_DEPTH;
 	}
 }
 
+void clear_pixel_counts()
+{
+	ZoneScoped; // for tracy
+
+	std::fill(pixel_counts, pixel_counts + (size_t)viewport->width * viewport->height, 0u);
+}
+
 void update_framebuffer()
 {
 	ZoneScoped; // for tracy
 
+	if (!renderer)
+	{
+		return;
+	}
+
 	SDL_UpdateTexture(
 		framebuffer_texture,
 		nullptr,
@@ -129,7 +176,10 @@ void render_frame()
 {
 	ZoneScoped; // for tracy
 
-	SDL_RenderPresent(renderer);
+	if (renderer)
+	{
+		SDL_RenderPresent(renderer);
+	}
 }
 
 void draw_pixel(const glm::ivec2& p, uint32 color)
@@ -193,7 +243,7 @@ void draw_line_bresenham(
 	uint32 color
 )
 {
-	ZoneScoped; // for tracy
+	ZoneScopedTriangle; // for tracy
 
 	const int dx = abs(end.x - start.x);
 	const int dy = abs(end.y - start.y);
@@ -245,7 +295,7 @@ void draw_line_bresenham_3d(
 	uint32 color
 )
 {
-	ZoneScoped; // for tracy
+	ZoneScopedTriangle; // for tracy
 
 	const int dx = abs(end.x - start.x);
 	const int dy = abs(end.y - start.y);
@@ -267,6 +317,9 @@ void draw_line_bresenham_3d(
 
 	int index;
 	float curr_len, pct;
+	int num_tested = 0;
+	int num_passed = 0;
+	int num_overdrawn = 0;
 
 	glm::ivec2 p;
 	// Loop until the line is drawn
@@ -287,8 +340,12 @@ void draw_line_bresenham_3d(
 			depth = start_z + (dz * pct);
 
 			// Perform a depth check using the z-buffer
+			num_tested++;
 			if (depth <= depth_buffer[index])
 			{
+				num_passed++;
+				num_overdrawn += depth_buffer[index] != CLEARED_DEPTH;
+
 				// Render the pixel
 				depth_buffer[index] = depth;
 				p.x = current_x;
@@ -316,6 +373,11 @@ void draw_line_bresenham_3d(
 			error += dx;
 		}
 	}
+
+	PipelineStats& stats = get_thread_pipeline_stats();
+	stats.counters[PIPELINE_PIXELS_TESTED] += num_tested;
+	stats.counters[PIPELINE_PIXELS_PASSED] += num_passed;
+	stats.counters[PIPELINE_PIXELS_OVERDRAWN] += num_overdrawn;
 }
 
 
@@ -334,7 +396,7 @@ void draw_line_bresenham_3d_no_zfight(
 	uint32 color
 )
 {
-	ZoneScoped; // for tracy
+	ZoneScopedTriangle; // for tracy
 
 	const int dx = abs(end.x - start.x);
 	const int dy = abs(end.y - start.y);
@@ -420,7 +482,7 @@ void draw_line_bresenham_3d_no_zfight(
 
 void draw_wireframe(const Triangle& triangle, const uint32 color)
 {
-	ZoneScoped; // for tracy
+	ZoneScopedTriangle; // for tracy
 
 	const glm::ivec2 a = { lrintf(triangle.vertices[0].position.x), lrintf(triangle.vertices[0].position.y) };
 	const glm::ivec2 b = { lrintf(triangle.vertices[1].position.x), lrintf(triangle.vertices[1].position.y) };
@@ -432,7 +494,7 @@ void draw_wireframe(const Triangle& triangle, const uint32 color)
 
 void draw_wireframe_3d(const Triangle& triangle, const uint32 color)
 {
-	ZoneScoped; // for tracy
+	ZoneScopedTriangle; // for tracy
 
 	const glm::ivec2 a = { lrintf(triangle.vertices[0].position.x), lrintf(triangle.vertices[0].position.y) };
 	const glm::ivec2 b = { lrintf(triangle.vertices[1].position.x), lrintf(triangle.vertices[1].position.y) };
@@ -457,7 +519,8 @@ void draw_solid(
 	EShadingMode shading_mode
 )
 {
-	ZoneScoped; // for tracy
+	ZoneScopedTriangle; // for tracy
+	TIMED_BLOCK("Draw solid");
 
 	const glm::vec2 v0 = { triangle.vertices[0].position.x, triangle.vertices[0].position.y };
 	const glm::vec2 v1 = { triangle.vertices[1].position.x, triangle.vertices[1].position.y };
@@ -498,6 +561,9 @@ void draw_solid(
 	float depth, current_depth;
 	float pixel_intensity;
 	int index;
+	int num_tested = 0;
+	int num_passed = 0;
+	int num_overdrawn = 0;
 
 	glm::vec2 p;
 	glm::ivec2 p_i;
@@ -525,11 +591,14 @@ void draw_solid(
 				// behind (front to back)
 				index = viewport->width * (viewport->height - y - 1) + x;
 				current_depth = depth_buffer[index];
+				num_tested++;
 				if (depth >= current_depth)
 				{
 					continue;
 				}
 				depth_buffer[index] = depth;
+				num_passed++;
+				num_overdrawn += current_depth != CLEARED_DEPTH;
 
 				p_i.x = x;
 				p_i.y = y;
@@ -564,14 +633,21 @@ void draw_solid(
 			}
 		}
 	}
+
+	PipelineStats& stats = get_thread_pipeline_stats();
+	stats.counters[PIPELINE_PIXELS_TESTED] += num_tested;
+	stats.counters[PIPELINE_PIXELS_PASSED] += num_passed;
+	stats.counters[PIPELINE_PIXELS_OVERDRAWN] += num_overdrawn;
 }
 
 void draw_textured(
 	const Triangle& triangle, 
-	EShadingMode shading_mode
+	EShadingMode shading_mode,
+	ETextureFilter texture_filter
 )
 {
-	ZoneScoped; // for tracy
+	ZoneScopedTriangle; // for tracy
+	TIMED_BLOCK("Draw textured");
 
 	// x, y coordinates in screen space (x/w, y/w)
 	const glm::vec2 v0 = { triangle.vertices[0].position.x, triangle.vertices[0].position.y };
@@ -601,7 +677,11 @@ void draw_textured(
 	const float v1_intensity = triangle.vertices[1].gouraud;
 	const float v2_intensity = triangle.vertices[2].gouraud;
 
-	const std::shared_ptr<Texture> texture = triangle.texture;
+	const Texture* texture = triangle.texture;
+
+	// Instance tint, skipped for the common untinted case
+	const uint32 tint = triangle.color;
+	const bool is_tinted = tint != Colors::WHITE;
 
 	// Calculate triangle bounding box
 	int min_x = std::min({ lrintf(v0.x), lrintf(v1.x), lrintf(v2.x) });
@@ -644,6 +724,10 @@ void draw_textured(
 	const float area2 = Math3D::orient2d_f(v0, v1, v2);
 	const float inv_area2 = 1.0f / area2;
 
+	// Pick the mip level once for the whole triangle
+	const float lod = compute_texture_lod(*texture, uv0, uv1, uv2, area2);
+	const int texels_per_sample = get_texels_per_sample(*texture, lod, texture_filter);
+
 	// Normalize the screen space z coordinates (TODO: do we need to do the same with 1/w?)
 	v0z *= inv_area2;
 	v1z *= inv_area2;
@@ -657,7 +741,9 @@ void draw_textured(
 	float A, B, C, ABC;
 	float depth, current_depth;
 	int index;
-	int tex_x, tex_y, tex_index;
+	int num_tested = 0;
+	int num_passed = 0;
+	int num_overdrawn = 0;
 
 	glm::vec2 p;
 	glm::ivec2 p_i;
@@ -682,11 +768,14 @@ void draw_textured(
 				// behind (front to back)
 				index = viewport->width * (viewport->height - y - 1) + x;
 				current_depth = depth_buffer[index];
+				num_tested++;
 				if (depth >= current_depth)
 				{
 					continue;
 				}
 				depth_buffer[index] = depth;
+				num_passed++;
+				num_overdrawn += current_depth != CLEARED_DEPTH;
 
 				// Interpolate 1/w
 				A = inv_w0 * alpha;
@@ -703,10 +792,11 @@ void draw_textured(
 				v *= ABC;
 
 				// Look up texel value and set pixel color
-				tex_x = abs((int)(u * (float)texture->width)) % texture->width;
-				tex_y = abs((int)(v * (float)texture->height)) % texture->height;
-				tex_index = texture->width * (texture->height - tex_y - 1) + tex_x;
-				uint32 color = texture->pixels[tex_index];
+				uint32 color = sample_texture(*texture, u, v, lod, texture_filter);
+				if (is_tinted)
+				{
+					color = apply_tint(color, tint);
+				}
 
 				p_i.x = x;
 				p_i.y = y;
@@ -747,6 +837,149 @@ void draw_textured(
 			}
 		}
 	}
+
+	PipelineStats& stats = get_thread_pipeline_stats();
+	stats.counters[PIPELINE_PIXELS_TESTED] += num_tested;
+	stats.counters[PIPELINE_PIXELS_PASSED] += num_passed;
+	stats.counters[PIPELINE_PIXELS_OVERDRAWN] += num_overdrawn;
+	stats.counters[PIPELINE_TEXELS_FETCHED] += (uint64)num_passed * texels_per_sample;
+}
+
+void draw_depth_complexity(const Triangle& triangle, bool count_rejections)
+{
+	ZoneScopedTriangle; // for tracy
+
+	const glm::vec2 v0 = { triangle.vertices[0].position.x, triangle.vertices[0].position.y };
+	const glm::vec2 v1 = { triangle.vertices[1].position.x, triangle.vertices[1].position.y };
+	const glm::vec2 v2 = { triangle.vertices[2].position.x, triangle.vertices[2].position.y };
+
+	const float v0z = triangle.vertices[0].position.z;
+	const float v1z = triangle.vertices[1].position.z;
+	const float v2z = triangle.vertices[2].position.z;
+
+	// Calculate triangle bounding box, clipped to the screen
+	const int min_x = std::max((int)std::min({ lrintf(v0.x), lrintf(v1.x), lrintf(v2.x) }), 0);
+	const int max_x = std::min((int)std::max({ lrintf(v0.x), lrintf(v1.x), lrintf(v2.x) }), viewport->width - 1);
+	const int min_y = std::max((int)std::min({ lrintf(v0.y), lrintf(v1.y), lrintf(v2.y) }), 0);
+	const int max_y = std::min((int)std::max({ lrintf(v0.y), lrintf(v1.y), lrintf(v2.y) }), viewport->height - 1);
+
+	const float inv_area2 = 1.0f / Math3D::orient2d_f(v0, v1, v2);
+
+	int num_tested = 0;
+	int num_passed = 0;
+	int num_overdrawn = 0;
+
+	// Same coverage and depth test as draw_solid(), counting instead of shading
+	glm::vec2 p;
+	for (int x = min_x; x <= max_x; x++) {
+		for (int y = min_y; y <= max_y; y++) {
+			p.x = (float)x;
+			p.y = (float)y;
+
+			const float alpha = Math3D::orient2d_f(v1, v2, p) * inv_area2;
+			const float beta = Math3D::orient2d_f(v2, v0, p) * inv_area2;
+			const float gamma = Math3D::orient2d_f(v0, v1, p) * inv_area2;
+			if (alpha < 0.0f || beta < 0.0f || gamma < 0.0f)
+			{
+				continue;
+			}
+
+			const float depth = v0z * alpha + v1z * beta + v2z * gamma;
+			const int index = viewport->width * (viewport->height - y - 1) + x;
+			const float current_depth = depth_buffer[index];
+			num_tested++;
+			const bool is_rejected = depth >= current_depth;
+			if (is_rejected == count_rejections)
+			{
+				// Triangles overlapping on other threads count the same pixels
+				std::atomic_ref<uint32>(pixel_counts[index]).fetch_add(1, std::memory_order_relaxed);
+			}
+			if (is_rejected)
+			{
+				continue;
+			}
+			depth_buffer[index] = depth;
+			num_passed++;
+			num_overdrawn += current_depth != CLEARED_DEPTH;
+		}
+	}
+
+	PipelineStats& stats = get_thread_pipeline_stats();
+	stats.counters[PIPELINE_PIXELS_TESTED] += num_tested;
+	stats.counters[PIPELINE_PIXELS_PASSED] += num_passed;
+	stats.counters[PIPELINE_PIXELS_OVERDRAWN] += num_overdrawn;
+}
+
+void draw_depth_heatmap()
+{
+	ZoneScoped; // for tracy
+
+	const size_t size = (size_t)viewport->width * viewport->height;
+
+	// Stretch the depths of the frame over the whole ramp, most of them are
+	// close to the far plane after the perspective divide
+	float min_depth = CLEARED_DEPTH;
+	float max_depth = -CLEARED_DEPTH;
+	for (size_t i = 0; i < size; i++)
+	{
+		if (depth_buffer[i] != CLEARED_DEPTH)
+		{
+			min_depth = std::min(min_depth, depth_buffer[i]);
+			max_depth = std::max(max_depth, depth_buffer[i]);
+		}
+	}
+	const float scale = max_depth > min_depth ? 1.0f / (max_depth - min_depth) : 0.0f;
+
+	// Near is bright, nothing drawn is black
+	for (size_t i = 0; i < size; i++)
+	{
+		framebuffer[i] = depth_buffer[i] == CLEARED_DEPTH
+							 ? Colors::BLACK
+							 : get_zbuffer_color(1.0f - (depth_buffer[i] - min_depth) * scale);
+	}
+}
+
+void draw_count_heatmap(uint32 max_count)
+{
+	ZoneScoped; // for tracy
+
+	const size_t size = (size_t)viewport->width * viewport->height;
+	for (size_t i = 0; i < size; i++)
+	{
+		framebuffer[i] = pixel_counts[i] == 0
+							 ? Colors::BLACK
+							 : get_heatmap_color((float)std::min(pixel_counts[i], max_count) / (float)max_count);
+	}
+}
+
+void draw_tile_heatmap(const float* tile_costs, int tile_size)
+{
+	ZoneScoped; // for tracy
+
+	const int tiles_x = (viewport->width + tile_size - 1) / tile_size;
+	const int tiles_y = (viewport->height + tile_size - 1) / tile_size;
+	float max_cost = 0.0f;
+	for (int i = 0; i < tiles_x * tiles_y; i++)
+	{
+		max_cost = std::max(max_cost, tile_costs[i]);
+	}
+	const float scale = max_cost > 0.0f ? 1.0f / max_cost : 0.0f;
+
+	// Half the ramp over half the frame, so the model can still be made out
+	for (int y = 0; y < viewport->height; y++)
+	{
+		const float* row_costs = &tile_costs[(y / tile_size) * tiles_x];
+		uint32* row = &framebuffer[(size_t)viewport->width * (viewport->height - y - 1)];
+		for (int x = 0; x < viewport->width; x++)
+		{
+			const float cost = row_costs[x / tile_size];
+			if (cost > 0.0f)
+			{
+				const uint32 heat = get_heatmap_color(cost * scale);
+				row[x] = 0xFF000000 | (((row[x] >> 1) & 0x7F7F7F) + ((heat >> 1) & 0x7F7F7F));
+			}
+		}
+	}
 }
 
 /**
@@ -932,13 +1165,43 @@ bool is_top_left(const glm::ivec2& a, const glm::ivec2& b)
 uint32 get_zbuffer_color(const float val)
 {
 	// Convert to 8 bits (0-255)
-	const uint8 color = (uint8)(val * 255.0f + 0.5f);
-	const uint8 alpha = 0xFF;
-	// Return the 32-bit BGRA value
-	const uint32 result = (color << 24) | (color << 16) | (color << 8) | alpha;
+	const uint32 color = (uint8)(val * 255.0f + 0.5f);
+	// Return the 32-bit ARGB value the framebuffer holds
+	const uint32 result = 0xFF000000 | (color << 16) | (color << 8) | color;
 	return result;
 }
 
+uint32 get_heatmap_color(const float t)
+{
+	// Blue, cyan, green, yellow and red, evenly spaced
+	static const glm::vec3 RAMP[] = {
+		{ 0.0f, 0.0f, 1.0f },
+		{ 0.0f, 1.0f, 1.0f },
+		{ 0.0f, 1.0f, 0.0f },
+		{ 1.0f, 1.0f, 0.0f },
+		{ 1.0f, 0.0f, 0.0f },
+	};
+	constexpr int LAST = (int)(sizeof(RAMP) / sizeof(RAMP[0])) - 1;
+
+	const float x = std::clamp(t, 0.0f, 1.0f) * (float)LAST;
+	const int i = std::min((int)x, LAST - 1);
+	const glm::vec3 color = RAMP[i] + (RAMP[i + 1] - RAMP[i]) * (x - (float)i);
+	return 0xFF000000
+		   | ((uint32)(color.r * 255.0f + 0.5f) << 16)
+		   | ((uint32)(color.g * 255.0f + 0.5f) << 8)
+		   | (uint32)(color.b * 255.0f + 0.5f);
+}
+
+uint32 apply_tint(const uint32 color, const uint32 tint)
+{
+	// Multiply each 8 bit channel, rounding (x * y + 255) / 256
+	const uint32 r = (((color >> 16) & 0xFF) * ((tint >> 16) & 0xFF) + 0xFF) >> 8;
+	const uint32 g = (((color >> 8) & 0xFF) * ((tint >> 8) & 0xFF) + 0xFF) >> 8;
+	const uint32 b = (((color >> 0) & 0xFF) * ((tint >> 0) & 0xFF) + 0xFF) >> 8;
+	const uint32 out = (color & 0xFF000000) | (r << 16) | (g << 8) | b;
+	return out;
+}
+
 uint32 apply_intensity(const uint32 color, const float intensity)
 {
 	// Unpack and convert to float
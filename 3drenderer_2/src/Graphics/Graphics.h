@@ -6,6 +6,7 @@
 #include <glm/vec3.hpp>
 
 #include "../Renderer/ShadingMode.h"
+#include "../Renderer/TextureFilter.h"
 #include "../Utils/3d_types.h"
 
 struct Gizmo;
@@ -15,14 +16,24 @@ struct SDL_Texture;
 struct Triangle;
 struct Viewport;
 
-/** Initialization and freeing of resources */
+/**
+ * Initialization and freeing of resources. Without an SDL renderer (headless)
+ * the frames only end up in the framebuffer, and presenting them does nothing
+ */
 void graphics_init(SDL_Renderer* renderer_, Viewport* viewport_);
 void initialize_framebuffer();
 void free_framebuffer();
 
+/** The last frame rendered, ARGB8888 rows from the top, viewport sized */
+const uint32* get_framebuffer();
+const float* get_depth_buffer();
+/** Writes the framebuffer to a binary PPM image */
+bool save_framebuffer_ppm(const char* filename);
+
 /** Clearing and updating the buffers */
 void clear_framebuffer(uint32 color);
 void clear_z_buffer();
+void clear_pixel_counts();
 void update_framebuffer();
 void render_frame();
 
@@ -64,7 +75,22 @@ void draw_wireframe_3d(const Triangle& triangle, uint32 color);
 
 /** Solid drawing algorithms */
 void draw_solid(const Triangle& triangle, uint32 color, EShadingMode shading_mode);
-void draw_textured(const Triangle& triangle, EShadingMode shading_mode);
+void draw_textured(
+	const Triangle& triangle,
+	EShadingMode shading_mode,
+	ETextureFilter texture_filter
+);
+
+/**
+ * Debug views. draw_depth_complexity() depth tests a triangle without shading
+ * it, counting per pixel either the times it passes (overdraw) or the times it
+ * fails (rejections). The heatmaps then replace the framebuffer with the depth
+ * buffer, those counts, or a cost per tile of the screen blended over the frame
+ */
+void draw_depth_complexity(const Triangle& triangle, bool count_rejections);
+void draw_depth_heatmap();
+void draw_count_heatmap(uint32 max_count);
+void draw_tile_heatmap(const float* tile_costs, int tile_size);
 
 /** Misc. drawing algorithms */
 void draw_vertices(const Triangle& triangle, int point_size, uint32 color);
@@ -74,4 +100,7 @@ void draw_gizmo(const Gizmo& gizmo);
 bool is_in_viewport(const glm::ivec2& p);
 bool is_top_left(const glm::ivec2& a, const glm::ivec2& b);
 uint32 get_zbuffer_color(float val);
-uint32 apply_intensity(uint32 color, float intensity);
\ No newline at end of file
+/** Blue through cyan, green and yellow to red, for t from 0 to 1 */
+uint32 get_heatmap_color(float t);
+uint32 apply_intensity(uint32 color, float intensity);
+uint32 apply_tint(uint32 color, uint32 tint);
\ No newline at end of file
@@ -1,9 +1,8 @@
 #include "Math3D.h"
 
-#include <tracy/tracy/Tracy.hpp>
-
 #include "../Camera/Camera.h"
 #include "../Viewport/Viewport.h"
+#include "../Utils/TraceRecorder.h"
 #include "../Utils/math_helpers.h"
 
 glm::mat4 Math3D::create_projection_matrix(const Camera& camera)
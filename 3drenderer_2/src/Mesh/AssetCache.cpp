@@ -0,0 +1,451 @@
+#include "AssetCache.h"
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Mesh.h"
+#include "TextureCache.h"
+#include "../Triangle/Triangle.h"
+#include "../Utils/MappedFile.h"
+#include "../Utils/TraceRecorder.h"
+
+constexpr char MESH_MAGIC[4] = { 'M', 'E', 'S', 'H' };
+constexpr char TEXTURE_MAGIC[4] = { 'T', 'E', 'X', 'R' };
+
+static_assert(std::is_trivially_copyable_v<Triangle>, "Triangles are stored raw");
+static_assert(std::is_trivially_copyable_v<Meshlet>, "Meshlets are stored raw");
+
+static bool get_source_stamp(const char* filename, uint64& size, int64& time)
+{
+	std::error_code error;
+	size = (uint64)std::filesystem::file_size(filename, error);
+	if (error)
+	{
+		return false;
+	}
+	time = (int64)std::filesystem::last_write_time(filename, error).time_since_epoch().count();
+	return !error;
+}
+
+/**
+ * Readable name of the cache file of an asset, with a hash of its canonical
+ * path and variant so assets with the same name in different folders or
+ * loaded with different options don't collide
+ */
+std::string get_asset_cache_path(const char* filename, const std::string& variant, const char* extension)
+{
+	std::error_code error;
+	std::filesystem::path path = std::filesystem::weakly_canonical(filename, error);
+	if (error)
+	{
+		path = std::filesystem::absolute(filename, error).lexically_normal();
+	}
+	const std::string key = path.generic_string() + "|" + variant;
+
+	// FNV-1a
+	uint64 hash = 14695981039346656037ull;
+	for (const char c : key)
+	{
+		hash = (hash ^ (uint8)c) * 1099511628211ull;
+	}
+	char hash_string[17];
+	snprintf(hash_string, sizeof(hash_string), "%016llx", (unsigned long long)hash);
+
+	const std::string name = path.filename().string() + "_" + hash_string + extension;
+	return (std::filesystem::path(ASSET_CACHE_DIRECTORY) / name).string();
+}
+
+static std::string get_texture_variant(const TextureLoadOptions& options)
+{
+	return "format=" + std::to_string((int)options.format) + (options.virtual_texture ? "|virtual" : "");
+}
+
+/** Loading threads that write the same asset at once each get their own file */
+std::string get_asset_cache_temp_path(const std::string& cache_path)
+{
+	static std::atomic<uint32> counter = 0;
+	return cache_path + "." + std::to_string(counter++) + ".tmp";
+}
+
+/** Maps the cache file and checks it was built from the current source file */
+std::shared_ptr<MappedFile> open_asset_cache_file(
+	const std::string& cache_path,
+	const char* source,
+	const char* magic,
+	uint32 layout_size
+)
+{
+	uint64 source_size;
+	int64 source_time;
+	if (!get_source_stamp(source, source_size, source_time))
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>();
+	if (!mapping->open(cache_path.c_str()) || mapping->size < sizeof(AssetCacheHeader))
+	{
+		return nullptr;
+	}
+
+	AssetCacheHeader header;
+	memcpy(&header, mapping->data, sizeof(header));
+	const bool is_current = memcmp(header.magic, magic, 4) == 0
+							&& header.version == ASSET_CACHE_VERSION
+							&& header.layout_size == layout_size
+							&& header.source_size == source_size
+							&& header.source_time == source_time;
+	return is_current ? mapping : nullptr;
+}
+
+/**
+ * Writes to a temporary file that only replaces the cache file once it is
+ * complete, so a crash or another instance never sees half a cache file
+ */
+bool begin_asset_cache_file(
+	CacheWriter& writer,
+	const std::string& temp_path,
+	const char* source,
+	const char* magic,
+	uint32 layout_size
+)
+{
+	AssetCacheHeader header = {};
+	memcpy(header.magic, magic, 4);
+	header.version = ASSET_CACHE_VERSION;
+	header.layout_size = layout_size;
+	if (!get_source_stamp(source, header.source_size, header.source_time))
+	{
+		return false;
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(ASSET_CACHE_DIRECTORY, error);
+	writer.file.open(temp_path, std::ios::binary | std::ios::trunc);
+	if (!writer.file)
+	{
+		std::cerr << "Failed to create the cache file " << temp_path << ".\n";
+		return false;
+	}
+	writer.write(header);
+	return true;
+}
+
+void end_asset_cache_file(CacheWriter& writer, const std::string& temp_path, const std::string& cache_path)
+{
+	writer.file.close();
+
+	std::error_code error;
+	if (writer.file.fail())
+	{
+		std::cerr << "Failed to write the cache file " << temp_path << ".\n";
+		std::filesystem::remove(temp_path, error);
+		return;
+	}
+	std::filesystem::rename(temp_path, cache_path, error);
+	if (error)
+	{
+		std::filesystem::remove(temp_path, error);
+	}
+}
+
+static int get_num_pages(const MipLevel& level)
+{
+	return level.pages_per_row * (level.height >> VIRTUAL_PAGE_SHIFT);
+}
+
+std::shared_ptr<Texture> load_cached_texture(const char* filename, const TextureLoadOptions& options)
+{
+	ZoneScoped; // for tracy
+
+	const std::string cache_path = get_asset_cache_path(filename, get_texture_variant(options), ".texture");
+	std::shared_ptr<MappedFile> mapping = open_asset_cache_file(cache_path, filename, TEXTURE_MAGIC, sizeof(MipLevel));
+	if (!mapping)
+	{
+		return nullptr;
+	}
+
+	CacheReader reader = { mapping->data, mapping->size, sizeof(AssetCacheHeader) };
+
+	std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+	texture->format = (ETextureFormat)reader.read<uint32>();
+	texture->width = reader.read<int32>();
+	texture->height = reader.read<int32>();
+	const int num_levels = reader.read<int32>();
+	texture->num_virtual_levels = reader.read<int32>();
+	texture->memory_size = 0;
+	if (!reader.is_valid || texture->format > TEXTURE_FORMAT_BC3 || num_levels <= 0 || num_levels > 32 || texture->num_virtual_levels > num_levels)
+	{
+		return nullptr;
+	}
+
+	texture->mips.resize(num_levels);
+	for (int i = 0; i < num_levels; i++)
+	{
+		MipLevel& level = texture->mips[i];
+		const int32 width = reader.read<int32>();
+		const int32 height = reader.read<int32>();
+		if (width <= 0 || height <= 0 || (width & (width - 1)) || (height & (height - 1)))
+		{
+			return nullptr;
+		}
+		set_level_size(level, width, height);
+		const uint64 data_size = reader.read<uint64>();
+		const uint8* data = reader.read_bytes(data_size, CACHE_ALIGNMENT);
+		if (!data)
+		{
+			return nullptr;
+		}
+
+		const bool is_virtual = i < texture->num_virtual_levels;
+		if (is_virtual)
+		{
+			level.pages_per_row = level.width >> VIRTUAL_PAGE_SHIFT;
+		}
+		const size_t expected_size = is_virtual
+			? (size_t)get_num_pages(level) * VIRTUAL_PAGE_TEXELS * sizeof(uint32)
+			: get_level_data_size(level, texture->format);
+		if (data_size != expected_size)
+		{
+			return nullptr;
+		}
+
+		if (is_virtual)
+		{
+			// Streamed from the cache file by the virtual texture cache
+			level.pages = std::make_unique<VirtualPage[]>(get_num_pages(level));
+			level.file_offset = (size_t)(data - mapping->data);
+		}
+		else
+		{
+			if (texture->format == TEXTURE_FORMAT_ARGB8888)
+			{
+				level.pixels = (const uint32*)data;
+			}
+			else
+			{
+				level.blocks = data;
+			}
+			texture->memory_size += data_size;
+		}
+	}
+
+	if (texture->num_virtual_levels > 0)
+	{
+		texture->page_file = cache_path;
+	}
+	texture->mapping = std::move(mapping);
+	return texture;
+}
+
+void save_cached_texture(const char* filename, const TextureLoadOptions& options, const Texture& texture)
+{
+	ZoneScoped; // for tracy
+
+	const std::string cache_path = get_asset_cache_path(filename, get_texture_variant(options), ".texture");
+	const std::string temp_path = get_asset_cache_temp_path(cache_path);
+	CacheWriter writer;
+	if (!begin_asset_cache_file(writer, temp_path, filename, TEXTURE_MAGIC, sizeof(MipLevel)))
+	{
+		return;
+	}
+
+	writer.write((uint32)texture.format);
+	writer.write((int32)texture.width);
+	writer.write((int32)texture.height);
+	writer.write((int32)texture.mips.size());
+	writer.write((int32)texture.num_virtual_levels);
+
+	std::ifstream page_file;
+	if (texture.num_virtual_levels > 0)
+	{
+		page_file.open(texture.page_file, std::ios::binary);
+	}
+
+	std::vector<uint8> pages;
+	for (int i = 0; i < (int)texture.mips.size(); i++)
+	{
+		const MipLevel& level = texture.mips[i];
+		writer.write((int32)level.width);
+		writer.write((int32)level.height);
+
+		if (i < texture.num_virtual_levels)
+		{
+			// Copy the pages over from the page file of the texture
+			pages.resize((size_t)get_num_pages(level) * VIRTUAL_PAGE_TEXELS * sizeof(uint32));
+			page_file.seekg((std::streamoff)level.file_offset);
+			page_file.read((char*)pages.data(), (std::streamsize)pages.size());
+			if (!page_file)
+			{
+				std::cerr << "Failed to read the page file " << texture.page_file << ".\n";
+				writer.file.setstate(std::ios::failbit);
+				break;
+			}
+			writer.write((uint64)pages.size());
+			writer.write_bytes(pages.data(), pages.size(), CACHE_ALIGNMENT);
+		}
+		else
+		{
+			const size_t data_size = get_level_data_size(level, texture.format);
+			const void* data = texture.format == TEXTURE_FORMAT_ARGB8888 ? (const void*)level.pixels : (const void*)level.blocks;
+			writer.write((uint64)data_size);
+			writer.write_bytes(data, data_size, CACHE_ALIGNMENT);
+		}
+	}
+
+	end_asset_cache_file(writer, temp_path, cache_path);
+}
+
+bool load_cached_mesh(const char* filename, const TextureLoadOptions& texture_options, Mesh& mesh)
+{
+	ZoneScoped; // for tracy
+
+	const std::string cache_path = get_asset_cache_path(filename, "", ".mesh");
+	const std::shared_ptr<MappedFile> mapping = open_asset_cache_file(cache_path, filename, MESH_MAGIC, sizeof(Triangle));
+	if (!mapping)
+	{
+		return false;
+	}
+
+	CacheReader reader = { mapping->data, mapping->size, sizeof(AssetCacheHeader) };
+
+	mesh.bounds_center = reader.read<glm::vec3>();
+	mesh.bounds_radius = reader.read<float>();
+
+	const uint32 num_materials = reader.read<uint32>();
+	if (!reader.is_valid || num_materials > reader.size)
+	{
+		return false;
+	}
+	mesh.texture_files.resize(num_materials);
+	for (std::string& texture_file : mesh.texture_files)
+	{
+		texture_file = reader.read_string();
+	}
+
+	// Texture pointers are stored as material indices
+	std::vector<int32> materials;
+	auto read_triangles = [&](std::vector<Triangle>& triangles)
+	{
+		reader.read_vector(triangles);
+		reader.read_vector(materials);
+		if (materials.size() != triangles.size())
+		{
+			reader.is_valid = false;
+		}
+	};
+
+	read_triangles(mesh.triangles);
+	std::vector<int32> full_materials = materials;
+	reader.read_vector(mesh.meshlets);
+
+	const uint32 num_lods = reader.read<uint32>();
+	if (!reader.is_valid || num_lods > reader.size)
+	{
+		return false;
+	}
+	mesh.lods.resize(num_lods);
+	std::vector<std::vector<int32>> lod_materials(num_lods);
+	for (uint32 i = 0; i < num_lods; i++)
+	{
+		mesh.lods[i].error = reader.read<float>();
+		read_triangles(mesh.lods[i].triangles);
+		lod_materials[i] = materials;
+		reader.read_vector(mesh.lods[i].meshlets);
+	}
+
+	if (!reader.is_valid)
+	{
+		mesh = Mesh();
+		return false;
+	}
+
+	// Textures come from the texture cache, and with it from their own cache
+	// files
+	mesh.textures.assign(num_materials, nullptr);
+	for (uint32 i = 0; i < num_materials; i++)
+	{
+		if (!mesh.texture_files[i].empty())
+		{
+			mesh.textures[i] = get_texture(mesh.texture_files[i].c_str(), texture_options);
+		}
+	}
+
+	auto resolve_textures = [&](std::vector<Triangle>& triangles, const std::vector<int32>& triangle_materials)
+	{
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			const int32 material = triangle_materials[i];
+			triangles[i].texture = material >= 0 && material < (int32)num_materials ? mesh.textures[material].get() : nullptr;
+		}
+	};
+	resolve_textures(mesh.triangles, full_materials);
+	for (uint32 i = 0; i < num_lods; i++)
+	{
+		resolve_textures(mesh.lods[i].triangles, lod_materials[i]);
+	}
+
+	std::cout << "Loaded " << filename << " from " << cache_path << "\n";
+	return true;
+}
+
+void save_cached_mesh(const char* filename, const Mesh& mesh)
+{
+	ZoneScoped; // for tracy
+
+	const std::string cache_path = get_asset_cache_path(filename, "", ".mesh");
+	const std::string temp_path = get_asset_cache_temp_path(cache_path);
+	CacheWriter writer;
+	if (!begin_asset_cache_file(writer, temp_path, filename, MESH_MAGIC, sizeof(Triangle)))
+	{
+		return;
+	}
+
+	writer.write(mesh.bounds_center);
+	writer.write(mesh.bounds_radius);
+
+	writer.write((uint32)mesh.texture_files.size());
+	for (const std::string& texture_file : mesh.texture_files)
+	{
+		writer.write_string(texture_file);
+	}
+
+	// Several materials can share a texture, any of them will do
+	std::unordered_map<const Texture*, int32> texture_materials;
+	for (int32 i = (int32)mesh.textures.size() - 1; i >= 0; i--)
+	{
+		texture_materials[mesh.textures[i].get()] = i;
+	}
+	std::vector<int32> materials;
+	auto write_triangles = [&](const std::vector<Triangle>& triangles)
+	{
+		materials.clear();
+		for (const Triangle& triangle : triangles)
+		{
+			const auto it = texture_materials.find(triangle.texture);
+			materials.push_back(triangle.texture && it != texture_materials.end() ? it->second : -1);
+		}
+		writer.write_vector(triangles);
+		writer.write_vector(materials);
+	};
+
+	write_triangles(mesh.triangles);
+	writer.write_vector(mesh.meshlets);
+
+	writer.write((uint32)mesh.lods.size());
+	for (const MeshLOD& lod : mesh.lods)
+	{
+		writer.write(lod.error);
+		write_triangles(lod.triangles);
+		writer.write_vector(lod.meshlets);
+	}
+
+	end_asset_cache_file(writer, temp_path, cache_path);
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Texture.h"
+
+struct MappedFile;
+struct Mesh;
+
+/**
+ * Binary copies of processed assets, so the OBJ parsing, image decoding, mip
+ * generation, compression, simplification and meshlet building only happen
+ * the first time an asset is loaded. Each cache file sits in
+ * ASSET_CACHE_DIRECTORY and records the size and modification time of the file
+ * it was built from. It is rebuilt when those change, or when
+ * ASSET_CACHE_VERSION is bumped after a change to the file layout or to the
+ * processing. Cache files are memory mapped. Texture levels are used straight
+ * from the mapping, and virtual texture pages are streamed from the cache file
+ */
+constexpr uint32 ASSET_CACHE_VERSION = 3;
+constexpr const char* ASSET_CACHE_DIRECTORY = "cache";
+
+/** Returns nullptr when there is no up to date cache file for the image */
+std::shared_ptr<Texture> load_cached_texture(const char* filename, const TextureLoadOptions& options);
+void save_cached_texture(const char* filename, const TextureLoadOptions& options, const Texture& texture);
+
+/**
+ * Fills in the geometry, levels of detail and meshlets of the mesh, and loads
+ * its textures with texture_options. Returns false when there is no up to date
+ * cache file for the OBJ. Only the OBJ itself is tracked, not its material
+ * library
+ */
+bool load_cached_mesh(const char* filename, const TextureLoadOptions& texture_options, Mesh& mesh);
+void save_cached_mesh(const char* filename, const Mesh& mesh);
+
+/**
+ * The pieces the asset cache files are made of, for other files built once
+ * from an asset and then memory mapped, like the chunks of a streamed mesh
+ */
+// Arrays start on a cache line so mapped texels are as aligned as allocated ones
+constexpr size_t CACHE_ALIGNMENT = 64;
+
+struct AssetCacheHeader
+{
+	char magic[4];
+	uint32 version;
+	uint32 layout_size; // catches layout changes of the structs stored raw
+	uint32 padding;
+	uint64 source_size;
+	int64 source_time;
+};
+
+/** Sequential reads from a mapped cache file, failing instead of reading past its end */
+struct CacheReader
+{
+	const uint8* data;
+	size_t size;
+	size_t offset = 0;
+	bool is_valid = true;
+
+	template <typename T>
+	T read()
+	{
+		T value{};
+		if (offset + sizeof(T) > size)
+		{
+			is_valid = false;
+			return value;
+		}
+		memcpy(&value, data + offset, sizeof(T));
+		offset += sizeof(T);
+		return value;
+	}
+
+	const uint8* read_bytes(size_t count, size_t alignment = 1)
+	{
+		offset = (offset + alignment - 1) / alignment * alignment;
+		if (count > size || offset > size - count)
+		{
+			is_valid = false;
+			return nullptr;
+		}
+		const uint8* bytes = data + offset;
+		offset += count;
+		return bytes;
+	}
+
+	std::string read_string()
+	{
+		const uint32 length = read<uint32>();
+		const uint8* bytes = read_bytes(length);
+		return bytes ? std::string((const char*)bytes, length) : std::string();
+	}
+
+	template <typename T>
+	void read_vector(std::vector<T>& values)
+	{
+		const uint64 count = read<uint64>();
+		const uint8* bytes = read_bytes(count * sizeof(T), CACHE_ALIGNMENT);
+		if (!bytes)
+		{
+			values.clear();
+			return;
+		}
+		values.resize(count);
+		memcpy(values.data(), bytes, count * sizeof(T));
+	}
+};
+
+struct CacheWriter
+{
+	std::ofstream file;
+
+	template <typename T>
+	void write(const T& value)
+	{
+		file.write((const char*)&value, sizeof(T));
+	}
+
+	void write_bytes(const void* bytes, size_t count, size_t alignment = 1)
+	{
+		const size_t offset = (size_t)file.tellp();
+		const size_t padding = (alignment - offset % alignment) % alignment;
+		static const char zeros[CACHE_ALIGNMENT] = {};
+		file.write(zeros, padding);
+		file.write((const char*)bytes, count);
+	}
+
+	void write_string(const std::string& value)
+	{
+		write((uint32)value.size());
+		write_bytes(value.data(), value.size());
+	}
+
+	template <typename T>
+	void write_vector(const std::vector<T>& values)
+	{
+		write((uint64)values.size());
+		write_bytes(values.data(), values.size() * sizeof(T), CACHE_ALIGNMENT);
+	}
+};
+
+/**
+ * Cache file of filename in ASSET_CACHE_DIRECTORY, one per variant, named
+ * after the file with extension
+ */
+std::string get_asset_cache_path(const char* filename, const std::string& variant, const char* extension);
+/** Unique per call, so threads writing the same cache file don't interfere */
+std::string get_asset_cache_temp_path(const std::string& cache_path);
+/**
+ * Maps the cache file when it was built from the current version of source
+ * with this magic and layout, returns nullptr otherwise. Reading continues
+ * after the AssetCacheHeader
+ */
+std::shared_ptr<MappedFile> open_asset_cache_file(
+	const std::string& cache_path,
+	const char* source,
+	const char* magic,
+	uint32 layout_size
+);
+/** Writes the AssetCacheHeader to a new temp file */
+bool begin_asset_cache_file(
+	CacheWriter& writer,
+	const std::string& temp_path,
+	const char* source,
+	const char* magic,
+	uint32 layout_size
+);
+/** Closes the temp file and moves it over the cache file, or removes it if writing failed */
+void end_asset_cache_file(CacheWriter& writer, const std::string& temp_path, const std::string& cache_path);
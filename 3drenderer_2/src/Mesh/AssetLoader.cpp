@@ -0,0 +1,136 @@
+#include "AssetLoader.h"
+
+#include <omp.h>
+
+#include "Mesh.h"
+#include "../Triangle/Triangle.h"
+#include "../Utils/TraceRecorder.h"
+
+AssetLoader::~AssetLoader()
+{
+	destroy();
+}
+
+void AssetLoader::initialize(int num_threads)
+{
+	destroy();
+
+	is_stopping = false;
+	for (int i = 0; i < num_threads; i++)
+	{
+		loaders.emplace_back(&AssetLoader::load_meshes, this);
+	}
+}
+
+void AssetLoader::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		is_stopping = true;
+		num_unfinished -= (int)queued.size();
+		queued.clear();
+	}
+	wake_loaders.notify_all();
+	for (std::thread& loader : loaders)
+	{
+		loader.join();
+	}
+	loaders.clear();
+
+	completed.clear();
+	states.clear();
+	num_loading = 0;
+	num_unfinished = 0;
+}
+
+int AssetLoader::load_mesh(const char* filename, const TextureLoadOptions& texture_options)
+{
+	const int handle = (int)states.size();
+	states.push_back(ASSET_LOADING);
+	num_loading++;
+
+	std::unique_ptr<MeshRequest> request = std::make_unique<MeshRequest>();
+	request->handle = handle;
+	request->filename = filename;
+	request->texture_options = texture_options;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued.push_back(std::move(request));
+		num_unfinished++;
+	}
+	wake_loaders.notify_one();
+
+	return handle;
+}
+
+EAssetState AssetLoader::get_state(int handle) const
+{
+	return handle >= 0 && handle < (int)states.size() ? states[handle] : ASSET_FAILED;
+}
+
+void AssetLoader::collect(std::vector<std::unique_ptr<MeshRequest>>& loaded)
+{
+	const size_t first = loaded.size();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (std::unique_ptr<MeshRequest>& request : completed)
+		{
+			loaded.push_back(std::move(request));
+		}
+		completed.clear();
+	}
+
+	for (size_t i = first; i < loaded.size(); i++)
+	{
+		const std::unique_ptr<MeshRequest>& request = loaded[i];
+		states[request->handle] = request->mesh ? ASSET_READY : ASSET_FAILED;
+		num_loading--;
+	}
+}
+
+void AssetLoader::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!loaders.empty())
+	{
+		finished_request.wait(lock, [this] { return num_unfinished == 0; });
+	}
+}
+
+void AssetLoader::load_meshes()
+{
+	// Keep the parallel parts of the loaders to this thread
+	omp_set_num_threads(1);
+
+	while (true)
+	{
+		std::unique_ptr<MeshRequest> request;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake_loaders.wait(lock, [this] { return is_stopping || !queued.empty(); });
+			if (is_stopping)
+			{
+				return;
+			}
+			request = std::move(queued.front());
+			queued.pop_front();
+		}
+
+		{
+			ZoneScopedN("Load mesh");
+
+			request->mesh = create_mesh(request->filename.c_str(), request->texture_options);
+			if (request->mesh->triangles.empty())
+			{
+				request->mesh.reset();
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			completed.push_back(std::move(request));
+			num_unfinished--;
+		}
+		finished_request.notify_all();
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Texture.h"
+
+struct Mesh;
+
+enum EAssetState
+{
+	ASSET_LOADING,
+	ASSET_READY,
+	ASSET_FAILED,
+};
+
+/** A mesh a loading thread reads */
+struct MeshRequest
+{
+	int handle;
+	std::string filename;
+	TextureLoadOptions texture_options;
+	std::unique_ptr<Mesh> mesh; // null if loading failed
+};
+
+/**
+ * Loads meshes on background threads. load_mesh() hands out a handle straight
+ * away, and one of the loading threads then parses and processes the mesh
+ * along with its textures, or maps them from the asset cache. Finished meshes
+ * are only handed over by collect(), which the world calls between frames, so
+ * nothing being drawn ever changes under the rasterizer. The OpenMP regions of
+ * the loaders run on one thread each, so loading only ever takes the cores of
+ * the loading threads and leaves the rest to the frame
+ */
+struct AssetLoader
+{
+	~AssetLoader();
+
+	void initialize(int num_threads);
+	/** Drops the meshes that haven't started loading, waits for the others */
+	void destroy();
+
+	int load_mesh(const char* filename, const TextureLoadOptions& texture_options = TextureLoadOptions());
+	/** States only change in collect() */
+	EAssetState get_state(int handle) const;
+
+	/**
+	 * Moves the meshes that finished loading since the last call into loaded,
+	 * with a null mesh for the ones that failed
+	 */
+	void collect(std::vector<std::unique_ptr<MeshRequest>>& loaded);
+	/** Blocks until every mesh requested so far has finished loading */
+	void wait();
+
+	int num_loading = 0; // requested but not collected yet
+
+	void load_meshes();
+
+	std::vector<EAssetState> states; // by handle
+
+	// Shared with the loading threads
+	std::vector<std::thread> loaders;
+	std::mutex mutex;
+	std::condition_variable wake_loaders;
+	std::condition_variable finished_request;
+	std::deque<std::unique_ptr<MeshRequest>> queued;
+	std::vector<std::unique_ptr<MeshRequest>> completed;
+	int num_unfinished = 0; // queued or being loaded
+	bool is_stopping = false;
+};
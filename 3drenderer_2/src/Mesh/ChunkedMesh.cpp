@@ -0,0 +1,693 @@
+#include "ChunkedMesh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+
+#include "AssetCache.h"
+#include "Mesh.h"
+#include "Meshlet.h"
+#include "ObjParser.h"
+#include "TextureCache.h"
+#include "../Camera/Camera.h"
+#include "../Triangle/Triangle.h"
+#include "../Utils/Colors.h"
+#include "../Utils/MappedFile.h"
+#include "../Utils/TraceRecorder.h"
+
+constexpr char CHUNKS_MAGIC[4] = { 'C', 'H', 'N', 'K' };
+
+// Triangles per cell of the grid the mesh is first cut into, on average
+constexpr size_t CELL_TRIANGLES = 32 * 1024;
+// Cells with more triangles than this are split in half until they fit
+constexpr size_t MAX_CHUNK_TRIANGLES = 64 * 1024;
+// Bytes of the OBJ parsed at a time while converting it
+constexpr size_t OBJ_BATCH_SIZE = (size_t)64 << 20;
+// Triangles sorted into cells at a time
+constexpr size_t SCATTER_BLOCK_SIZE = 64 * 1024;
+// Levels queued at once. Keeps the reads close to what the camera sees now
+constexpr int MAX_CHUNKS_IN_FLIGHT = 4;
+
+/** Table entry of a chunk in the chunk file */
+struct ChunkRecord
+{
+	glm::vec3 center;
+	float radius;
+	int32 first_level;
+	int32 num_levels;
+};
+
+static glm::vec3 get_centroid(const Triangle& triangle)
+{
+	return glm::vec3(triangle.vertices[0].position + triangle.vertices[1].position + triangle.vertices[2].position) / 3.0f;
+}
+
+/** Halves the triangles at the median of their longest axis until each piece fits in a chunk */
+static void split_chunk(std::vector<Triangle>& triangles, std::vector<std::vector<Triangle>>& pieces)
+{
+	if (triangles.size() <= MAX_CHUNK_TRIANGLES)
+	{
+		pieces.push_back(std::move(triangles));
+		return;
+	}
+
+	glm::vec3 min_p = get_centroid(triangles[0]);
+	glm::vec3 max_p = min_p;
+	for (const Triangle& triangle : triangles)
+	{
+		const glm::vec3 centroid = get_centroid(triangle);
+		min_p = glm::min(min_p, centroid);
+		max_p = glm::max(max_p, centroid);
+	}
+	const glm::vec3 extent = max_p - min_p;
+	const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+	const size_t half = triangles.size() / 2;
+	std::nth_element(
+		triangles.begin(),
+		triangles.begin() + half,
+		triangles.end(),
+		[axis](const Triangle& a, const Triangle& b) { return get_centroid(a)[axis] < get_centroid(b)[axis]; }
+	);
+	std::vector<Triangle> upper(triangles.begin() + half, triangles.end());
+	triangles.resize(half);
+	split_chunk(triangles, pieces);
+	split_chunk(upper, pieces);
+}
+
+std::string build_chunked_mesh(const char* filename)
+{
+	ZoneScoped; // for tracy
+
+	const std::string cache_path = get_asset_cache_path(filename, "", ".chunks");
+	if (open_asset_cache_file(cache_path, filename, CHUNKS_MAGIC, sizeof(Triangle)))
+	{
+		return cache_path;
+	}
+
+	std::cout << "Cutting " << filename << " into chunks\n";
+
+	std::error_code error;
+	std::filesystem::create_directories(ASSET_CACHE_DIRECTORY, error);
+
+	// Stream the triangles of the OBJ out to a file, with the material index
+	// + 1 standing in for the texture pointer, and find the bounds of their
+	// centroids on the way
+	const std::string soup_path = get_asset_cache_temp_path(cache_path);
+	std::vector<ObjMaterial> materials;
+	glm::vec3 min_p(FLT_MAX);
+	glm::vec3 max_p(-FLT_MAX);
+	size_t num_triangles = 0;
+	{
+		std::ofstream soup(soup_path, std::ios::binary | std::ios::trunc);
+		const bool is_parsed = soup && parse_obj_batches(filename, OBJ_BATCH_SIZE, materials,
+			[&](std::vector<Triangle>& triangles, std::vector<int>& triangle_materials)
+			{
+				for (size_t i = 0; i < triangles.size(); i++)
+				{
+					Triangle& triangle = triangles[i];
+					triangle.texture = (Texture*)(uintptr_t)(triangle_materials[i] + 1);
+					triangle.color = Colors::WHITE;
+					const glm::vec3 centroid = get_centroid(triangle);
+					min_p = glm::min(min_p, centroid);
+					max_p = glm::max(max_p, centroid);
+				}
+				soup.write((const char*)triangles.data(), triangles.size() * sizeof(Triangle));
+				num_triangles += triangles.size();
+			});
+		soup.close();
+		if (!is_parsed || soup.fail() || num_triangles == 0)
+		{
+			std::cerr << "Failed to cut " << filename << " into chunks.\n";
+			std::filesystem::remove(soup_path, error);
+			return std::string();
+		}
+	}
+
+	MappedFile soup;
+	if (!soup.open(soup_path.c_str()))
+	{
+		std::filesystem::remove(soup_path, error);
+		return std::string();
+	}
+	const Triangle* soup_triangles = (const Triangle*)soup.data;
+
+	// Lay a grid over the centroids with about CELL_TRIANGLES triangles per
+	// cell, by doubling the cells along the axis where they are longest
+	const size_t target_cells = std::max(num_triangles / CELL_TRIANGLES, (size_t)1);
+	const glm::vec3 extent = glm::max(max_p - min_p, glm::vec3(1e-6f));
+	glm::ivec3 grid(1);
+	while ((size_t)grid.x * grid.y * grid.z < target_cells)
+	{
+		const glm::vec3 cell_size = extent / glm::vec3(grid);
+		const int axis = cell_size.x >= cell_size.y && cell_size.x >= cell_size.z ? 0 : (cell_size.y >= cell_size.z ? 1 : 2);
+		grid[axis] *= 2;
+	}
+	const size_t num_cells = (size_t)grid.x * grid.y * grid.z;
+	auto get_cell = [&](const Triangle& triangle)
+	{
+		const glm::ivec3 cell = glm::clamp(glm::ivec3((get_centroid(triangle) - min_p) / extent * glm::vec3(grid)), glm::ivec3(0), grid - 1);
+		return ((size_t)cell.z * grid.y + cell.y) * grid.x + cell.x;
+	};
+
+	std::vector<size_t> cell_offsets(num_cells + 1, 0);
+	for (size_t i = 0; i < num_triangles; i++)
+	{
+		cell_offsets[get_cell(soup_triangles[i]) + 1]++;
+	}
+	for (size_t i = 0; i < num_cells; i++)
+	{
+		cell_offsets[i + 1] += cell_offsets[i];
+	}
+
+	// Sort the triangles by cell into a second file, a block at a time
+	const std::string sorted_path = get_asset_cache_temp_path(cache_path);
+	{
+		std::ofstream(sorted_path, std::ios::binary | std::ios::trunc);
+		std::filesystem::resize_file(sorted_path, num_triangles * sizeof(Triangle), error);
+		std::fstream sorted(sorted_path, std::ios::binary | std::ios::in | std::ios::out);
+		std::vector<size_t> cursors(cell_offsets.begin(), cell_offsets.end() - 1);
+		std::vector<std::pair<size_t, size_t>> block; // cell, triangle
+		std::vector<Triangle> run;
+		for (size_t first = 0; first < num_triangles && sorted; first += SCATTER_BLOCK_SIZE)
+		{
+			const size_t last = std::min(first + SCATTER_BLOCK_SIZE, num_triangles);
+			block.clear();
+			for (size_t i = first; i < last; i++)
+			{
+				block.emplace_back(get_cell(soup_triangles[i]), i);
+			}
+			std::sort(block.begin(), block.end());
+
+			// One write for each cell the block touches
+			for (size_t i = 0; i < block.size(); )
+			{
+				const size_t cell = block[i].first;
+				run.clear();
+				for (; i < block.size() && block[i].first == cell; i++)
+				{
+					run.push_back(soup_triangles[block[i].second]);
+				}
+				sorted.seekp((std::streamoff)(cursors[cell] * sizeof(Triangle)));
+				sorted.write((const char*)run.data(), run.size() * sizeof(Triangle));
+				cursors[cell] += run.size();
+			}
+		}
+		sorted.close();
+		soup.close();
+		std::filesystem::remove(soup_path, error);
+		if (sorted.fail())
+		{
+			std::cerr << "Failed to cut " << filename << " into chunks.\n";
+			std::filesystem::remove(sorted_path, error);
+			return std::string();
+		}
+	}
+
+	// Build the levels of detail and meshlets of every cell in parallel and
+	// append them to the chunk file as they finish
+	const std::string temp_path = get_asset_cache_temp_path(cache_path);
+	CacheWriter writer;
+	MappedFile sorted;
+	if (!sorted.open(sorted_path.c_str()) || !begin_asset_cache_file(writer, temp_path, filename, CHUNKS_MAGIC, sizeof(Triangle)))
+	{
+		std::filesystem::remove(sorted_path, error);
+		return std::string();
+	}
+	const Triangle* sorted_triangles = (const Triangle*)sorted.data;
+
+	const std::streamoff table_slot = writer.file.tellp();
+	writer.write((uint64)0);
+	writer.write((uint32)materials.size());
+	for (const ObjMaterial& material : materials)
+	{
+		writer.write_string(material.texture_file);
+	}
+
+	glm::vec3 min_v(FLT_MAX);
+	glm::vec3 max_v(-FLT_MAX);
+	std::vector<ChunkRecord> records;
+	std::vector<ChunkLevel> levels;
+	#pragma omp parallel for schedule(dynamic)
+	for (int cell = 0; cell < (int)num_cells; cell++)
+	{
+		if (cell_offsets[cell] == cell_offsets[cell + 1])
+		{
+			continue;
+		}
+
+		std::vector<Triangle> triangles(sorted_triangles + cell_offsets[cell], sorted_triangles + cell_offsets[cell + 1]);
+		std::vector<std::vector<Triangle>> pieces;
+		split_chunk(triangles, pieces);
+
+		for (std::vector<Triangle>& piece : pieces)
+		{
+			Mesh chunk;
+			chunk.triangles = std::move(piece);
+			chunk.compute_bounds();
+			chunk.build_lods(true);
+			::build_meshlets(chunk.triangles, chunk.meshlets);
+			for (MeshLOD& lod : chunk.lods)
+			{
+				::build_meshlets(lod.triangles, lod.meshlets);
+			}
+
+			#pragma omp critical(chunk_file)
+			{
+				ChunkRecord record = { chunk.bounds_center, chunk.bounds_radius, (int32)levels.size(), chunk.num_lods() };
+				records.push_back(record);
+				std::vector<int32> triangle_materials;
+				for (int i = 0; i < chunk.num_lods(); i++)
+				{
+					const std::vector<Triangle>& level_triangles = chunk.get_lod_triangles(i);
+					const std::vector<Meshlet>& level_meshlets = chunk.get_lod_meshlets(i);
+
+					ChunkLevel level = {};
+					level.error = chunk.get_lod_error(i);
+					level.num_triangles = (uint32)level_triangles.size();
+					level.num_meshlets = (uint32)level_meshlets.size();
+					level.offset = (uint64)writer.file.tellp();
+					levels.push_back(level);
+
+					triangle_materials.clear();
+					for (const Triangle& triangle : level_triangles)
+					{
+						triangle_materials.push_back((int32)(uintptr_t)triangle.texture - 1);
+					}
+					writer.write_vector(level_triangles);
+					writer.write_vector(triangle_materials);
+					writer.write_vector(level_meshlets);
+				}
+				min_v = glm::min(min_v, chunk.bounds_center - chunk.bounds_radius);
+				max_v = glm::max(max_v, chunk.bounds_center + chunk.bounds_radius);
+			}
+		}
+	}
+	sorted.close();
+	std::filesystem::remove(sorted_path, error);
+
+	// The table goes last, once every chunk is known
+	const uint64 table_offset = (uint64)writer.file.tellp();
+	const glm::vec3 bounds_center = (min_v + max_v) * 0.5f;
+	writer.write(bounds_center);
+	writer.write(glm::length(max_v - bounds_center));
+	writer.write_vector(records);
+	writer.write_vector(levels);
+	writer.file.seekp(table_slot);
+	writer.write(table_offset);
+
+	std::cout << "Cut " << num_triangles << " triangles into " << records.size() << " chunks\n";
+
+	end_asset_cache_file(writer, temp_path, cache_path);
+	return std::filesystem::exists(cache_path, error) ? cache_path : std::string();
+}
+
+ChunkedMesh::~ChunkedMesh()
+{
+	destroy();
+}
+
+void ChunkedMesh::open(const char* filename_, const TextureLoadOptions& texture_options_)
+{
+	destroy();
+
+	filename = filename_;
+	texture_options = texture_options_;
+	state = ASSET_LOADING;
+	streamer_state = ASSET_LOADING;
+	is_stopping = false;
+	streamer = std::thread(&ChunkedMesh::stream_chunks, this);
+}
+
+void ChunkedMesh::destroy()
+{
+	if (streamer.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			is_stopping = true;
+		}
+		wake_streamer.notify_one();
+		streamer.join();
+	}
+
+	queued.clear();
+	completed.clear();
+	retired.clear();
+	chunks.clear();
+	levels.clear();
+	textures.clear();
+	mapping.reset();
+	state = ASSET_FAILED;
+	num_resident = 0;
+	num_in_flight = 0;
+	used_bytes = 0;
+	num_loaded = 0;
+	num_evicted = 0;
+}
+
+size_t ChunkedMesh::get_level_size(int level) const
+{
+	return (size_t)levels[level].num_triangles * sizeof(Triangle) + (size_t)levels[level].num_meshlets * sizeof(Meshlet);
+}
+
+void ChunkedMesh::update(
+	const glm::mat4& transform,
+	const Camera& camera,
+	int viewport_height,
+	float error_threshold,
+	float hysteresis
+)
+{
+	ZoneScoped; // for tracy
+
+	// Nothing draws the meshes replaced last time anymore
+	retired.clear();
+
+	std::vector<std::unique_ptr<ChunkRequest>> loaded;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		state = streamer_state;
+		loaded.swap(completed);
+	}
+	if (state != ASSET_READY)
+	{
+		return;
+	}
+	num_updates++;
+
+	// Swap in the levels that were read, unless the chunk wants another one
+	// by now
+	for (std::unique_ptr<ChunkRequest>& request : loaded)
+	{
+		MeshChunk& chunk = chunks[request->chunk];
+		const int level = chunk.first_level + request->level;
+		chunk.loading_level = -1;
+		num_in_flight--;
+		used_bytes -= get_level_size(level);
+		if (!request->mesh || request->level != chunk.wanted_level)
+		{
+			continue;
+		}
+
+		if (chunk.mesh)
+		{
+			used_bytes -= get_level_size(chunk.first_level + chunk.resident_level);
+			num_resident--;
+			retired.push_back(std::move(chunk.mesh));
+		}
+		chunk.mesh = std::move(request->mesh);
+		chunk.mesh->bounds_center = chunk.center;
+		chunk.mesh->bounds_radius = chunk.radius;
+		chunk.resident_level = request->level;
+		used_bytes += get_level_size(level);
+		num_resident++;
+		num_loaded++;
+	}
+
+	// Pick the level each chunk in the frustum needs, the same way
+	// World::select_lod() picks the level of a mesh
+	glm::vec4 frustum_planes[6];
+	extract_frustum_planes(camera.vp_matrix, frustum_planes);
+	const float max_scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])) });
+
+	std::vector<std::pair<float, int>> wanted; // distance, chunk
+	for (int i = 0; i < (int)chunks.size(); i++)
+	{
+		MeshChunk& chunk = chunks[i];
+		const glm::vec3 center = glm::vec3(transform * glm::vec4(chunk.center, 1.0f));
+		const float radius = chunk.radius * max_scale;
+		if (is_sphere_outside_frustum(center, radius, frustum_planes))
+		{
+			chunk.wanted_level = -1;
+			continue;
+		}
+
+		const float distance = std::max(glm::length(center - camera.translation) - radius, camera.znear);
+		float pixels_per_unit;
+		if (camera.projection_mode & ORTHOGRAPHIC)
+		{
+			pixels_per_unit = (float)viewport_height / (2.0f * camera.ortho_dist);
+		}
+		else
+		{
+			const float half_fov = glm::radians(camera.fov) * 0.5f;
+			pixels_per_unit = (float)viewport_height / (2.0f * tanf(half_fov) * distance);
+		}
+
+		int finest_allowed = 0;
+		int coarsest_allowed = 0;
+		for (int level = 1; level < chunk.num_levels; level++)
+		{
+			const float error = levels[chunk.first_level + level].error * max_scale * pixels_per_unit;
+			if (error <= error_threshold)
+			{
+				finest_allowed = level;
+			}
+			if (error <= error_threshold * (1.0f - hysteresis))
+			{
+				coarsest_allowed = level;
+			}
+		}
+
+		int& level = chunk.wanted_level;
+		if (level < 0)
+		{
+			level = finest_allowed;
+		}
+		else if (level > finest_allowed)
+		{
+			level = finest_allowed;
+		}
+		else if (level < coarsest_allowed)
+		{
+			level = coarsest_allowed;
+		}
+		chunk.last_used = num_updates;
+		wanted.emplace_back(distance, i);
+	}
+	std::sort(wanted.begin(), wanted.end());
+
+	// Over the budget the farthest chunks fall back to their coarsest level
+	// first, and are dropped after that
+	size_t wanted_bytes = 0;
+	for (const std::pair<float, int>& entry : wanted)
+	{
+		const MeshChunk& chunk = chunks[entry.second];
+		wanted_bytes += get_level_size(chunk.first_level + chunk.wanted_level);
+	}
+	for (int i = (int)wanted.size() - 1; i >= 0 && wanted_bytes > memory_budget; i--)
+	{
+		MeshChunk& chunk = chunks[wanted[i].second];
+		const int coarsest = chunk.num_levels - 1;
+		wanted_bytes -= get_level_size(chunk.first_level + chunk.wanted_level) - get_level_size(chunk.first_level + coarsest);
+		chunk.wanted_level = coarsest;
+	}
+	while (!wanted.empty() && wanted_bytes > memory_budget)
+	{
+		MeshChunk& chunk = chunks[wanted.back().second];
+		wanted_bytes -= get_level_size(chunk.first_level + chunk.wanted_level);
+		chunk.wanted_level = -1;
+		wanted.pop_back();
+	}
+
+	// Chunks nobody wants can be evicted, least recently used first
+	std::vector<int> evictable;
+	for (int i = 0; i < (int)chunks.size(); i++)
+	{
+		if (chunks[i].mesh && chunks[i].wanted_level < 0)
+		{
+			evictable.push_back(i);
+		}
+	}
+	std::sort(evictable.begin(), evictable.end(), [this](int a, int b) { return chunks[a].last_used > chunks[b].last_used; });
+	auto evict = [&]()
+	{
+		MeshChunk& chunk = chunks[evictable.back()];
+		evictable.pop_back();
+		used_bytes -= get_level_size(chunk.first_level + chunk.resident_level);
+		retired.push_back(std::move(chunk.mesh));
+		chunk.resident_level = -1;
+		num_resident--;
+		num_evicted++;
+	};
+	while (used_bytes > memory_budget && !evictable.empty())
+	{
+		evict();
+	}
+
+	// Request the missing levels, nearest chunks first
+	std::vector<std::unique_ptr<ChunkRequest>> requests;
+	for (const std::pair<float, int>& entry : wanted)
+	{
+		if (num_in_flight >= MAX_CHUNKS_IN_FLIGHT)
+		{
+			break;
+		}
+		MeshChunk& chunk = chunks[entry.second];
+		if (chunk.wanted_level == chunk.resident_level || chunk.loading_level >= 0)
+		{
+			continue;
+		}
+
+		const size_t size = get_level_size(chunk.first_level + chunk.wanted_level);
+		while (used_bytes + size > memory_budget && !evictable.empty())
+		{
+			evict();
+		}
+		if (used_bytes + size > memory_budget)
+		{
+			break;
+		}
+
+		std::unique_ptr<ChunkRequest> request = std::make_unique<ChunkRequest>();
+		request->chunk = entry.second;
+		request->level = chunk.wanted_level;
+		requests.push_back(std::move(request));
+		chunk.loading_level = chunk.wanted_level;
+		used_bytes += size;
+		num_in_flight++;
+	}
+
+	if (!requests.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (std::unique_ptr<ChunkRequest>& request : requests)
+			{
+				queued.push_back(std::move(request));
+			}
+		}
+		wake_streamer.notify_one();
+	}
+}
+
+void ChunkedMesh::stream_chunks()
+{
+	// Convert the OBJ the first time, then map the chunk file and read its
+	// table
+	std::vector<MeshChunk> new_chunks;
+	std::vector<ChunkLevel> new_levels;
+	glm::vec3 new_center;
+	float new_radius;
+	bool is_valid = false;
+	{
+		ZoneScopedN("Open chunked mesh");
+
+		const std::string cache_path = build_chunked_mesh(filename.c_str());
+		mapping = cache_path.empty() ? nullptr : open_asset_cache_file(cache_path, filename.c_str(), CHUNKS_MAGIC, sizeof(Triangle));
+		if (mapping)
+		{
+			CacheReader reader = { mapping->data, mapping->size, sizeof(AssetCacheHeader) };
+			const uint64 table_offset = reader.read<uint64>();
+			const uint32 num_materials = reader.read<uint32>();
+			std::vector<std::string> texture_files;
+			for (uint32 i = 0; i < num_materials && reader.is_valid; i++)
+			{
+				texture_files.push_back(reader.read_string());
+			}
+
+			reader.offset = (size_t)table_offset;
+			new_center = reader.read<glm::vec3>();
+			new_radius = reader.read<float>();
+			std::vector<ChunkRecord> records;
+			reader.read_vector(records);
+			reader.read_vector(new_levels);
+
+			is_valid = reader.is_valid;
+			new_chunks.resize(records.size());
+			for (size_t i = 0; i < records.size() && is_valid; i++)
+			{
+				const ChunkRecord& record = records[i];
+				is_valid = record.first_level >= 0 && record.num_levels > 0
+						   && (size_t)record.first_level + record.num_levels <= new_levels.size();
+				new_chunks[i].center = record.center;
+				new_chunks[i].radius = record.radius;
+				new_chunks[i].first_level = record.first_level;
+				new_chunks[i].num_levels = record.num_levels;
+			}
+
+			if (is_valid)
+			{
+				for (const std::string& texture_file : texture_files)
+				{
+					textures.push_back(texture_file.empty() ? nullptr : get_texture(texture_file.c_str(), texture_options));
+				}
+			}
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (is_valid)
+		{
+			chunks = std::move(new_chunks);
+			levels = std::move(new_levels);
+			bounds_center = new_center;
+			bounds_radius = new_radius;
+			std::cout << "Streaming " << chunks.size() << " chunks of " << filename << "\n";
+		}
+		else
+		{
+			std::cerr << "Failed to open " << filename << " for streaming.\n";
+		}
+		streamer_state = is_valid ? ASSET_READY : ASSET_FAILED;
+		if (!is_valid)
+		{
+			return;
+		}
+	}
+
+	// Copy the levels out of the mapping as they are requested
+	while (true)
+	{
+		std::unique_ptr<ChunkRequest> request;
+		int first_level;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake_streamer.wait(lock, [this] { return is_stopping || !queued.empty(); });
+			if (is_stopping)
+			{
+				return;
+			}
+			request = std::move(queued.front());
+			queued.pop_front();
+			first_level = chunks[request->chunk].first_level;
+		}
+
+		{
+			ZoneScopedN("Read chunk");
+
+			std::unique_ptr<Mesh> mesh = std::make_unique<Mesh>();
+			CacheReader reader = { mapping->data, mapping->size, (size_t)levels[first_level + request->level].offset };
+			std::vector<int32> triangle_materials;
+			reader.read_vector(mesh->triangles);
+			reader.read_vector(triangle_materials);
+			reader.read_vector(mesh->meshlets);
+			if (reader.is_valid && triangle_materials.size() == mesh->triangles.size())
+			{
+				for (size_t i = 0; i < mesh->triangles.size(); i++)
+				{
+					const int32 material = triangle_materials[i];
+					mesh->triangles[i].texture = material >= 0 && material < (int32)textures.size() ? textures[material].get() : nullptr;
+				}
+				mesh->textures = textures;
+				request->mesh = std::move(mesh);
+			}
+			else
+			{
+				std::cerr << "Failed to read a chunk of " << filename << ".\n";
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		completed.push_back(std::move(request));
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include "AssetLoader.h"
+#include "Texture.h"
+
+struct Camera;
+struct MappedFile;
+struct Mesh;
+
+/** One level of detail of a chunk, as laid out in the chunk file */
+struct ChunkLevel
+{
+	float error; // object space, like MeshLOD::error
+	uint32 num_triangles;
+	uint32 num_meshlets;
+	uint32 padding;
+	uint64 offset; // of its triangles, materials and meshlets in the chunk file
+};
+
+/** A piece of a chunked mesh, paged in one level of detail at a time */
+struct MeshChunk
+{
+	// Object space bounding sphere of the full resolution triangles
+	glm::vec3 center;
+	float radius;
+	int first_level; // in ChunkedMesh::levels, finest first
+	int num_levels;
+
+	int wanted_level = -1; // picked by update(), -1 when it isn't wanted
+	int resident_level = -1;
+	int loading_level = -1;
+	std::unique_ptr<Mesh> mesh; // the resident level, null if none is
+	uint64 last_used = 0; // update() call that last wanted the chunk
+};
+
+/** A level of a chunk the streaming thread reads */
+struct ChunkRequest
+{
+	int chunk;
+	int level;
+	std::unique_ptr<Mesh> mesh; // null if the read failed
+};
+
+/**
+ * A mesh too large to keep in memory. The first time it is opened the OBJ is
+ * streamed through in batches and cut into chunks of up to
+ * MAX_CHUNK_TRIANGLES triangles, which each get their own levels of detail
+ * and meshlets. The chunks are written to a file in the asset cache that is
+ * memory mapped afterwards. The levels are simplified with their open
+ * boundaries locked, so the border a cut leaves is the same at every level and
+ * neighbouring chunks drawn at different levels still meet without cracks.
+ *
+ * Between frames update() picks the level each chunk should have in memory
+ * from its projected error, the way World::select_lod() does for meshes, and
+ * leaves out the chunks outside the frustum. When the chunks it wants don't
+ * fit in memory_budget the farthest ones fall back to their coarsest level,
+ * and then get dropped. A streaming thread copies the levels missing out of
+ * the mapping into meshes of their own, one level each, which update() swaps
+ * in. Chunks that aren't wanted anymore stay in memory until the room is
+ * needed, and then go least recently used first
+ */
+struct ChunkedMesh
+{
+	~ChunkedMesh();
+
+	/** Converts or maps the OBJ on the streaming thread, check state before use */
+	void open(const char* filename_, const TextureLoadOptions& texture_options_ = TextureLoadOptions());
+	void destroy();
+
+	/**
+	 * transform places the mesh in the world. Must be called between frames.
+	 * The meshes of the chunks only change in here, and meshes replaced are
+	 * only freed by the next call, so the entities drawing them can be
+	 * pointed at the new ones first
+	 */
+	void update(
+		const glm::mat4& transform,
+		const Camera& camera,
+		int viewport_height,
+		float error_threshold,
+		float hysteresis
+	);
+
+	size_t get_level_size(int level) const;
+	void stream_chunks();
+
+	std::string filename;
+	TextureLoadOptions texture_options;
+	EAssetState state = ASSET_FAILED; // only changes in update()
+
+	size_t memory_budget = (size_t)512 << 20; // for the triangles and meshlets of the resident levels
+
+	// Statistics
+	int num_resident = 0;
+	int num_in_flight = 0; // queued or being read
+	size_t used_bytes = 0; // resident and in flight
+	int num_loaded = 0; // since it was opened
+	int num_evicted = 0;
+
+	// Only valid once the state is ASSET_READY
+	std::vector<MeshChunk> chunks;
+	std::vector<ChunkLevel> levels;
+	std::vector<std::shared_ptr<Texture>> textures; // by material
+	glm::vec3 bounds_center = glm::vec3(0.0f);
+	float bounds_radius = 0.0f;
+
+	uint64 num_updates = 0;
+	std::vector<std::unique_ptr<Mesh>> retired; // replaced by the last update()
+
+	// Shared with the streaming thread
+	std::thread streamer;
+	std::mutex mutex;
+	std::condition_variable wake_streamer;
+	std::deque<std::unique_ptr<ChunkRequest>> queued;
+	std::vector<std::unique_ptr<ChunkRequest>> completed;
+	EAssetState streamer_state = ASSET_FAILED;
+	bool is_stopping = false;
+	std::shared_ptr<MappedFile> mapping; // only touched by the streaming thread once open
+};
+
+/**
+ * Cuts the OBJ into chunks and writes the chunk file to the asset cache,
+ * unless it is already up to date. Returns the path of the chunk file, or an
+ * empty string on failure
+ */
+std::string build_chunked_mesh(const char* filename);
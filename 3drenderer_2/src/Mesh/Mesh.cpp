@@ -1,12 +1,15 @@
 #include "Mesh.h"
 
-#define FAST_OBJ_IMPLEMENTATION
-
+#include <algorithm>
 #include <iostream>
 
-#include <fast_obj/fast_obj.h>
+#include <glm/geometric.hpp>
 
+#include "AssetCache.h"
+#include "MeshSimplifier.h"
+#include "ObjParser.h"
 #include "Texture.h"
+#include "TextureCache.h"
 #include "../Triangle/Triangle.h"
 #include "../Utils/Colors.h"
 #include "../Utils/debug_helpers.h"
@@ -17,98 +20,148 @@
 #include <SDL2/SDL_image.h>
 #endif
 
-Mesh::Mesh(
-	glm::vec3 scale, 
-	rot3 rotation, 
-	glm::vec3 translation
-) : Entity(scale, rotation, translation)
-{
-}
-
-void Mesh::load_from_obj(const char* filename)
+void Mesh::load_from_obj(const char* filename, const TextureLoadOptions& texture_options)
 {
-	fastObjMesh* fast_mesh = fast_obj_read(filename);
-
-	if (!fast_mesh)
+	std::vector<int> triangle_materials;
+	std::vector<ObjMaterial> materials;
+	if (!parse_obj(filename, triangles, triangle_materials, materials))
 	{
 		std::cerr << "Failed to load " << filename << ".\n";
 		return;
 	}
 
-	// Allocate memory for the texture pointer array
-	const int num_materials = (int)fast_mesh->material_count;
-	textures.resize(num_materials * sizeof(Texture*));
-
-	// For each mesh
-	for (uint32 i = 0; i < fast_mesh->object_count; i++)
+	// One texture per material, shared with every other mesh using the same
+	// image through the texture cache. Only the materials in use are loaded
+	const int num_materials = (int)materials.size();
+	textures.assign(num_materials, nullptr);
+	texture_files.assign(num_materials, std::string());
+	std::vector<bool> is_material_used(num_materials, false);
+	for (const int material : triangle_materials)
 	{
-		const fastObjGroup object = fast_mesh->objects[i];
-		int idx = 0;
+		if (material >= 0)
+		{
+			is_material_used[material] = true;
+		}
+	}
+	for (int i = 0; i < num_materials; i++)
+	{
+		if (!is_material_used[i])
+		{
+			continue;
+		}
+		if (materials[i].texture_file.empty())
+		{
+			std::cerr << "No textures found for " << filename << ".\n";
+		}
+		texture_files[i] = materials[i].texture_file;
+	}
 
-		// For each triangle
-		for (uint32 j = 0; j < object.face_count; j++)
+	// Decode the images side by side, most of the load time of a mesh with a
+	// handful of large textures is spent here
+	#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < num_materials; i++)
+	{
+		if (!texture_files[i].empty())
 		{
-			Triangle triangle;
+			textures[i] = get_texture(texture_files[i].c_str(), texture_options);
+		}
+	}
 
-			// Load the texture from the material.
-			const int material_index = fast_mesh->face_materials[object.face_offset + j];
+	#pragma omp parallel for
+	for (int i = 0; i < (int)triangles.size(); i++)
+	{
+		const int material = triangle_materials[i];
+		triangles[i].texture = material >= 0 ? textures[material].get() : nullptr;
+		triangles[i].color = Colors::WHITE;
+	}
 
-			// Only load if the texture is not already loaded
-			if (!textures[material_index])
-			{
-				char* material_filename = fast_mesh->materials[material_index].map_Kd.path;
-				if (material_filename)
-				{
-					const std::shared_ptr<Texture> texture = load_texture(material_filename);
-					textures[material_index] = texture;
-				}
-				else
-				{
-					std::cerr << "No textures found for " << filename << ".\n";
-				}
-			}
+	std::cout << "Loaded " << filename << "\n";
+}
 
-			triangle.texture = textures[material_index];
+void Mesh::compute_bounds()
+{
+	if (triangles.empty())
+	{
+		return;
+	}
 
-			for (uint32 k = 0; k < 3; k++)
-			{
-				const fastObjIndex index = fast_mesh->indices[object.index_offset + idx];
-
-				triangle.vertices[k].position = glm::vec4(
-					fast_mesh->positions[3 * index.p + 0],
-					fast_mesh->positions[3 * index.p + 1],
-					fast_mesh->positions[3 * index.p + 2],
-					1.0f
-				);
-				triangle.vertices[k].uv = {
-					fast_mesh->texcoords[2 * index.t + 0],
-					fast_mesh->texcoords[2 * index.t + 1]
-				};
-				triangle.vertices[k].normal = glm::vec3(
-					fast_mesh->normals[3 * index.n + 0],
-					fast_mesh->normals[3 * index.n + 1],
-					fast_mesh->normals[3 * index.n + 2]
-				);
-
-				idx++;
-			}
+	glm::vec3 min_p(triangles[0].vertices[0].position);
+	glm::vec3 max_p = min_p;
+	for (const Triangle& triangle : triangles)
+	{
+		for (const Vertex& vertex : triangle.vertices)
+		{
+			min_p = glm::min(min_p, glm::vec3(vertex.position));
+			max_p = glm::max(max_p, glm::vec3(vertex.position));
+		}
+	}
 
-			triangle.color = Colors::WHITE;
-			triangles.push_back(triangle);
+	// Center the sphere on the bounding box and grow it to fit every vertex
+	bounds_center = (min_p + max_p) * 0.5f;
+	bounds_radius = 0.0f;
+	for (const Triangle& triangle : triangles)
+	{
+		for (const Vertex& vertex : triangle.vertices)
+		{
+			const float distance = glm::length(glm::vec3(vertex.position) - bounds_center);
+			bounds_radius = std::max(bounds_radius, distance);
 		}
 	}
+}
 
-	std::cout << "Loaded " << filename << "\n";
+// Number of levels of detail, including the full resolution mesh
+constexpr int MAX_LODS = 6;
+// Each level tries to keep this fraction of the triangles of the last level
+constexpr float LOD_REDUCTION = 0.5f;
+// Don't bother simplifying meshes below this many triangles
+constexpr int MIN_LOD_TRIANGLES = 64;
+
+void Mesh::build_lods(bool lock_boundary)
+{
+	lods.clear();
+
+	int target_count = num_triangles();
+	int previous_count = num_triangles();
+	float previous_error = 0.0f;
+
+	for (int i = 1; i < MAX_LODS; i++)
+	{
+		target_count = (int)((float)target_count * LOD_REDUCTION);
+		if (target_count < MIN_LOD_TRIANGLES)
+		{
+			break;
+		}
+
+		// Every level is reduced from the full resolution mesh, so the error
+		// is always relative to the original surface
+		MeshLOD lod;
+		lod.error = simplify_triangles(triangles, target_count, lod.triangles, lock_boundary);
+		lod.error = std::max(lod.error, previous_error);
+
+		// Stop once the simplifier can't make any meaningful progress
+		const int count = (int)lod.triangles.size();
+		if (count == 0 || (float)count > (float)previous_count * 0.9f)
+		{
+			break;
+		}
 
-	// Destroy the fastobj mesh once we've imported it
-	fast_obj_destroy(fast_mesh);
+		previous_count = count;
+		previous_error = lod.error;
+		lods.push_back(std::move(lod));
+	}
 }
 
-void Mesh::rotate(rot3 amount)
+void Mesh::build_meshlets()
 {
-	rotation.pitch += amount.pitch; // x
-	rotation.yaw += amount.yaw; // y
-	rotation.roll += amount.roll; // z
+	// Meshlets reorder the triangles they are built from, so this has to run
+	// after the LODs have been simplified from the full resolution mesh
+	::build_meshlets(triangles, meshlets);
+	for (MeshLOD& lod : lods)
+	{
+		::build_meshlets(lod.triangles, lod.meshlets);
+	}
+
+	std::cout << "Built " << meshlets.size() << " meshlets\n";
 }
 
 int Mesh::num_triangles() const
@@ -116,21 +169,123 @@ int Mesh::num_triangles() const
 	return (int)triangles.size();
 }
 
-std::unique_ptr<Mesh> create_mesh(const char* filename)
+int Mesh::num_lods() const
+{
+	return (int)lods.size() + 1;
+}
+
+const std::vector<Triangle>& Mesh::get_lod_triangles(int lod) const
+{
+	if (lod <= 0 || lods.empty())
+	{
+		return triangles;
+	}
+	lod = std::min(lod, (int)lods.size());
+	return lods[lod - 1].triangles;
+}
+
+const std::vector<Meshlet>& Mesh::get_lod_meshlets(int lod) const
+{
+	if (lod <= 0 || lods.empty())
+	{
+		return meshlets;
+	}
+	lod = std::min(lod, (int)lods.size());
+	return lods[lod - 1].meshlets;
+}
+
+float Mesh::get_lod_error(int lod) const
+{
+	if (lod <= 0 || lods.empty())
+	{
+		return 0.0f;
+	}
+	lod = std::min(lod, (int)lods.size());
+	return lods[lod - 1].error;
+}
+
+std::unique_ptr<Mesh> create_mesh(const char* filename, const TextureLoadOptions& texture_options)
 {
 	std::unique_ptr<Mesh> mesh = std::make_unique<Mesh>();
-	mesh->load_from_obj(filename);
-	if (!mesh)
+	if (load_cached_mesh(filename, texture_options, *mesh))
 	{
-		return nullptr;
+		return mesh;
+	}
+
+	mesh->load_from_obj(filename, texture_options);
+	mesh->compute_bounds();
+	mesh->build_lods();
+
+	// Written in one go, meshes load on several threads at once
+	std::string lod_counts = std::to_string(mesh->num_triangles());
+	for (const MeshLOD& lod : mesh->lods)
+	{
+		lod_counts += " -> " + std::to_string(lod.triangles.size());
+	}
+	std::cout << "Built " + std::to_string(mesh->lods.size()) + " LODs (" + lod_counts + " triangles)\n";
+
+	mesh->build_meshlets();
+	if (!mesh->triangles.empty())
+	{
+		save_cached_mesh(filename, *mesh);
 	}
 	return mesh;
 }
 
-std::shared_ptr<Texture> load_texture(const char* filename)
+std::unique_ptr<Mesh> create_placeholder_mesh()
 {
-	// Allocate the Texture object
-	std::shared_ptr<Texture> texture = std::make_unique<Texture>();
+	std::unique_ptr<Mesh> mesh = std::make_unique<Mesh>();
+
+	// One grey texel, so the box shades like any other textured mesh
+	const uint32 grey = 0xFF808080;
+	mesh->textures.push_back(create_texture(&grey, 1, 1, sizeof(uint32)));
+	mesh->texture_files.push_back(std::string());
+
+	// Each face is spanned by two axes whose cross product points out of it,
+	// which keeps the corners counter-clockwise seen from outside
+	const glm::vec3 faces[6][3] = {
+		{ glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) },
+		{ glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+		{ glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 0.0f, 0.0f) },
+		{ glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f) },
+		{ glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f) },
+		{ glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f) },
+	};
+	const tex2 corners[2][3] = {
+		{ { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 0.0f, 1.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f } },
+	};
+	for (const glm::vec3* face : faces)
+	{
+		for (const tex2* triangle_corners : corners)
+		{
+			Triangle triangle;
+			for (int k = 0; k < 3; k++)
+			{
+				const tex2 uv = triangle_corners[k];
+				const glm::vec3 position = face[0] + face[1] * (uv.u * 2.0f - 1.0f) + face[2] * (uv.v * 2.0f - 1.0f);
+				triangle.vertices[k].position = glm::vec4(position, 1.0f);
+				triangle.vertices[k].uv = uv;
+				triangle.vertices[k].normal = face[0];
+			}
+			triangle.texture = mesh->textures[0].get();
+			triangle.color = Colors::WHITE;
+			mesh->triangles.push_back(triangle);
+		}
+	}
+
+	mesh->compute_bounds();
+	mesh->build_meshlets();
+	return mesh;
+}
+
+std::shared_ptr<Texture> load_texture(const char* filename, const TextureLoadOptions& options)
+{
+	std::shared_ptr<Texture> cached = load_cached_texture(filename, options);
+	if (cached)
+	{
+		return cached;
+	}
 
 	// Load the image using SDL_image
 	SDL_Surface* surface = IMG_Load(filename);
@@ -145,13 +300,21 @@ std::shared_ptr<Texture> load_texture(const char* filename)
 	surface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
 
 	// Copy the pixels of the surface over to our struct
-	texture->width = surface->w;
-	texture->height = surface->h;
-	texture->pixels = std::make_unique<uint32[]>(surface->w * surface->h);
-	memcpy(texture->pixels.get(), surface->pixels, surface->w * surface->h * sizeof(uint32));
+	std::shared_ptr<Texture> texture = create_texture(
+		(const uint32*)surface->pixels,
+		surface->w,
+		surface->h,
+		surface->pitch,
+		options
+	);
 
 	// Free the created surface now that we're done with it
 	SDL_FreeSurface(surface);
 
+	if (texture)
+	{
+		save_cached_texture(filename, options, *texture);
+	}
+
 	return texture;
 }
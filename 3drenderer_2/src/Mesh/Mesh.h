@@ -1,33 +1,66 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include <vector>
 
-#include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
-#include <glm/vec4.hpp>
 
-#include "../Entity/Entity.h"
+#include "Meshlet.h"
+#include "Texture.h"
 
-struct Texture;
 struct Triangle;
 
-struct Mesh : Entity
+/** A reduced copy of a mesh used when it is far away from the camera */
+struct MeshLOD
 {
-	Mesh(
-		glm::vec3 scale = glm::vec3(1.0f), 
-		rot3 rotation = rot3(0.0f),
-		glm::vec3 translation = glm::vec3(0.0f)
-	);
-	~Mesh() = default;
+	std::vector<Triangle> triangles;
+	std::vector<Meshlet> meshlets;
+	float error; // how far (in object space) the surface may have moved
+};
 
-	void load_from_obj(const char* filename);
-	void rotate(rot3 rotation);
+/**
+ * Object space geometry and textures of a model. A mesh isn't placed in the
+ * world itself, that is done by the MeshInstances referencing it
+ */
+struct Mesh
+{
+	void load_from_obj(
+		const char* filename,
+		const TextureLoadOptions& texture_options = TextureLoadOptions()
+	);
+	void compute_bounds();
+	/** lock_boundary keeps the open boundaries in place, see simplify_triangles() */
+	void build_lods(bool lock_boundary = false);
+	void build_meshlets();
 	int num_triangles() const;
+	int num_lods() const;
+	const std::vector<Triangle>& get_lod_triangles(int lod) const;
+	const std::vector<Meshlet>& get_lod_meshlets(int lod) const;
+	float get_lod_error(int lod) const;
 
-	std::vector<Triangle> triangles;
-	std::vector<std::shared_ptr<Texture>> textures;
+	std::vector<Triangle> triangles; // full resolution
+	std::vector<Meshlet> meshlets; // clusters of the full resolution triangles
+	std::vector<MeshLOD> lods; // LOD 1 and up, each coarser than the last
+	std::vector<std::shared_ptr<Texture>> textures; // referenced by the triangles
+	std::vector<std::string> texture_files; // image of each material, empty if it has none
+
+	// Object space bounding sphere
+	glm::vec3 bounds_center = glm::vec3(0.0f);
+	float bounds_radius = 0.0f;
 };
 
-std::unique_ptr<Mesh> create_mesh(const char* filename);
-std::shared_ptr<Texture> load_texture(const char* filename);
+std::unique_ptr<Mesh> create_mesh(
+	const char* filename,
+	const TextureLoadOptions& texture_options = TextureLoadOptions()
+);
+/** Grey box two units across, drawn in place of meshes that are still loading */
+std::unique_ptr<Mesh> create_placeholder_mesh();
+/**
+ * Decodes the image, or maps it from its asset cache file, every time. See
+ * get_texture() for the version shared between meshes
+ */
+std::shared_ptr<Texture> load_texture(
+	const char* filename,
+	const TextureLoadOptions& options = TextureLoadOptions()
+);
@@ -0,0 +1,493 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <unordered_map>
+
+#include <glm/geometric.hpp>
+
+#include "../Triangle/Triangle.h"
+#include "../Utils/hash_helpers.h"
+#include "../Utils/TraceRecorder.h"
+
+namespace
+{
+	/**
+	 * Symmetric 4x4 matrix storing the sum of the squared distances to a set of
+	 * planes. Only the upper triangle is kept around, along with the total
+	 * weight of the planes so the mean squared distance can be recovered
+	 */
+	struct Quadric
+	{
+		double m[10] = {};
+		double weight = 0.0;
+
+		void add_plane(const glm::dvec3& n, double d, double weight = 1.0)
+		{
+			m[0] += weight * n.x * n.x;
+			m[1] += weight * n.x * n.y;
+			m[2] += weight * n.x * n.z;
+			m[3] += weight * n.x * d;
+			m[4] += weight * n.y * n.y;
+			m[5] += weight * n.y * n.z;
+			m[6] += weight * n.y * d;
+			m[7] += weight * n.z * n.z;
+			m[8] += weight * n.z * d;
+			m[9] += weight * d * d;
+			this->weight += weight;
+		}
+
+		void add(const Quadric& q)
+		{
+			for (int i = 0; i < 10; i++)
+			{
+				m[i] += q.m[i];
+			}
+			weight += q.weight;
+		}
+
+		double evaluate(const glm::vec3& p) const
+		{
+			const double x = p.x;
+			const double y = p.y;
+			const double z = p.z;
+			const double result = m[0] * x * x + 2.0 * m[1] * x * y
+								  + 2.0 * m[2] * x * z + 2.0 * m[3] * x
+								  + m[4] * y * y + 2.0 * m[5] * y * z
+								  + 2.0 * m[6] * y + m[7] * z * z
+								  + 2.0 * m[8] * z + m[9];
+			// Guard against rounding errors pushing the result below zero
+			return std::max(result, 0.0);
+		}
+	};
+
+	// Per-corner attributes that are carried over from the source triangle
+	struct Corner
+	{
+		tex2 uv;
+		glm::vec3 normal;
+	};
+
+	struct Face
+	{
+		int v[3];
+		Corner corners[3];
+		int source; // index of the triangle this face came from
+		bool alive;
+	};
+
+	// A candidate collapse of the vertex "from" onto the vertex "to"
+	struct Collapse
+	{
+		double cost;
+		double error; // mean squared distance the surface moves by
+		int from;
+		int to;
+		uint32 from_version;
+		uint32 to_version;
+
+		// Inverted so that std::priority_queue hands out the cheapest collapse
+		bool operator<(const Collapse& other) const
+		{
+			return cost > other.cost;
+		}
+	};
+
+	bool same_corner(const Corner& a, const Corner& b)
+	{
+		return a.uv.u == b.uv.u && a.uv.v == b.uv.v && a.normal == b.normal;
+	}
+
+	uint64 edge_key(int a, int b)
+	{
+		const uint32 lo = (uint32)std::min(a, b);
+		const uint32 hi = (uint32)std::max(a, b);
+		return ((uint64)hi << 32) | lo;
+	}
+
+	int corner_of(const Face& face, int vertex)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			if (face.v[i] == vertex)
+			{
+				return i;
+			}
+		}
+		return -1;
+	}
+}
+
+
+// Faces whose normal would turn by more than this (cosine of the angle) after
+// a collapse are considered folded over, and the collapse is rejected
+constexpr float MIN_FLIP_COS = 0.2f;
+
+// Collapsing a vertex across a UV or normal seam smears the attributes of one
+// side of the seam over the other. Those collapses are charged as if the
+// surface had moved by the length of the collapsed edge, scaled by this weight.
+// This only pushes them to the back of the queue, it isn't counted towards the
+// geometric error of the result
+constexpr double SEAM_PENALTY = 1.0;
+
+// Open boundaries are kept in place by planes running along the boundary edge,
+// perpendicular to its face. They are weighted heavily so the outline of the
+// mesh survives much longer than its interior
+constexpr double BOUNDARY_WEIGHT = 10.0;
+
+namespace
+{
+	struct Simplifier
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<Face> faces;
+		std::vector<Quadric> quadrics;
+		std::vector<std::vector<int>> vertex_faces;
+		std::vector<uint32> versions;
+		std::vector<bool> vertex_alive;
+		// Vertices on non-manifold edges stay where they are, and so do those
+		// on open boundaries if asked to
+		std::vector<bool> locked;
+		std::vector<int> edge_faces;
+
+		/**
+		 * Gathers the faces that share the edge between from and to. Returns
+		 * false if the edge no longer exists
+		 */
+		bool gather_edge_faces(int from, int to)
+		{
+			edge_faces.clear();
+			for (const int f : vertex_faces[from])
+			{
+				if (faces[f].alive && corner_of(faces[f], to) >= 0)
+				{
+					edge_faces.push_back(f);
+				}
+			}
+			return !edge_faces.empty();
+		}
+
+		/**
+		 * Finds the edge face on the same side of any seam running through
+		 * from as the given face, so its corner of to can be reused.
+		 */
+		int find_matching_edge_face(const Face& face, int from) const
+		{
+			const Corner& corner = face.corners[corner_of(face, from)];
+			for (const int e : edge_faces)
+			{
+				const Face& edge_face = faces[e];
+				if (same_corner(edge_face.corners[corner_of(edge_face, from)], corner))
+				{
+					return e;
+				}
+			}
+			return -1;
+		}
+
+		bool breaks_seam(int from, int to)
+		{
+			for (const int f : vertex_faces[from])
+			{
+				const Face& face = faces[f];
+				if (face.alive && corner_of(face, to) < 0
+					&& find_matching_edge_face(face, from) < 0)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool folds_over(int from, int to) const
+		{
+			for (const int f : vertex_faces[from])
+			{
+				const Face& face = faces[f];
+				if (!face.alive || corner_of(face, to) >= 0)
+				{
+					continue;
+				}
+				const int k = corner_of(face, from);
+				const glm::vec3& p0 = positions[face.v[(k + 1) % 3]];
+				const glm::vec3& p1 = positions[face.v[(k + 2) % 3]];
+				const glm::vec3 old_normal = glm::cross(p0 - positions[from], p1 - positions[from]);
+				const glm::vec3 new_normal = glm::cross(p0 - positions[to], p1 - positions[to]);
+				const float old_length = glm::length(old_normal);
+				const float new_length = glm::length(new_normal);
+				if (new_length <= 0.0f
+					|| glm::dot(old_normal, new_normal) < MIN_FLIP_COS * old_length * new_length)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool evaluate(int from, int to, double& cost, double& error)
+		{
+			if (locked[from] || !gather_edge_faces(from, to))
+			{
+				return false;
+			}
+			Quadric q = quadrics[from];
+			q.add(quadrics[to]);
+			cost = q.evaluate(positions[to]);
+			error = q.weight > 0.0 ? cost / q.weight : 0.0;
+			if (breaks_seam(from, to))
+			{
+				const glm::vec3 edge = positions[to] - positions[from];
+				cost += SEAM_PENALTY * (double)glm::dot(edge, edge);
+			}
+			return true;
+		}
+
+		/**
+		 * Moves from onto to. The faces that shared the edge disappear, and
+		 * every other face around from picks up the attributes of to from the
+		 * edge face on its side of the seam. Returns the number of faces lost
+		 */
+		int collapse(int from, int to)
+		{
+			std::vector<Corner> new_corners;
+			for (const int f : vertex_faces[from])
+			{
+				const Face& face = faces[f];
+				if (!face.alive || corner_of(face, to) >= 0)
+				{
+					continue;
+				}
+				int e = find_matching_edge_face(face, from);
+				e = e < 0 ? edge_faces[0] : e;
+				new_corners.push_back(faces[e].corners[corner_of(faces[e], to)]);
+			}
+
+			int num_removed = 0;
+			int i = 0;
+			for (const int f : vertex_faces[from])
+			{
+				Face& face = faces[f];
+				if (!face.alive)
+				{
+					continue;
+				}
+				if (corner_of(face, to) >= 0)
+				{
+					face.alive = false;
+					num_removed++;
+					continue;
+				}
+				const int k = corner_of(face, from);
+				face.v[k] = to;
+				face.corners[k] = new_corners[i++];
+				vertex_faces[to].push_back(f);
+			}
+
+			vertex_alive[from] = false;
+			vertex_faces[from].clear();
+			quadrics[to].add(quadrics[from]);
+			versions[to]++;
+
+			// Compact the face list of the surviving vertex
+			std::vector<int>& to_faces = vertex_faces[to];
+			to_faces.erase(
+				std::remove_if(to_faces.begin(), to_faces.end(),
+					[&](int f) { return !faces[f].alive; }),
+				to_faces.end()
+			);
+
+			return num_removed;
+		}
+	};
+}
+
+float simplify_triangles(
+	const std::vector<Triangle>& in_tris,
+	int target_count,
+	std::vector<Triangle>& out_tris,
+	bool lock_boundary
+)
+{
+	ZoneScoped; // for tracy
+
+	out_tris.clear();
+
+	Simplifier s;
+
+	/* Weld the triangle soup into an indexed mesh */
+	std::unordered_map<glm::vec3, int, Vec3BitHash> position_lookup;
+	s.faces.reserve(in_tris.size());
+	for (int i = 0; i < (int)in_tris.size(); i++)
+	{
+		const Triangle& triangle = in_tris[i];
+		Face face;
+		face.source = i;
+		face.alive = true;
+		for (int k = 0; k < 3; k++)
+		{
+			const Vertex& vertex = triangle.vertices[k];
+			const glm::vec3 p(vertex.position);
+			auto [it, inserted] = position_lookup.try_emplace(p, (int)s.positions.size());
+			if (inserted)
+			{
+				s.positions.push_back(p);
+			}
+			face.v[k] = it->second;
+			face.corners[k] = { vertex.uv, vertex.normal };
+		}
+		s.faces.push_back(face);
+	}
+
+	const int num_vertices = (int)s.positions.size();
+	s.quadrics.resize(num_vertices);
+	s.vertex_faces.resize(num_vertices);
+	s.versions.assign(num_vertices, 0);
+	s.vertex_alive.assign(num_vertices, true);
+	s.locked.assign(num_vertices, false);
+
+	// Number of faces around each edge, along with the last face seen
+	std::unordered_map<uint64, std::pair<int, int>> edge_counts;
+	int num_alive = 0;
+	for (int i = 0; i < (int)s.faces.size(); i++)
+	{
+		Face& face = s.faces[i];
+		const glm::vec3& a = s.positions[face.v[0]];
+		const glm::vec3& b = s.positions[face.v[1]];
+		const glm::vec3& c = s.positions[face.v[2]];
+		const glm::vec3 cross = glm::cross(b - a, c - a);
+		const float length = glm::length(cross);
+
+		// Drop degenerate faces straight away
+		if (face.v[0] == face.v[1] || face.v[1] == face.v[2]
+			|| face.v[2] == face.v[0] || length <= 0.0f)
+		{
+			face.alive = false;
+			continue;
+		}
+		num_alive++;
+
+		const glm::dvec3 normal = glm::dvec3(cross / length);
+		const double d = -glm::dot(normal, glm::dvec3(a));
+
+		for (int k = 0; k < 3; k++)
+		{
+			s.quadrics[face.v[k]].add_plane(normal, d);
+			s.vertex_faces[face.v[k]].push_back(i);
+			std::pair<int, int>& edge = edge_counts[edge_key(face.v[k], face.v[(k + 1) % 3])];
+			edge.first++;
+			edge.second = i;
+		}
+	}
+
+	for (const auto& [key, edge] : edge_counts)
+	{
+		const int a = (int)(key & 0xFFFFFFFF);
+		const int b = (int)(key >> 32);
+		if (edge.first == 1 && lock_boundary)
+		{
+			s.locked[a] = true;
+			s.locked[b] = true;
+		}
+		else if (edge.first == 1)
+		{
+			const Face& face = s.faces[edge.second];
+			const glm::vec3& p0 = s.positions[face.v[0]];
+			const glm::vec3 face_normal = glm::cross(
+				s.positions[face.v[1]] - p0, s.positions[face.v[2]] - p0);
+			const glm::vec3 along = s.positions[b] - s.positions[a];
+			const glm::vec3 cross = glm::cross(along, face_normal);
+			const float length = glm::length(cross);
+			if (length > 0.0f)
+			{
+				const glm::dvec3 normal = glm::dvec3(cross / length);
+				const double d = -glm::dot(normal, glm::dvec3(s.positions[a]));
+				s.quadrics[a].add_plane(normal, d, BOUNDARY_WEIGHT);
+				s.quadrics[b].add_plane(normal, d, BOUNDARY_WEIGHT);
+			}
+		}
+		else if (edge.first > 2)
+		{
+			s.locked[a] = true;
+			s.locked[b] = true;
+		}
+	}
+
+	std::priority_queue<Collapse> heap;
+
+	auto push_edge = [&](int from, int to)
+	{
+		double cost, error;
+		if (s.evaluate(from, to, cost, error))
+		{
+			heap.push({ cost, error, from, to, s.versions[from], s.versions[to] });
+		}
+	};
+
+	for (const auto& [key, edge] : edge_counts)
+	{
+		const int a = (int)(key & 0xFFFFFFFF);
+		const int b = (int)(key >> 32);
+		push_edge(a, b);
+		push_edge(b, a);
+	}
+
+	double max_error = 0.0;
+
+	/* Collapse the cheapest edges until we hit the target */
+	while (num_alive > target_count && !heap.empty())
+	{
+		const Collapse collapse = heap.top();
+		heap.pop();
+
+		const int from = collapse.from;
+		const int to = collapse.to;
+
+		// Skip entries that went stale after an earlier collapse
+		if (!s.vertex_alive[from] || !s.vertex_alive[to]
+			|| s.versions[from] != collapse.from_version
+			|| s.versions[to] != collapse.to_version
+			|| !s.gather_edge_faces(from, to)
+			|| s.folds_over(from, to))
+		{
+			continue;
+		}
+
+		num_alive -= s.collapse(from, to);
+		max_error = std::max(max_error, collapse.error);
+
+		// Re-queue all the edges touching the surviving vertex
+		for (const int f : s.vertex_faces[to])
+		{
+			for (const int v : s.faces[f].v)
+			{
+				if (v != to)
+				{
+					push_edge(to, v);
+					push_edge(v, to);
+				}
+			}
+		}
+	}
+
+	/* Rebuild the triangle soup from the surviving faces */
+	out_tris.reserve(num_alive);
+	for (const Face& face : s.faces)
+	{
+		if (!face.alive)
+		{
+			continue;
+		}
+		Triangle triangle = in_tris[face.source];
+		for (int k = 0; k < 3; k++)
+		{
+			triangle.vertices[k].position = glm::vec4(s.positions[face.v[k]], 1.0f);
+			triangle.vertices[k].uv = face.corners[k].uv;
+			triangle.vertices[k].normal = face.corners[k].normal;
+		}
+		out_tris.push_back(triangle);
+	}
+
+	const float error = (float)sqrt(max_error);
+	return error;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+struct Triangle;
+
+/**
+ * Reduces a triangle soup down to roughly target_count triangles using
+ * quadric error metric edge collapses (Garland & Heckbert). Vertices are
+ * welded by position so that the soup can be treated as a connected mesh.
+ * Only vertices on non-manifold edges are never moved. Collapses across a
+ * UV/normal seam are charged extra so they come last, and open boundaries are
+ * held by heavily weighted planes, but both can still be collapsed: a vertex in
+ * the middle of a straight boundary lies in those planes and costs nothing to
+ * remove. lock_boundary locks the vertices of open boundaries as well, for
+ * pieces cut out of a larger mesh whose borders have to keep matching their
+ * neighbours. Returns the object-space geometric error of the result, which is
+ * used to pick a level of detail based on its projected size on screen
+ */
+float simplify_triangles(
+	const std::vector<Triangle>& in_tris,
+	int target_count,
+	std::vector<Triangle>& out_tris,
+	bool lock_boundary = false
+);
@@ -0,0 +1,99 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "../Triangle/Triangle.h"
+#include "../Utils/UnitTests.h"
+
+// Quads of the test grid along each side, and the column it is cut at
+constexpr int GRID_SIZE = 32;
+constexpr int GRID_CUT = 16;
+
+/**
+ * A gently curved height field over the columns [first_column, last_column) of
+ * the grid, two triangles per quad. UVs and normals are continuous, so the only
+ * open boundary is the outline of the piece
+ */
+static std::vector<Triangle> make_grid(int first_column, int last_column)
+{
+	auto make_vertex = [](int x, int z)
+	{
+		Vertex vertex = {};
+		const float height = sinf((float)x * 0.3f) * cosf((float)z * 0.2f);
+		vertex.position = glm::vec4((float)x, height, (float)z, 1.0f);
+		vertex.uv = { (float)x / GRID_SIZE, (float)z / GRID_SIZE };
+		vertex.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+		return vertex;
+	};
+
+	std::vector<Triangle> triangles;
+	for (int z = 0; z < GRID_SIZE; z++)
+	{
+		for (int x = first_column; x < last_column; x++)
+		{
+			Triangle a = {};
+			a.vertices = { make_vertex(x, z), make_vertex(x, z + 1), make_vertex(x + 1, z + 1) };
+			Triangle b = {};
+			b.vertices = { make_vertex(x, z), make_vertex(x + 1, z + 1), make_vertex(x + 1, z) };
+			triangles.push_back(a);
+			triangles.push_back(b);
+		}
+	}
+	return triangles;
+}
+
+/** Edges of the triangles lying on the cut, as sorted pairs of z */
+static std::vector<std::pair<float, float>> get_cut_edges(const std::vector<Triangle>& triangles)
+{
+	std::vector<std::pair<float, float>> edges;
+	for (const Triangle& triangle : triangles)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			const glm::vec4& a = triangle.vertices[k].position;
+			const glm::vec4& b = triangle.vertices[(k + 1) % 3].position;
+			if (a.x == (float)GRID_CUT && b.x == (float)GRID_CUT)
+			{
+				edges.push_back({ std::min(a.z, b.z), std::max(a.z, b.z) });
+			}
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	return edges;
+}
+
+UNIT_TEST("simplifier: locked boundaries of neighbouring pieces match at any level")
+{
+	const std::vector<Triangle> left = make_grid(0, GRID_CUT);
+	const std::vector<Triangle> right = make_grid(GRID_CUT, GRID_SIZE);
+
+	std::vector<Triangle> coarse_left;
+	std::vector<Triangle> fine_right;
+	simplify_triangles(left, (int)left.size() / 8, coarse_left, true);
+	simplify_triangles(right, (int)right.size() / 2, fine_right, true);
+
+	// Both were simplified, to different levels
+	CHECK(coarse_left.size() < left.size() / 2);
+	CHECK(fine_right.size() < right.size());
+	CHECK(coarse_left.size() < fine_right.size());
+
+	// The cut is still split at every grid line on both sides
+	const std::vector<std::pair<float, float>> left_edges = get_cut_edges(coarse_left);
+	const std::vector<std::pair<float, float>> right_edges = get_cut_edges(fine_right);
+	CHECK(left_edges.size() == GRID_SIZE);
+	CHECK(left_edges == right_edges);
+	CHECK(left_edges == get_cut_edges(left));
+}
+
+UNIT_TEST("simplifier: open boundaries are only penalised unless locked")
+{
+	const std::vector<Triangle> left = make_grid(0, GRID_CUT);
+
+	std::vector<Triangle> simplified;
+	simplify_triangles(left, (int)left.size() / 8, simplified);
+
+	// The straight cut costs nothing to collapse along, so some of it goes
+	CHECK(get_cut_edges(simplified).size() < GRID_SIZE);
+}
@@ -0,0 +1,338 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_access.hpp>
+
+#include "../Triangle/Triangle.h"
+#include "../Utils/hash_helpers.h"
+#include "../Utils/TraceRecorder.h"
+
+// How many not yet emitted triangles to look through for the closest one when
+// a meshlet runs out of connected triangles to grow into
+constexpr int SEED_SEARCH_WINDOW = 512;
+
+// How much a triangle facing away from the rest of the meshlet counts against
+// it, relative to the number of new vertices it adds. Keeping the normals of a
+// meshlet close together makes its normal cone narrow enough to be culled
+constexpr float CONE_WEIGHT = 2.0f;
+
+// Normals spread out further than this (cosine of the angle to the cone axis)
+// produce a cone that is too wide to ever be culled
+constexpr float MIN_CONE_DOT = 0.1f;
+
+static void compute_meshlet_bounds(
+	const std::vector<Triangle>& triangles,
+	Meshlet& meshlet
+)
+{
+	const int first = meshlet.triangle_offset;
+	const int last = meshlet.triangle_offset + meshlet.triangle_count;
+
+	// Bounding sphere centered on the bounding box
+	glm::vec3 min_p(triangles[first].vertices[0].position);
+	glm::vec3 max_p = min_p;
+	for (int i = first; i < last; i++)
+	{
+		for (const Vertex& vertex : triangles[i].vertices)
+		{
+			min_p = glm::min(min_p, glm::vec3(vertex.position));
+			max_p = glm::max(max_p, glm::vec3(vertex.position));
+		}
+	}
+	meshlet.center = (min_p + max_p) * 0.5f;
+	meshlet.radius = 0.0f;
+	for (int i = first; i < last; i++)
+	{
+		for (const Vertex& vertex : triangles[i].vertices)
+		{
+			const float distance = glm::length(glm::vec3(vertex.position) - meshlet.center);
+			meshlet.radius = std::max(meshlet.radius, distance);
+		}
+	}
+
+	// Average the face normals to get the axis of the normal cone
+	std::vector<glm::vec3> normals;
+	normals.reserve(meshlet.triangle_count);
+	glm::vec3 axis(0.0f);
+	for (int i = first; i < last; i++)
+	{
+		const Triangle& triangle = triangles[i];
+		const glm::vec3 ab = glm::vec3(triangle.vertices[1].position - triangle.vertices[0].position);
+		const glm::vec3 ac = glm::vec3(triangle.vertices[2].position - triangle.vertices[0].position);
+		const glm::vec3 normal = glm::cross(ab, ac);
+		const float length = glm::length(normal);
+		if (length > 0.0f)
+		{
+			normals.push_back(normal / length);
+			axis += normals.back();
+		}
+	}
+
+	meshlet.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.cone_cutoff = 1.0f;
+
+	const float axis_length = glm::length(axis);
+	if (axis_length <= 0.0f)
+	{
+		return;
+	}
+	axis /= axis_length;
+
+	// Find the normal that strays the furthest from the axis
+	float min_dot = 1.0f;
+	for (const glm::vec3& normal : normals)
+	{
+		min_dot = std::min(min_dot, glm::dot(axis, normal));
+	}
+
+	meshlet.cone_axis = axis;
+	if (min_dot > MIN_CONE_DOT)
+	{
+		// The meshlet is back facing once the view direction is within 90
+		// degrees minus the spread angle of the axis. cos(90 - a) = sin(a)
+		meshlet.cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+	}
+}
+
+void build_meshlets(std::vector<Triangle>& triangles, std::vector<Meshlet>& meshlets)
+{
+	ZoneScoped; // for tracy
+
+	meshlets.clear();
+
+	const int num_triangles = (int)triangles.size();
+	if (num_triangles == 0)
+	{
+		return;
+	}
+
+	// Weld the vertices by position so we know which triangles are neighbours
+	std::vector<int> indices((size_t)num_triangles * 3);
+	std::unordered_map<glm::vec3, int, Vec3BitHash> position_lookup;
+	for (int i = 0; i < num_triangles; i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			const glm::vec3 p(triangles[i].vertices[k].position);
+			auto [it, inserted] = position_lookup.try_emplace(p, (int)position_lookup.size());
+			indices[(size_t)i * 3 + k] = it->second;
+		}
+	}
+
+	const int num_vertices = (int)position_lookup.size();
+	std::vector<std::vector<int>> vertex_triangles(num_vertices);
+	for (int i = 0; i < num_triangles * 3; i++)
+	{
+		vertex_triangles[indices[i]].push_back(i / 3);
+	}
+
+	std::vector<glm::vec3> face_normals(num_triangles);
+	for (int i = 0; i < num_triangles; i++)
+	{
+		const Triangle& triangle = triangles[i];
+		const glm::vec3 ab = glm::vec3(triangle.vertices[1].position - triangle.vertices[0].position);
+		const glm::vec3 ac = glm::vec3(triangle.vertices[2].position - triangle.vertices[0].position);
+		const glm::vec3 normal = glm::cross(ab, ac);
+		const float length = glm::length(normal);
+		face_normals[i] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+	}
+
+	std::vector<bool> emitted(num_triangles, false);
+	// The meshlet each vertex was last added to
+	std::vector<int> vertex_meshlet(num_vertices, -1);
+	std::vector<int> order;
+	order.reserve(num_triangles);
+	std::vector<int> candidates;
+
+	auto count_new_vertices = [&](int triangle, int meshlet_index)
+	{
+		int count = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			const int v = indices[(size_t)triangle * 3 + k];
+			count += vertex_meshlet[v] != meshlet_index ? 1 : 0;
+		}
+		return count;
+	};
+
+	int next_seed = 0;
+	while ((int)order.size() < num_triangles)
+	{
+		const int meshlet_index = (int)meshlets.size();
+		Meshlet meshlet;
+		meshlet.triangle_offset = (int)order.size();
+		meshlet.triangle_count = 0;
+		meshlet.vertex_count = 0;
+
+		glm::vec3 centroid_sum(0.0f);
+		glm::vec3 normal_sum(0.0f);
+		candidates.clear();
+
+		while (true)
+		{
+			// Grow into the neighbouring triangle that adds the fewest new
+			// vertices and faces the same way as the rest of the meshlet
+			const float normal_length = glm::length(normal_sum);
+			const glm::vec3 average_normal = normal_length > 0.0f ? normal_sum / normal_length : glm::vec3(0.0f);
+
+			int best = -1;
+			int best_new = 4;
+			float best_score = std::numeric_limits<float>::max();
+			for (const int t : candidates)
+			{
+				if (emitted[t])
+				{
+					continue;
+				}
+				const int num_new = count_new_vertices(t, meshlet_index);
+				const float spread = 1.0f - glm::dot(face_normals[t], average_normal);
+				const float score = (float)num_new + CONE_WEIGHT * spread;
+				if (score < best_score)
+				{
+					best = t;
+					best_new = num_new;
+					best_score = score;
+				}
+			}
+
+			// Nothing connected is left, so jump to the closest triangle
+			if (best < 0)
+			{
+				while (next_seed < num_triangles && emitted[next_seed])
+				{
+					next_seed++;
+				}
+				if (next_seed == num_triangles)
+				{
+					break;
+				}
+
+				best = next_seed;
+				if (meshlet.triangle_count > 0)
+				{
+					const glm::vec3 centroid = centroid_sum / (float)meshlet.triangle_count;
+					float best_distance = std::numeric_limits<float>::max();
+					const int end = std::min(num_triangles, next_seed + SEED_SEARCH_WINDOW);
+					for (int t = next_seed; t < end; t++)
+					{
+						if (emitted[t])
+						{
+							continue;
+						}
+						const glm::vec3 p(triangles[t].vertices[0].position);
+						const float distance = glm::dot(p - centroid, p - centroid);
+						if (distance < best_distance)
+						{
+							best = t;
+							best_distance = distance;
+						}
+					}
+				}
+				best_new = count_new_vertices(best, meshlet_index);
+			}
+
+			if (meshlet.vertex_count + best_new > MAX_MESHLET_VERTICES
+				|| meshlet.triangle_count + 1 > MAX_MESHLET_TRIANGLES)
+			{
+				break;
+			}
+
+			// Add the triangle to the meshlet
+			emitted[best] = true;
+			order.push_back(best);
+			meshlet.triangle_count++;
+			meshlet.vertex_count += best_new;
+			centroid_sum += glm::vec3(triangles[best].vertices[0].position);
+			normal_sum += face_normals[best];
+			for (int k = 0; k < 3; k++)
+			{
+				const int v = indices[(size_t)best * 3 + k];
+				vertex_meshlet[v] = meshlet_index;
+				for (const int t : vertex_triangles[v])
+				{
+					if (!emitted[t])
+					{
+						candidates.push_back(t);
+					}
+				}
+			}
+
+			// Throw out candidates that have been emitted in the meantime
+			candidates.erase(
+				std::remove_if(candidates.begin(), candidates.end(),
+					[&](int t) { return emitted[t]; }),
+				candidates.end()
+			);
+		}
+
+		meshlets.push_back(meshlet);
+	}
+
+	// Lay the triangles out in meshlet order
+	std::vector<Triangle> reordered;
+	reordered.reserve(num_triangles);
+	for (const int t : order)
+	{
+		reordered.push_back(triangles[t]);
+	}
+	triangles = std::move(reordered);
+
+	for (Meshlet& meshlet : meshlets)
+	{
+		compute_meshlet_bounds(triangles, meshlet);
+	}
+}
+
+void extract_frustum_planes(const glm::mat4& clip_matrix, glm::vec4* planes)
+{
+	const glm::vec4 row_x = glm::row(clip_matrix, 0);
+	const glm::vec4 row_y = glm::row(clip_matrix, 1);
+	const glm::vec4 row_z = glm::row(clip_matrix, 2);
+	const glm::vec4 row_w = glm::row(clip_matrix, 3);
+
+	// Same inequalities as the clipper (-w <= x <= w etc.)
+	planes[0] = row_w + row_x; // left
+	planes[1] = row_w - row_x; // right
+	planes[2] = row_w + row_y; // bottom
+	planes[3] = row_w - row_y; // top
+	planes[4] = row_w + row_z; // near
+	planes[5] = row_w - row_z; // far
+
+	for (int i = 0; i < 6; i++)
+	{
+		const float length = glm::length(glm::vec3(planes[i]));
+		planes[i] /= length;
+	}
+}
+
+bool is_sphere_outside_frustum(
+	const glm::vec3& center,
+	float radius,
+	const glm::vec4* planes
+)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		const float distance = glm::dot(glm::vec3(planes[i]), center) + planes[i].w;
+		if (distance < -radius)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool is_meshlet_backfacing(const Meshlet& meshlet, const glm::vec3& camera_position)
+{
+	// Conservative cone test that accounts for the view direction changing
+	// across the bounding sphere
+	const glm::vec3 view = meshlet.center - camera_position;
+	const bool result = glm::dot(view, meshlet.cone_axis)
+						>= meshlet.cone_cutoff * glm::length(view) + meshlet.radius;
+	return result;
+}
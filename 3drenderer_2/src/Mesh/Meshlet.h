@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+struct Triangle;
+
+constexpr int MAX_MESHLET_VERTICES = 64;
+constexpr int MAX_MESHLET_TRIANGLES = 124;
+
+/**
+ * A small cluster of neighbouring triangles that gets culled as a whole before
+ * any of its vertices are transformed
+ */
+struct Meshlet
+{
+	int triangle_offset; // index of the first triangle in the triangle array
+	int triangle_count;
+	int vertex_count;
+
+	// Object space bounding sphere
+	glm::vec3 center;
+	float radius;
+
+	// Every face normal in the meshlet lies inside the cone around cone_axis.
+	// cone_cutoff is the sine of the spread angle of the cone, or 1.0 if the
+	// normals are spread out too far for the cone to ever be culled
+	glm::vec3 cone_axis;
+	float cone_cutoff;
+};
+
+/**
+ * Reorders the triangles so that each meshlet occupies a contiguous range and
+ * writes out the meshlets covering them
+ */
+void build_meshlets(std::vector<Triangle>& triangles, std::vector<Meshlet>& meshlets);
+
+/** Extracts the six (normalized) frustum planes from a clip matrix */
+void extract_frustum_planes(const glm::mat4& clip_matrix, glm::vec4* planes);
+
+bool is_sphere_outside_frustum(
+	const glm::vec3& center,
+	float radius,
+	const glm::vec4* planes
+);
+bool is_meshlet_backfacing(const Meshlet& meshlet, const glm::vec3& camera_position);
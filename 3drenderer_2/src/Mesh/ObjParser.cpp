@@ -0,0 +1,506 @@
+#include "ObjParser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+#include <glm/vec3.hpp>
+#include <omp.h>
+
+#include "../Triangle/Triangle.h"
+#include "../Utils/MappedFile.h"
+#include "../Utils/TraceRecorder.h"
+
+// Smaller files aren't worth splitting
+constexpr size_t MIN_CHUNK_SIZE = 64 * 1024;
+// More chunks than threads, so a thread that gets a slow chunk doesn't hold up
+// the others
+constexpr size_t CHUNKS_PER_THREAD = 4;
+
+// Negative OBJ indices count back from the last vertex read. They are kept
+// relative to the first vertex of the chunk until the chunks are stitched
+constexpr uint8 RELATIVE_POSITION = 1 << 0;
+constexpr uint8 RELATIVE_TEXCOORD = 1 << 1;
+constexpr uint8 RELATIVE_NORMAL = 1 << 2;
+
+struct ObjCorner
+{
+	int position;
+	int texcoord;
+	int normal;
+	uint8 relative;
+};
+
+/** Everything read from one line aligned piece of the file */
+struct ObjChunk
+{
+	const char* begin;
+	const char* end;
+
+	std::vector<glm::vec3> positions;
+	std::vector<tex2> texcoords;
+	std::vector<glm::vec3> normals;
+	std::vector<ObjCorner> corners; // three per triangle
+	std::vector<int> triangle_materials; // in material_names, -1 before the first usemtl
+	std::vector<std::string> material_names; // in order of first use
+	std::vector<std::string> libraries;
+	int last_material = -1; // in material_names
+
+	// Filled in when the chunks are stitched
+	int first_position;
+	int first_texcoord;
+	int first_normal;
+	int first_triangle;
+	int inherited_material; // in effect at the start of the chunk
+	std::vector<int> materials; // global index of each of material_names
+};
+
+static inline bool is_space(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+static const char* skip_spaces(const char* p, const char* end)
+{
+	while (p < end && is_space(*p))
+	{
+		p++;
+	}
+	return p;
+}
+
+/** Start of the line after the one p is in */
+static const char* skip_line(const char* p, const char* end)
+{
+	const char* newline = (const char*)memchr(p, '\n', end - p);
+	return newline ? newline + 1 : end;
+}
+
+/** True if the line starts with the keyword followed by a space */
+static bool is_keyword(const char* p, const char* end, const char* keyword)
+{
+	const size_t length = strlen(keyword);
+	return (size_t)(end - p) > length && memcmp(p, keyword, length) == 0 && is_space(p[length]);
+}
+
+/**
+ * Plain decimal parsing, a few times faster than std::from_chars and strtof,
+ * which dominate the load time otherwise. Rounds the same as fast_obj did
+ */
+static const char* parse_float(const char* p, const char* end, float& value)
+{
+	p = skip_spaces(p, end);
+	double sign = 1.0;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		sign = *p == '-' ? -1.0 : 1.0;
+		p++;
+	}
+
+	double number = 0.0;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		number = number * 10.0 + (double)(*p++ - '0');
+	}
+	if (p < end && *p == '.')
+	{
+		p++;
+		double fraction = 0.0;
+		double divisor = 1.0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			fraction = fraction * 10.0 + (double)(*p++ - '0');
+			divisor *= 10.0;
+		}
+		number += fraction / divisor;
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+		const bool is_negative = p < end && *p == '-';
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			p++;
+		}
+		int exponent = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			exponent = std::min(exponent * 10 + (*p++ - '0'), 400);
+		}
+		number *= pow(10.0, is_negative ? -exponent : exponent);
+	}
+
+	value = (float)(sign * number);
+	return p;
+}
+
+static const char* parse_int(const char* p, const char* end, int& value)
+{
+	const bool is_negative = p < end && *p == '-';
+	if (is_negative)
+	{
+		p++;
+	}
+	value = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		value = value * 10 + (*p++ - '0');
+	}
+	value = is_negative ? -value : value;
+	return p;
+}
+
+/** Rest of the line, without the surrounding spaces */
+static std::string parse_name(const char* p, const char* end)
+{
+	p = skip_spaces(p, end);
+	const char* name_end = p;
+	while (name_end < end && *name_end != '\r' && *name_end != '\n')
+	{
+		name_end++;
+	}
+	while (name_end > p && is_space(name_end[-1]))
+	{
+		name_end--;
+	}
+	return std::string(p, name_end);
+}
+
+static int make_relative(int index, size_t count, uint8 flag, uint8& relative)
+{
+	if (index < 0)
+	{
+		relative |= flag;
+		return (int)count + index;
+	}
+	return index;
+}
+
+static void parse_chunk(ObjChunk& chunk)
+{
+	ZoneScoped; // for tracy
+
+	std::vector<ObjCorner> face;
+	int material = -1;
+
+	for (const char* p = chunk.begin; p < chunk.end; )
+	{
+		const char* line_end = skip_line(p, chunk.end);
+		p = skip_spaces(p, line_end);
+
+		if (is_keyword(p, line_end, "v"))
+		{
+			glm::vec3 position;
+			p = parse_float(p + 1, line_end, position.x);
+			p = parse_float(p, line_end, position.y);
+			parse_float(p, line_end, position.z);
+			chunk.positions.push_back(position);
+		}
+		else if (is_keyword(p, line_end, "vt"))
+		{
+			tex2 texcoord;
+			p = parse_float(p + 2, line_end, texcoord.u);
+			parse_float(p, line_end, texcoord.v);
+			chunk.texcoords.push_back(texcoord);
+		}
+		else if (is_keyword(p, line_end, "vn"))
+		{
+			glm::vec3 normal;
+			p = parse_float(p + 2, line_end, normal.x);
+			p = parse_float(p, line_end, normal.y);
+			parse_float(p, line_end, normal.z);
+			chunk.normals.push_back(normal);
+		}
+		else if (is_keyword(p, line_end, "f"))
+		{
+			face.clear();
+			p = skip_spaces(p + 1, line_end);
+			while (p < line_end && *p != '\r' && *p != '\n')
+			{
+				int v = 0;
+				int t = 0;
+				int n = 0;
+				p = parse_int(p, line_end, v);
+				if (p < line_end && *p == '/')
+				{
+					p++;
+					if (p < line_end && *p != '/')
+					{
+						p = parse_int(p, line_end, t);
+					}
+					if (p < line_end && *p == '/')
+					{
+						p = parse_int(p + 1, line_end, n);
+					}
+				}
+
+				ObjCorner corner = {};
+				corner.position = make_relative(v, chunk.positions.size(), RELATIVE_POSITION, corner.relative);
+				corner.texcoord = make_relative(t, chunk.texcoords.size(), RELATIVE_TEXCOORD, corner.relative);
+				corner.normal = make_relative(n, chunk.normals.size(), RELATIVE_NORMAL, corner.relative);
+				face.push_back(corner);
+
+				// Step over whatever is left of a malformed index
+				while (p < line_end && !is_space(*p) && *p != '\r' && *p != '\n')
+				{
+					p++;
+				}
+				p = skip_spaces(p, line_end);
+			}
+
+			// Split polygons into a fan around their first corner
+			for (size_t i = 2; i < face.size(); i++)
+			{
+				chunk.corners.push_back(face[0]);
+				chunk.corners.push_back(face[i - 1]);
+				chunk.corners.push_back(face[i]);
+				chunk.triangle_materials.push_back(material);
+			}
+		}
+		else if (is_keyword(p, line_end, "usemtl"))
+		{
+			const std::string name = parse_name(p + 6, line_end);
+			const auto it = std::find(chunk.material_names.begin(), chunk.material_names.end(), name);
+			material = (int)std::distance(chunk.material_names.begin(), it);
+			if (it == chunk.material_names.end())
+			{
+				chunk.material_names.push_back(name);
+			}
+			chunk.last_material = material;
+		}
+		else if (is_keyword(p, line_end, "mtllib"))
+		{
+			chunk.libraries.push_back(parse_name(p + 6, line_end));
+		}
+
+		p = line_end;
+	}
+}
+
+/** Adds the materials of a material library, keeping only the texture */
+static void read_material_library(const std::string& path, std::vector<ObjMaterial>& materials)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return;
+	}
+	const std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	const std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+	const char* end = contents.data() + contents.size();
+	for (const char* p = contents.data(); p < end; )
+	{
+		const char* line_end = skip_line(p, end);
+		p = skip_spaces(p, line_end);
+
+		if (is_keyword(p, line_end, "newmtl"))
+		{
+			materials.push_back({ parse_name(p + 6, line_end), "" });
+		}
+		else if (is_keyword(p, line_end, "map_Kd") && !materials.empty())
+		{
+			// Options (-blendu on etc.) aren't supported
+			const std::string name = parse_name(p + 6, line_end);
+			if (!name.empty() && name[0] != '-')
+			{
+				std::string texture_file = directory + name;
+				std::replace(texture_file.begin(), texture_file.end(), '\\', '/');
+				materials.back().texture_file = texture_file;
+			}
+		}
+
+		p = line_end;
+	}
+}
+
+static int get_vertex_index(int index, bool is_relative, int first, size_t count)
+{
+	if (is_relative)
+	{
+		index += first;
+	}
+	// 0 is the default vertex, for missing and broken indices
+	return index > 0 && (size_t)index < count ? index : 0;
+}
+
+bool parse_obj_batches(
+	const char* filename,
+	size_t batch_size,
+	std::vector<ObjMaterial>& materials,
+	const std::function<void(std::vector<Triangle>&, std::vector<int>&)>& batch
+)
+{
+	ZoneScoped; // for tracy
+
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		return false;
+	}
+
+	const std::string directory = std::string(filename).substr(0, std::string(filename).find_last_of("/\\") + 1);
+	std::vector<std::string> libraries;
+	std::unordered_map<std::string, int> material_indices; // a name defined twice refers to its first definition
+	int material = 0;
+
+	// Index 0 of each vertex array is the default for corners without that
+	// attribute. The vertices are the only thing kept from one batch to the
+	// next
+	std::vector<glm::vec3> positions(1, glm::vec3(0.0f));
+	std::vector<tex2> texcoords(1, tex2{ 0.0f, 0.0f });
+	std::vector<glm::vec3> normals(1, glm::vec3(0.0f, 0.0f, 1.0f));
+
+	std::vector<Triangle> triangles;
+	std::vector<int> triangle_materials;
+
+	const char* data = (const char*)file.data;
+	const char* data_end = data + file.size;
+	for (const char* batch_begin = data; batch_begin < data_end; )
+	{
+		// Cut the batch into chunks that start at the beginning of a line
+		const size_t size = std::min(batch_size, (size_t)(data_end - batch_begin));
+		const char* batch_end = size == (size_t)(data_end - batch_begin) ? data_end : skip_line(batch_begin + size - 1, data_end);
+		const size_t batch_bytes = (size_t)(batch_end - batch_begin);
+		const size_t max_chunks = (size_t)omp_get_max_threads() * CHUNKS_PER_THREAD;
+		const size_t num_chunks = std::clamp(batch_bytes / MIN_CHUNK_SIZE, (size_t)1, max_chunks);
+		std::vector<ObjChunk> chunks(num_chunks);
+		const char* chunk_begin = batch_begin;
+		for (size_t i = 0; i < num_chunks; i++)
+		{
+			const char* split = std::max(batch_begin + batch_bytes * (i + 1) / num_chunks, chunk_begin + 1);
+			chunks[i].begin = chunk_begin;
+			chunks[i].end = i + 1 == num_chunks ? batch_end : skip_line(std::min(split, batch_end) - 1, batch_end);
+			chunk_begin = chunks[i].end;
+		}
+		batch_begin = batch_end;
+
+		#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < (int)num_chunks; i++)
+		{
+			parse_chunk(chunks[i]);
+		}
+
+		// The materials of the libraries come first, then the ones only named
+		// by usemtl, in the order they are used
+		for (const ObjChunk& chunk : chunks)
+		{
+			for (const std::string& library : chunk.libraries)
+			{
+				if (std::find(libraries.begin(), libraries.end(), library) == libraries.end())
+				{
+					libraries.push_back(library);
+					const size_t first_material = materials.size();
+					read_material_library(directory + library, materials);
+					for (size_t i = first_material; i < materials.size(); i++)
+					{
+						material_indices.emplace(materials[i].name, (int)i);
+					}
+				}
+			}
+		}
+
+		// Work out where every chunk goes in the merged arrays
+		size_t num_positions = positions.size();
+		size_t num_texcoords = texcoords.size();
+		size_t num_normals = normals.size();
+		size_t num_triangles = 0;
+		for (ObjChunk& chunk : chunks)
+		{
+			chunk.first_position = (int)num_positions;
+			chunk.first_texcoord = (int)num_texcoords;
+			chunk.first_normal = (int)num_normals;
+			chunk.first_triangle = (int)num_triangles;
+			num_positions += chunk.positions.size();
+			num_texcoords += chunk.texcoords.size();
+			num_normals += chunk.normals.size();
+			num_triangles += chunk.triangle_materials.size();
+
+			for (const std::string& name : chunk.material_names)
+			{
+				const auto inserted = material_indices.emplace(name, (int)materials.size());
+				if (inserted.second)
+				{
+					materials.push_back({ name, "" });
+				}
+				chunk.materials.push_back(inserted.first->second);
+			}
+
+			chunk.inherited_material = material;
+			if (chunk.last_material >= 0)
+			{
+				material = chunk.materials[chunk.last_material];
+			}
+		}
+
+		positions.resize(num_positions);
+		texcoords.resize(num_texcoords);
+		normals.resize(num_normals);
+		triangles.assign(num_triangles, Triangle());
+		triangle_materials.assign(num_triangles, -1);
+
+		#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < (int)num_chunks; i++)
+		{
+			const ObjChunk& chunk = chunks[i];
+			std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.first_position);
+			std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), texcoords.begin() + chunk.first_texcoord);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.first_normal);
+		}
+
+		// Every vertex of the batch is in place, any corner can be looked up now
+		#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < (int)num_chunks; i++)
+		{
+			const ObjChunk& chunk = chunks[i];
+			for (size_t j = 0; j < chunk.triangle_materials.size(); j++)
+			{
+				Triangle& triangle = triangles[chunk.first_triangle + j];
+				for (int k = 0; k < 3; k++)
+				{
+					const ObjCorner& corner = chunk.corners[3 * j + k];
+					const int p = get_vertex_index(corner.position, corner.relative & RELATIVE_POSITION, chunk.first_position, num_positions);
+					const int t = get_vertex_index(corner.texcoord, corner.relative & RELATIVE_TEXCOORD, chunk.first_texcoord, num_texcoords);
+					const int n = get_vertex_index(corner.normal, corner.relative & RELATIVE_NORMAL, chunk.first_normal, num_normals);
+					triangle.vertices[k].position = glm::vec4(positions[p], 1.0f);
+					triangle.vertices[k].uv = texcoords[t];
+					triangle.vertices[k].normal = normals[n];
+				}
+
+				const int local_material = chunk.triangle_materials[j];
+				const int triangle_material = local_material >= 0 ? chunk.materials[local_material] : chunk.inherited_material;
+				triangle_materials[chunk.first_triangle + j] = triangle_material < (int)materials.size() ? triangle_material : -1;
+			}
+		}
+
+		batch(triangles, triangle_materials);
+	}
+
+	return true;
+}
+
+bool parse_obj(
+	const char* filename,
+	std::vector<Triangle>& triangles,
+	std::vector<int>& triangle_materials,
+	std::vector<ObjMaterial>& materials
+)
+{
+	// The whole file in one batch
+	triangles.clear();
+	triangle_materials.clear();
+	return parse_obj_batches(
+		filename,
+		SIZE_MAX,
+		materials,
+		[&](std::vector<Triangle>& batch_triangles, std::vector<int>& batch_materials)
+		{
+			triangles.swap(batch_triangles);
+			triangle_materials.swap(batch_materials);
+		}
+	);
+}
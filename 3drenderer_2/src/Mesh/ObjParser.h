@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+struct Triangle;
+
+/** A material of an OBJ file, from its material library or only named by usemtl */
+struct ObjMaterial
+{
+	std::string name;
+	std::string texture_file; // map_Kd next to the material library, empty if none
+};
+
+/**
+ * Reads an OBJ file into a triangle soup, splitting polygons into fans. Only
+ * the vertices of the triangles are filled in. Large files are cut into chunks
+ * at line boundaries that are parsed in parallel and then stitched together in
+ * file order, so the result doesn't depend on the number of threads.
+ * triangle_materials holds the index in materials of every triangle, or -1.
+ * Faces before the first usemtl use the first material, like fast_obj did
+ */
+bool parse_obj(
+	const char* filename,
+	std::vector<Triangle>& triangles,
+	std::vector<int>& triangle_materials,
+	std::vector<ObjMaterial>& materials
+);
+
+/**
+ * Streams the triangles of an OBJ file to batch, about batch_size bytes of the
+ * file at a time, for files too large to hold all their triangles in memory.
+ * Only the vertices are kept from one batch to the next, so a face can only
+ * use the vertices above it, as every exporter writes them. The vectors handed
+ * to batch may be swapped out, the next batch refills them
+ */
+bool parse_obj_batches(
+	const char* filename,
+	size_t batch_size,
+	std::vector<ObjMaterial>& materials,
+	const std::function<void(std::vector<Triangle>& triangles, std::vector<int>& triangle_materials)>& batch
+);
@@ -0,0 +1,595 @@
+#include "Texture.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <vectorclass/vectorclass.h>
+
+#include "TextureCompression.h"
+#include "tex2.h"
+#include "../Utils/TraceRecorder.h"
+
+// Keeps degenerate triangles from dividing by zero
+constexpr float MIN_SCREEN_AREA = 1e-6f;
+
+// Slots in the decoded block cache of each thread. The slot of a block comes
+// from the position of its tile, covering a 16x4 tile area of two mip levels
+constexpr int BLOCK_CACHE_SIZE = 128;
+
+/**
+ * Recently decoded blocks of compressed textures. Neighbouring pixels mostly
+ * fetch from the same few blocks, so each block is decoded once and then
+ * read back from here
+ */
+struct DecodedBlockCache
+{
+	uint64 tags[BLOCK_CACHE_SIZE] = {}; // block each slot was decoded from, see get_block_tag()
+	uint32 texels[BLOCK_CACHE_SIZE][TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE];
+};
+
+static thread_local DecodedBlockCache block_cache;
+
+// Ids start at 1, so no block matches the empty slots
+static std::atomic<uint32> last_texture_id{ 0 };
+
+uint32 virtual_texture_frame = 1;
+
+/** The texture id, the level (4 bits) and the tile (32 bits) of a block */
+static inline uint64 get_block_tag(const Texture& texture, int level_index, int tile)
+{
+	return ((uint64)texture.id << 36) | ((uint64)level_index << 32) | (uint32)tile;
+}
+
+Texture::Texture()
+	: id(last_texture_id.fetch_add(1, std::memory_order_relaxed) + 1)
+{
+}
+
+Texture::~Texture()
+{
+	if (owns_page_file)
+	{
+		std::error_code error;
+		std::filesystem::remove(page_file, error);
+	}
+}
+
+/** Image with rows in bottom to top order, one texel after the other */
+struct LinearImage
+{
+	std::vector<uint32> pixels;
+	int width;
+	int height;
+};
+
+static int next_power_of_two(int n)
+{
+	int result = 1;
+	while (result < n)
+	{
+		result <<= 1;
+	}
+	return result;
+}
+
+/** Bilinear resampling with the edges clamped */
+static LinearImage resample(const LinearImage& src, int width, int height)
+{
+	LinearImage dst;
+	dst.width = width;
+	dst.height = height;
+	dst.pixels.resize((size_t)width * height);
+
+	const float scale_x = (float)src.width / (float)width;
+	const float scale_y = (float)src.height / (float)height;
+	for (int y = 0; y < height; y++)
+	{
+		const float sy = std::max(((float)y + 0.5f) * scale_y - 0.5f, 0.0f);
+		const int y0 = std::min((int)sy, src.height - 1);
+		const int y1 = std::min(y0 + 1, src.height - 1);
+		const float fy = sy - (float)y0;
+		for (int x = 0; x < width; x++)
+		{
+			const float sx = std::max(((float)x + 0.5f) * scale_x - 0.5f, 0.0f);
+			const int x0 = std::min((int)sx, src.width - 1);
+			const int x1 = std::min(x0 + 1, src.width - 1);
+			const float fx = sx - (float)x0;
+
+			const uint32 c00 = src.pixels[(size_t)y0 * src.width + x0];
+			const uint32 c10 = src.pixels[(size_t)y0 * src.width + x1];
+			const uint32 c01 = src.pixels[(size_t)y1 * src.width + x0];
+			const uint32 c11 = src.pixels[(size_t)y1 * src.width + x1];
+
+			uint32 out = 0;
+			for (int shift = 0; shift < 32; shift += 8)
+			{
+				const float top = (float)((c00 >> shift) & 0xFF) * (1.0f - fx) + (float)((c10 >> shift) & 0xFF) * fx;
+				const float bottom = (float)((c01 >> shift) & 0xFF) * (1.0f - fx) + (float)((c11 >> shift) & 0xFF) * fx;
+				const float channel = top * (1.0f - fy) + bottom * fy;
+				out |= (uint32)(channel + 0.5f) << shift;
+			}
+			dst.pixels[(size_t)y * width + x] = out;
+		}
+	}
+	return dst;
+}
+
+/** Averages each 2x2 block of texels */
+static LinearImage downsample(const LinearImage& src)
+{
+	LinearImage dst;
+	dst.width = std::max(src.width / 2, 1);
+	dst.height = std::max(src.height / 2, 1);
+	dst.pixels.resize((size_t)dst.width * dst.height);
+
+	for (int y = 0; y < dst.height; y++)
+	{
+		const int y0 = std::min(y * 2, src.height - 1);
+		const int y1 = std::min(y * 2 + 1, src.height - 1);
+		const uint32* row0 = &src.pixels[(size_t)y0 * src.width];
+		const uint32* row1 = &src.pixels[(size_t)y1 * src.width];
+		for (int x = 0; x < dst.width; x++)
+		{
+			const int x0 = std::min(x * 2, src.width - 1);
+			const int x1 = std::min(x * 2 + 1, src.width - 1);
+			const uint32 texels[4] = { row0[x0], row0[x1], row1[x0], row1[x1] };
+
+			uint32 out = 0;
+			for (int shift = 0; shift < 32; shift += 8)
+			{
+				uint32 sum = 2; // round to nearest
+				for (const uint32 texel : texels)
+				{
+					sum += (texel >> shift) & 0xFF;
+				}
+				out |= (sum >> 2) << shift;
+			}
+			dst.pixels[(size_t)y * dst.width + x] = out;
+		}
+	}
+	return dst;
+}
+
+void set_level_size(MipLevel& level, int width, int height)
+{
+	level.width = width;
+	level.height = height;
+	level.width_mask = width - 1;
+	level.height_mask = height - 1;
+	level.tiles_per_row = std::max(width >> TEXTURE_TILE_SHIFT, 1);
+}
+
+static MipLevel describe_level(const LinearImage& image)
+{
+	MipLevel level;
+	set_level_size(level, image.width, image.height);
+	return level;
+}
+
+static MipLevel tile_level(const LinearImage& image)
+{
+	MipLevel level = describe_level(image);
+
+	const int tile_rows = std::max(image.height >> TEXTURE_TILE_SHIFT, 1);
+	const size_t num_texels = (size_t)level.tiles_per_row * tile_rows * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE;
+	level.storage = std::make_unique<uint8[]>(num_texels * sizeof(uint32));
+	uint32* pixels = (uint32*)level.storage.get();
+
+	for (int y = 0; y < image.height; y++)
+	{
+		for (int x = 0; x < image.width; x++)
+		{
+			pixels[texel_index(level, x, y)] = image.pixels[(size_t)y * image.width + x];
+		}
+	}
+	level.pixels = pixels;
+	return level;
+}
+
+/** Appends the pages of a level to the page file, one row of pages after the other */
+static bool write_virtual_level(const LinearImage& image, std::ofstream& file, MipLevel& level)
+{
+	level.pages_per_row = image.width >> VIRTUAL_PAGE_SHIFT;
+	level.file_offset = (size_t)file.tellp();
+
+	const int page_rows = image.height >> VIRTUAL_PAGE_SHIFT;
+	std::vector<uint32> page(VIRTUAL_PAGE_TEXELS);
+	for (int page_y = 0; page_y < page_rows; page_y++)
+	{
+		for (int page_x = 0; page_x < level.pages_per_row; page_x++)
+		{
+			for (int y = 0; y < VIRTUAL_PAGE_SIZE; y++)
+			{
+				const size_t row = (size_t)(page_y * VIRTUAL_PAGE_SIZE + y) * image.width;
+				for (int x = 0; x < VIRTUAL_PAGE_SIZE; x++)
+				{
+					page[page_texel_index(x, y)] = image.pixels[row + page_x * VIRTUAL_PAGE_SIZE + x];
+				}
+			}
+			file.write((const char*)page.data(), VIRTUAL_PAGE_TEXELS * sizeof(uint32));
+		}
+	}
+
+	if (!file)
+	{
+		return false;
+	}
+	level.pages = std::make_unique<VirtualPage[]>((size_t)level.pages_per_row * page_rows);
+	return true;
+}
+
+/** A file in the temp directory no other texture or process uses */
+static std::string make_page_file_name()
+{
+	static std::atomic<uint32> counter = 0;
+	const uint64 stamp = (uint64)std::chrono::steady_clock::now().time_since_epoch().count();
+	const std::string name = "texture_pages_" + std::to_string(stamp) + "_" + std::to_string(counter++) + ".bin";
+
+	std::error_code error;
+	const std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+	return (directory / name).string();
+}
+
+static int get_block_size(ETextureFormat format)
+{
+	return format == TEXTURE_FORMAT_BC1 ? BC1_BLOCK_SIZE : BC3_BLOCK_SIZE;
+}
+
+/** Replaces the texels of a tiled level with one block per tile */
+static void compress_level(MipLevel& level, ETextureFormat format)
+{
+	const int tile_rows = std::max(level.height >> TEXTURE_TILE_SHIFT, 1);
+	const int num_tiles = level.tiles_per_row * tile_rows;
+	const int block_size = get_block_size(format);
+	std::unique_ptr<uint8[]> blocks = std::make_unique<uint8[]>((size_t)num_tiles * block_size);
+
+	for (int tile = 0; tile < num_tiles; tile++)
+	{
+		const uint32* tile_texels = &level.pixels[(size_t)tile * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE];
+
+		// Levels smaller than a tile repeat their texels over the padding, so
+		// it doesn't drag the endpoints of the block towards black
+		uint32 texels[TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE];
+		const int used_width = std::min(level.width, TEXTURE_TILE_SIZE);
+		const int used_height = std::min(level.height, TEXTURE_TILE_SIZE);
+		for (int y = 0; y < TEXTURE_TILE_SIZE; y++)
+		{
+			for (int x = 0; x < TEXTURE_TILE_SIZE; x++)
+			{
+				texels[y * TEXTURE_TILE_SIZE + x] = tile_texels[(y % used_height) * TEXTURE_TILE_SIZE + x % used_width];
+			}
+		}
+
+		uint8* block = &blocks[(size_t)tile * block_size];
+		if (format == TEXTURE_FORMAT_BC1)
+		{
+			encode_bc1_block(texels, block);
+		}
+		else
+		{
+			encode_bc3_block(texels, block);
+		}
+	}
+
+	level.storage = std::move(blocks);
+	level.pixels = nullptr;
+	level.blocks = level.storage.get();
+}
+
+size_t get_level_data_size(const MipLevel& level, ETextureFormat format)
+{
+	const int tile_rows = std::max(level.height >> TEXTURE_TILE_SHIFT, 1);
+	const size_t num_tiles = (size_t)level.tiles_per_row * tile_rows;
+	if (format == TEXTURE_FORMAT_ARGB8888)
+	{
+		return num_tiles * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE * sizeof(uint32);
+	}
+	return num_tiles * get_block_size(format);
+}
+
+std::shared_ptr<Texture> create_texture(
+	const uint32* pixels,
+	const int width,
+	const int height,
+	const int pitch,
+	const TextureLoadOptions& options
+)
+{
+	ZoneScoped; // for tracy
+
+	// Flip the image so that row 0 is at v = 0
+	LinearImage image;
+	image.width = width;
+	image.height = height;
+	image.pixels.resize((size_t)width * height);
+	for (int y = 0; y < height; y++)
+	{
+		const uint32* src_row = (const uint32*)((const uint8*)pixels + (size_t)pitch * (height - y - 1));
+		std::copy(src_row, src_row + width, &image.pixels[(size_t)y * width]);
+	}
+
+	const int pot_width = next_power_of_two(width);
+	const int pot_height = next_power_of_two(height);
+	if (pot_width != width || pot_height != height)
+	{
+		image = resample(image, pot_width, pot_height);
+	}
+
+	std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+	texture->format = options.format;
+	texture->width = image.width;
+	texture->height = image.height;
+	texture->memory_size = 0;
+
+	std::ofstream page_file;
+	if (options.virtual_texture)
+	{
+		texture->page_file = make_page_file_name();
+		page_file.open(texture->page_file, std::ios::binary | std::ios::trunc);
+		if (!page_file)
+		{
+			std::cerr << "Failed to create the page file " << texture->page_file << ".\n";
+			texture->page_file.clear();
+		}
+		texture->owns_page_file = page_file.is_open();
+	}
+
+	// Mipmap the linear images, and only tile them once they are done
+	while (true)
+	{
+		// The levels big enough to be split into pages come first, so the
+		// virtual levels always sit at the start of the chain
+		const bool is_virtual = page_file.is_open()
+								&& texture->num_virtual_levels == (int)texture->mips.size()
+								&& image.width >= VIRTUAL_PAGE_SIZE
+								&& image.height >= VIRTUAL_PAGE_SIZE;
+		MipLevel level = describe_level(image);
+		if (is_virtual && write_virtual_level(image, page_file, level))
+		{
+			texture->num_virtual_levels++;
+		}
+		else
+		{
+			if (is_virtual)
+			{
+				std::cerr << "Failed to write the page file " << texture->page_file << ".\n";
+				page_file.close();
+			}
+			level = tile_level(image);
+			if (options.format != TEXTURE_FORMAT_ARGB8888)
+			{
+				compress_level(level, options.format);
+			}
+			texture->memory_size += get_level_data_size(level, options.format);
+		}
+		texture->mips.push_back(std::move(level));
+
+		if (image.width == 1 && image.height == 1)
+		{
+			break;
+		}
+		image = downsample(image);
+	}
+
+	return texture;
+}
+
+float compute_texture_lod(
+	const Texture& texture,
+	const tex2& uv0,
+	const tex2& uv1,
+	const tex2& uv2,
+	const float screen_area2
+)
+{
+	// Twice the area of the triangle in texels
+	const float du1 = (uv1.u - uv0.u) * (float)texture.width;
+	const float dv1 = (uv1.v - uv0.v) * (float)texture.height;
+	const float du2 = (uv2.u - uv0.u) * (float)texture.width;
+	const float dv2 = (uv2.v - uv0.v) * (float)texture.height;
+	const float texel_area2 = fabsf(du1 * dv2 - du2 * dv1);
+
+	// Every level down divides the area by four, hence the 0.5 factor
+	const float ratio = texel_area2 / std::max(fabsf(screen_area2), MIN_SCREEN_AREA);
+	const float lod = 0.5f * log2f(std::max(ratio, 1.0f));
+	return lod;
+}
+
+/**
+ * Stamps the pages under a bilinear footprint (two texels wide and high at
+ * most) as wanted this frame. Returns true if all of them are resident
+ */
+static inline bool touch_pages(const MipLevel& level, int x0, int y0, int x1, int y1)
+{
+	const int page_x[2] = { x0 >> VIRTUAL_PAGE_SHIFT, x1 >> VIRTUAL_PAGE_SHIFT };
+	const int page_y[2] = { y0 >> VIRTUAL_PAGE_SHIFT, y1 >> VIRTUAL_PAGE_SHIFT };
+	const int num_x = page_x[0] == page_x[1] ? 1 : 2;
+	const int num_y = page_y[0] == page_y[1] ? 1 : 2;
+
+	bool is_resident = true;
+	for (int j = 0; j < num_y; j++)
+	{
+		for (int i = 0; i < num_x; i++)
+		{
+			VirtualPage& page = level.pages[page_y[j] * level.pages_per_row + page_x[i]];
+			// Only write when the stamp changes so the threads don't keep
+			// stealing the cache line from each other
+			if (page.last_used.load(std::memory_order_relaxed) != virtual_texture_frame)
+			{
+				page.last_used.store(virtual_texture_frame, std::memory_order_relaxed);
+			}
+			is_resident &= page.texels != nullptr;
+		}
+	}
+	return is_resident;
+}
+
+static inline uint32 fetch_texel(const Texture& texture, int level_index, int x, int y)
+{
+	const MipLevel& level = texture.mips[level_index];
+	if (level_index < texture.num_virtual_levels)
+	{
+		const VirtualPage& page = level.pages[(y >> VIRTUAL_PAGE_SHIFT) * level.pages_per_row + (x >> VIRTUAL_PAGE_SHIFT)];
+		return page.texels[page_texel_index(x, y)];
+	}
+
+	const int index = texel_index(level, x, y);
+	if (texture.format == TEXTURE_FORMAT_ARGB8888)
+	{
+		return level.pixels[index];
+	}
+
+	// Decode the block on a cache miss
+	const int tile = index >> (2 * TEXTURE_TILE_SHIFT);
+	const uint64 tag = get_block_tag(texture, level_index, tile);
+	const int slot = ((x >> TEXTURE_TILE_SHIFT) & 15)
+					| (((y >> TEXTURE_TILE_SHIFT) & 3) << 4)
+					| ((level_index & 1) << 6);
+	if (block_cache.tags[slot] != tag)
+	{
+		const uint8* block = &level.blocks[(size_t)tile * get_block_size(texture.format)];
+		if (texture.format == TEXTURE_FORMAT_BC1)
+		{
+			decode_bc1_block(block, block_cache.texels[slot]);
+		}
+		else
+		{
+			decode_bc3_block(block, block_cache.texels[slot]);
+		}
+		block_cache.tags[slot] = tag;
+	}
+	return block_cache.texels[slot][index & (TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE - 1)];
+}
+
+static inline uint32 fetch_point(const Texture& texture, int level_index, float u, float v)
+{
+	int x, y;
+	while (true)
+	{
+		const MipLevel& level = texture.mips[level_index];
+		x = (int)floorf(u * (float)level.width) & level.width_mask;
+		y = (int)floorf(v * (float)level.height) & level.height_mask;
+
+		// Fall back to coarser levels until one has the page resident
+		if (level_index >= texture.num_virtual_levels || touch_pages(level, x, y, x, y))
+		{
+			break;
+		}
+		level_index++;
+	}
+	return fetch_texel(texture, level_index, x, y);
+}
+
+/** The four channels (b, g, r, a) of the filtered color, in 0-255 */
+static inline Vec4f fetch_bilinear(const Texture& texture, int level_index, float u, float v)
+{
+	float fx, fy;
+	int x0, x1, y0, y1;
+	while (true)
+	{
+		const MipLevel& level = texture.mips[level_index];
+
+		// Texel centers sit at half integer coordinates
+		const float x = u * (float)level.width - 0.5f;
+		const float y = v * (float)level.height - 0.5f;
+		const float x_floor = floorf(x);
+		const float y_floor = floorf(y);
+		fx = x - x_floor;
+		fy = y - y_floor;
+
+		x0 = (int)x_floor & level.width_mask;
+		x1 = (x0 + 1) & level.width_mask;
+		y0 = (int)y_floor & level.height_mask;
+		y1 = (y0 + 1) & level.height_mask;
+
+		// Fall back to coarser levels until one has the pages resident
+		if (level_index >= texture.num_virtual_levels || touch_pages(level, x0, y0, x1, y1))
+		{
+			break;
+		}
+		level_index++;
+	}
+
+	// Widen the bytes of all four texels to floats, two texels per register
+	const Vec16uc bytes = Vec16uc(Vec4ui(
+		fetch_texel(texture, level_index, x0, y0),
+		fetch_texel(texture, level_index, x1, y0),
+		fetch_texel(texture, level_index, x0, y1),
+		fetch_texel(texture, level_index, x1, y1)
+	));
+	const Vec8f bottom = to_float(Vec8i(extend(extend_low(bytes)))); // (x0, y0), (x1, y0)
+	const Vec8f top = to_float(Vec8i(extend(extend_high(bytes)))); // (x0, y1), (x1, y1)
+
+	// Blend vertically, then horizontally
+	const Vec8f column = bottom + (top - bottom) * fy;
+	const Vec4f left = column.get_low();
+	const Vec4f right = column.get_high();
+	return left + (right - left) * fx;
+}
+
+static inline uint32 pack_color(const Vec4f& channels)
+{
+	const Vec4i rounded = roundi(channels);
+	const Vec8s words = compress(rounded, rounded);
+	const Vec16c bytes = compress(words, words);
+	return Vec4ui(bytes).extract(0);
+}
+
+uint32 sample_texture(
+	const Texture& texture,
+	const float u,
+	const float v,
+	const float lod,
+	const ETextureFilter filter
+)
+{
+	const int max_level = (int)texture.mips.size() - 1;
+
+	switch (filter)
+	{
+		case FILTER_POINT:
+		{
+			const int level = std::min((int)(lod + 0.5f), max_level);
+			return fetch_point(texture, level, u, v);
+		}
+		case FILTER_BILINEAR:
+		{
+			const int level = std::min((int)(lod + 0.5f), max_level);
+			return pack_color(fetch_bilinear(texture, level, u, v));
+		}
+		case FILTER_TRILINEAR:
+		default:
+		{
+			const int level = std::min((int)lod, max_level);
+			const Vec4f fine = fetch_bilinear(texture, level, u, v);
+			if (level == max_level)
+			{
+				return pack_color(fine);
+			}
+			const Vec4f coarse = fetch_bilinear(texture, level + 1, u, v);
+			const float t = lod - (float)level;
+			return pack_color(fine + (coarse - fine) * t);
+		}
+	}
+}
+
+int get_texels_per_sample(const Texture& texture, const float lod, const ETextureFilter filter)
+{
+	switch (filter)
+	{
+		case FILTER_POINT:
+			return 1;
+		case FILTER_BILINEAR:
+			return 4;
+		case FILTER_TRILINEAR:
+		default:
+			// Two levels, unless the coarsest one is picked
+			return (int)lod >= (int)texture.mips.size() - 1 ? 4 : 8;
+	}
+}
@@ -1,11 +1,181 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <memory>
+#include <string>
+#include <vector>
+
+#include "../Renderer/TextureFilter.h"
 #include "../Utils/3d_types.h"
 
-struct Texture
+struct MappedFile;
+struct tex2;
+
+// Texels are stored in square tiles of TEXTURE_TILE_SIZE x TEXTURE_TILE_SIZE,
+// so a 4x4 tile of 32 bit texels fills exactly one 64 byte cache line
+constexpr int TEXTURE_TILE_SHIFT = 2;
+constexpr int TEXTURE_TILE_SIZE = 1 << TEXTURE_TILE_SHIFT;
+
+// Virtual textures stream their larger levels in pages of VIRTUAL_PAGE_SIZE x
+// VIRTUAL_PAGE_SIZE texels. Levels smaller than a page are always resident
+constexpr int VIRTUAL_PAGE_SHIFT = 7;
+constexpr int VIRTUAL_PAGE_SIZE = 1 << VIRTUAL_PAGE_SHIFT;
+constexpr int VIRTUAL_PAGE_TEXELS = VIRTUAL_PAGE_SIZE * VIRTUAL_PAGE_SIZE;
+
+/**
+ * Frame number the rasterizer stamps on the virtual pages it samples. Only
+ * advanced between frames, by VirtualTextureCache::update()
+ */
+extern uint32 virtual_texture_frame;
+
+/** How the texels are held in memory */
+enum ETextureFormat
+{
+	TEXTURE_FORMAT_ARGB8888, // 32 bits per texel
+	TEXTURE_FORMAT_BC1, // 4 bits per texel, alpha is dropped
+	TEXTURE_FORMAT_BC3, // 8 bits per texel
+};
+
+/** Decides how an image gets turned into a texture */
+struct TextureLoadOptions
 {
-	std::unique_ptr<uint32[]> pixels;
+	/**
+	 * Compressed formats use a fraction of the memory, at the cost of some
+	 * color precision and of decoding blocks while rasterizing
+	 */
+	ETextureFormat format = TEXTURE_FORMAT_ARGB8888;
+
+	/**
+	 * Moves the levels that span at least one page out to a page file on disk
+	 * and only keeps the pages that get sampled in memory, as uncompressed
+	 * ARGB8888. The texture has to be added to a VirtualTextureCache
+	 */
+	bool virtual_texture = false;
+};
+
+/** One page of a virtual level, see VirtualTextureCache */
+struct VirtualPage
+{
+	const uint32* texels = nullptr; // null while the page isn't resident
+	std::atomic<uint32> last_used = 0; // last frame the rasterizer wanted it
+
+	// Only touched by the cache, between frames
+	int slot = -1;
+	bool requested = false;
+	bool failed = false; // reading the page file went wrong, don't retry
+};
+
+/**
+ * One level of the mip chain. The width and height are powers of two so that
+ * texture coordinates wrap with a mask. Row 0 is the bottom of the image (v =
+ * 0), which is the order texture coordinates are given in. The texels are laid
+ * out tile by tile, see texel_index(). In the compressed formats each tile is
+ * stored as one block instead. The texels either live in storage or in the
+ * mapped cache file of the texture
+ */
+struct MipLevel
+{
+	std::unique_ptr<uint8[]> storage;
+	const uint32* pixels = nullptr; // TEXTURE_FORMAT_ARGB8888 only
+	const uint8* blocks = nullptr; // compressed formats only
 	int width;
 	int height;
-};
\ No newline at end of file
+	int width_mask; // width - 1
+	int height_mask; // height - 1
+	int tiles_per_row; // levels narrower than a tile still take up a full one
+
+	// Virtual levels only, the texels live in pages instead
+	std::unique_ptr<VirtualPage[]> pages;
+	int pages_per_row = 0;
+	size_t file_offset = 0; // of the first page in the page file
+};
+
+/**
+ * Level 0 is the full resolution image. Every following level is half the size
+ * of the previous one, down to a single texel
+ */
+struct Texture
+{
+	Texture();
+	~Texture();
+
+	// Unique to each texture ever created. Decoded blocks are cached by it
+	// rather than by address, which a later texture can get again
+	uint32 id;
+
+	std::vector<MipLevel> mips;
+	ETextureFormat format;
+	int width; // of level 0
+	int height;
+	size_t memory_size; // bytes taken up by all resident levels
+
+	// Levels below num_virtual_levels are paged from page_file
+	int num_virtual_levels = 0;
+	std::string page_file;
+	bool owns_page_file = false; // deleted along with the texture
+
+	// Cache file the levels were loaded from, if any
+	std::shared_ptr<MappedFile> mapping;
+};
+
+/** Position of texel (x, y) of a level in its pixels array */
+inline int texel_index(const MipLevel& level, int x, int y)
+{
+	const int tile = (y >> TEXTURE_TILE_SHIFT) * level.tiles_per_row + (x >> TEXTURE_TILE_SHIFT);
+	const int offset = ((y & (TEXTURE_TILE_SIZE - 1)) << TEXTURE_TILE_SHIFT) | (x & (TEXTURE_TILE_SIZE - 1));
+	return (tile << (2 * TEXTURE_TILE_SHIFT)) | offset;
+}
+
+/** Position of texel (x, y) inside the page that holds it */
+inline int page_texel_index(int x, int y)
+{
+	constexpr int PAGE_MASK = VIRTUAL_PAGE_SIZE - 1;
+	constexpr int TILES_PER_PAGE_ROW = VIRTUAL_PAGE_SIZE >> TEXTURE_TILE_SHIFT;
+	x &= PAGE_MASK;
+	y &= PAGE_MASK;
+	const int tile = (y >> TEXTURE_TILE_SHIFT) * TILES_PER_PAGE_ROW + (x >> TEXTURE_TILE_SHIFT);
+	const int offset = ((y & (TEXTURE_TILE_SIZE - 1)) << TEXTURE_TILE_SHIFT) | (x & (TEXTURE_TILE_SIZE - 1));
+	return (tile << (2 * TEXTURE_TILE_SHIFT)) | offset;
+}
+
+/**
+ * Builds a texture from an image given top row first, the way image files
+ * store them. The image is resampled to power of two dimensions if needed,
+ * then flipped, mipmapped, tiled and compressed
+ */
+std::shared_ptr<Texture> create_texture(
+	const uint32* pixels,
+	int width,
+	int height,
+	int pitch,
+	const TextureLoadOptions& options = TextureLoadOptions()
+);
+
+/** Bytes of texel data of a level that isn't virtual */
+size_t get_level_data_size(const MipLevel& level, ETextureFormat format);
+/** Sets the size of a power of two level and the masks and tiling derived from it */
+void set_level_size(MipLevel& level, int width, int height);
+
+/**
+ * Mip level (fractional) that maps one texel to about one pixel, from the ratio
+ * between the area the triangle covers in the texture and on the screen
+ */
+float compute_texture_lod(
+	const Texture& texture,
+	const tex2& uv0,
+	const tex2& uv1,
+	const tex2& uv2,
+	float screen_area2
+);
+
+/** Texture coordinates wrap around, lod is clamped to the available levels */
+uint32 sample_texture(
+	const Texture& texture,
+	float u,
+	float v,
+	float lod,
+	ETextureFilter filter
+);
+/** Texels a single sample_texture() call reads at this lod */
+int get_texels_per_sample(const Texture& texture, float lod, ETextureFilter filter);
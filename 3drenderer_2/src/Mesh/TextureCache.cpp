@@ -0,0 +1,124 @@
+#include "TextureCache.h"
+
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "Mesh.h"
+#include "../Utils/TraceRecorder.h"
+
+struct TextureCacheEntry
+{
+	std::weak_ptr<Texture> texture;
+	/**
+	 * Set while the image is being decoded. Other threads asking for the same
+	 * key wait on it instead of decoding the image a second time
+	 */
+	std::shared_ptr<std::once_flag> loading;
+};
+
+static std::mutex cache_mutex;
+static std::unordered_map<std::string, TextureCacheEntry> cache_entries;
+static int num_hits = 0;
+static int num_misses = 0;
+
+/** Different spellings of the same path map to the same key */
+static std::string make_cache_key(const char* filename, const TextureLoadOptions& options)
+{
+	std::error_code error;
+	std::filesystem::path path = std::filesystem::weakly_canonical(filename, error);
+	if (error)
+	{
+		path = std::filesystem::absolute(filename, error).lexically_normal();
+	}
+
+	std::string key = path.generic_string();
+	key += "|format=" + std::to_string((int)options.format);
+	key += options.virtual_texture ? "|virtual" : "";
+	return key;
+}
+
+std::shared_ptr<Texture> get_texture(const char* filename, const TextureLoadOptions& options)
+{
+	ZoneScoped; // for tracy
+
+	const std::string key = make_cache_key(filename, options);
+
+	std::shared_ptr<std::once_flag> loading;
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		TextureCacheEntry& entry = cache_entries[key];
+		if (std::shared_ptr<Texture> texture = entry.texture.lock())
+		{
+			num_hits++;
+			return texture;
+		}
+		if (!entry.loading)
+		{
+			entry.loading = std::make_shared<std::once_flag>();
+		}
+		loading = entry.loading;
+	}
+
+	// Decode outside of the lock so different images load in parallel
+	std::shared_ptr<Texture> texture;
+	bool is_decoder = false;
+	std::call_once(*loading, [&]
+	{
+		is_decoder = true;
+		texture = load_texture(filename, options);
+
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		TextureCacheEntry& entry = cache_entries[key];
+		entry.texture = texture;
+		entry.loading.reset();
+		num_misses++;
+	});
+	if (is_decoder)
+	{
+		return texture;
+	}
+
+	// Some other thread did the decoding
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex);
+		texture = cache_entries[key].texture.lock();
+		if (texture)
+		{
+			num_hits++;
+			return texture;
+		}
+	}
+
+	// The decode failed, or the texture was already freed again. Try once more
+	// ourselves
+	return get_texture(filename, options);
+}
+
+TextureCacheStats get_texture_cache_stats()
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	TextureCacheStats stats;
+	stats.num_hits = num_hits;
+	stats.num_misses = num_misses;
+
+	// Forget the textures nobody holds on to anymore
+	for (auto it = cache_entries.begin(); it != cache_entries.end();)
+	{
+		const std::shared_ptr<Texture> texture = it->second.texture.lock();
+		if (!texture && !it->second.loading)
+		{
+			it = cache_entries.erase(it);
+			continue;
+		}
+		if (texture)
+		{
+			stats.num_textures++;
+			stats.memory_size += texture->memory_size;
+		}
+		++it;
+	}
+	return stats;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "Texture.h"
+
+struct TextureCacheStats
+{
+	int num_textures = 0; // alive right now
+	size_t memory_size = 0; // resident bytes of those textures
+	int num_hits = 0; // requests served without decoding, since the start
+	int num_misses = 0; // images decoded
+};
+
+/**
+ * Process wide cache of the textures loaded from image files, keyed by the
+ * canonical path of the file and the load options. Every mesh asking for the
+ * same image with the same options gets the same Texture, so each image is
+ * decoded once. The cache only holds weak references: a texture is freed as
+ * soon as the last mesh using it is, and loading it again decodes it again.
+ * Safe to call from several threads at once
+ */
+std::shared_ptr<Texture> get_texture(
+	const char* filename,
+	const TextureLoadOptions& options = TextureLoadOptions()
+);
+
+TextureCacheStats get_texture_cache_stats();
@@ -0,0 +1,276 @@
+#include "TextureCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// Iterations used to find the main axis of the colors in a block
+constexpr int POWER_ITERATIONS = 4;
+
+static inline uint16 pack_565(float r, float g, float b)
+{
+	const uint32 r5 = (uint32)std::clamp(r * (31.0f / 255.0f) + 0.5f, 0.0f, 31.0f);
+	const uint32 g6 = (uint32)std::clamp(g * (63.0f / 255.0f) + 0.5f, 0.0f, 63.0f);
+	const uint32 b5 = (uint32)std::clamp(b * (31.0f / 255.0f) + 0.5f, 0.0f, 31.0f);
+	return (uint16)((r5 << 11) | (g6 << 5) | b5);
+}
+
+static inline uint32 unpack_565(uint16 color)
+{
+	const uint32 r5 = (color >> 11) & 0x1F;
+	const uint32 g6 = (color >> 5) & 0x3F;
+	const uint32 b5 = color & 0x1F;
+	// Replicate the top bits into the bottom ones so 31 maps to 255
+	const uint32 r = (r5 << 3) | (r5 >> 2);
+	const uint32 g = (g6 << 2) | (g6 >> 4);
+	const uint32 b = (b5 << 3) | (b5 >> 2);
+	return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+/** a + (b - a) * weight / 3 for every channel */
+static inline uint32 lerp_thirds(uint32 a, uint32 b, uint32 weight)
+{
+	uint32 out = 0xFF000000;
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		const uint32 ca = (a >> shift) & 0xFF;
+		const uint32 cb = (b >> shift) & 0xFF;
+		out |= ((ca * (3 - weight) + cb * weight) / 3) << shift;
+	}
+	return out;
+}
+
+/** The four colors a BC1 block can pick from */
+static inline void bc1_palette(uint16 color0, uint16 color1, uint32* palette)
+{
+	palette[0] = unpack_565(color0);
+	palette[1] = unpack_565(color1);
+	if (color0 > color1)
+	{
+		palette[2] = lerp_thirds(palette[0], palette[1], 1);
+		palette[3] = lerp_thirds(palette[0], palette[1], 2);
+	}
+	else
+	{
+		// Three color mode, only written by other encoders
+		uint32 half = 0xFF000000;
+		for (int shift = 0; shift < 24; shift += 8)
+		{
+			half |= ((((palette[0] >> shift) & 0xFF) + ((palette[1] >> shift) & 0xFF)) / 2) << shift;
+		}
+		palette[2] = half;
+		palette[3] = 0x00000000;
+	}
+}
+
+static inline int color_distance(uint32 a, uint32 b)
+{
+	const int dr = (int)((a >> 16) & 0xFF) - (int)((b >> 16) & 0xFF);
+	const int dg = (int)((a >> 8) & 0xFF) - (int)((b >> 8) & 0xFF);
+	const int db = (int)(a & 0xFF) - (int)(b & 0xFF);
+	return dr * dr + dg * dg + db * db;
+}
+
+static void encode_color_block(const uint32* texels, uint8* block)
+{
+	// Fit a line through the colors: start at their mean and point along the
+	// direction they are spread out the most
+	float colors[16][3];
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		colors[i][0] = (float)((texels[i] >> 16) & 0xFF);
+		colors[i][1] = (float)((texels[i] >> 8) & 0xFF);
+		colors[i][2] = (float)(texels[i] & 0xFF);
+		for (int c = 0; c < 3; c++)
+		{
+			mean[c] += colors[i][c] * (1.0f / 16.0f);
+		}
+	}
+
+	float covariance[3][3] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			for (int b = 0; b < 3; b++)
+			{
+				covariance[a][b] += (colors[i][a] - mean[a]) * (colors[i][b] - mean[b]);
+			}
+		}
+	}
+
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < POWER_ITERATIONS; iteration++)
+	{
+		float next[3];
+		for (int a = 0; a < 3; a++)
+		{
+			next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+		}
+		const float length = std::max({ fabsf(next[0]), fabsf(next[1]), fabsf(next[2]) });
+		if (length <= 0.0f)
+		{
+			break;
+		}
+		for (int a = 0; a < 3; a++)
+		{
+			axis[a] = next[a] / length;
+		}
+	}
+
+	// The texels furthest along the axis in both directions become the endpoints
+	float min_t = 0.0f;
+	float max_t = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		const float t = (colors[i][0] - mean[0]) * axis[0]
+						+ (colors[i][1] - mean[1]) * axis[1]
+						+ (colors[i][2] - mean[2]) * axis[2];
+		min_t = std::min(min_t, t);
+		max_t = std::max(max_t, t);
+	}
+	const float axis_length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	min_t /= axis_length2;
+	max_t /= axis_length2;
+
+	uint16 color0 = pack_565(mean[0] + axis[0] * max_t, mean[1] + axis[1] * max_t, mean[2] + axis[2] * max_t);
+	uint16 color1 = pack_565(mean[0] + axis[0] * min_t, mean[1] + axis[1] * min_t, mean[2] + axis[2] * min_t);
+
+	// The four color mode needs color0 > color1
+	if (color0 < color1)
+	{
+		std::swap(color0, color1);
+	}
+
+	uint32 indices = 0;
+	if (color0 != color1)
+	{
+		uint32 palette[4];
+		bc1_palette(color0, color1, palette);
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			int best_distance = color_distance(texels[i], palette[0]);
+			for (int k = 1; k < 4; k++)
+			{
+				const int distance = color_distance(texels[i], palette[k]);
+				if (distance < best_distance)
+				{
+					best = k;
+					best_distance = distance;
+				}
+			}
+			indices |= (uint32)best << (2 * i);
+		}
+	}
+
+	memcpy(block + 0, &color0, 2);
+	memcpy(block + 2, &color1, 2);
+	memcpy(block + 4, &indices, 4);
+}
+
+static void encode_alpha_block(const uint32* texels, uint8* block)
+{
+	uint32 alpha0 = 0;
+	uint32 alpha1 = 255;
+	for (int i = 0; i < 16; i++)
+	{
+		const uint32 alpha = texels[i] >> 24;
+		alpha0 = std::max(alpha0, alpha);
+		alpha1 = std::min(alpha1, alpha);
+	}
+
+	// With alpha0 > alpha1 the block interpolates six values between them
+	uint64 indices = 0;
+	if (alpha0 > alpha1)
+	{
+		uint32 palette[8];
+		palette[0] = alpha0;
+		palette[1] = alpha1;
+		for (int k = 1; k < 7; k++)
+		{
+			palette[k + 1] = (alpha0 * (7 - k) + alpha1 * k) / 7;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			const int alpha = (int)(texels[i] >> 24);
+			int best = 0;
+			for (int k = 1; k < 8; k++)
+			{
+				if (abs(alpha - (int)palette[k]) < abs(alpha - (int)palette[best]))
+				{
+					best = k;
+				}
+			}
+			indices |= (uint64)best << (3 * i);
+		}
+	}
+
+	block[0] = (uint8)alpha0;
+	block[1] = (uint8)alpha1;
+	memcpy(block + 2, &indices, 6);
+}
+
+void encode_bc1_block(const uint32* texels, uint8* block)
+{
+	encode_color_block(texels, block);
+}
+
+void encode_bc3_block(const uint32* texels, uint8* block)
+{
+	encode_alpha_block(texels, block);
+	encode_color_block(texels, block + 8);
+}
+
+void decode_bc1_block(const uint8* block, uint32* texels)
+{
+	uint16 color0, color1;
+	uint32 indices;
+	memcpy(&color0, block + 0, 2);
+	memcpy(&color1, block + 2, 2);
+	memcpy(&indices, block + 4, 4);
+
+	uint32 palette[4];
+	bc1_palette(color0, color1, palette);
+	for (int i = 0; i < 16; i++)
+	{
+		texels[i] = palette[(indices >> (2 * i)) & 0x3];
+	}
+}
+
+void decode_bc3_block(const uint8* block, uint32* texels)
+{
+	decode_bc1_block(block + 8, texels);
+
+	const uint32 alpha0 = block[0];
+	const uint32 alpha1 = block[1];
+	uint32 palette[8];
+	palette[0] = alpha0;
+	palette[1] = alpha1;
+	if (alpha0 > alpha1)
+	{
+		for (int k = 1; k < 7; k++)
+		{
+			palette[k + 1] = (alpha0 * (7 - k) + alpha1 * k) / 7;
+		}
+	}
+	else
+	{
+		for (int k = 1; k < 5; k++)
+		{
+			palette[k + 1] = (alpha0 * (5 - k) + alpha1 * k) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	uint64 indices = 0;
+	memcpy(&indices, block + 2, 6);
+	for (int i = 0; i < 16; i++)
+	{
+		const uint32 alpha = palette[(indices >> (3 * i)) & 0x7];
+		texels[i] = (texels[i] & 0x00FFFFFF) | (alpha << 24);
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "../Utils/3d_types.h"
+
+/**
+ * Encoders and decoders for 4x4 blocks of texels in the BC1 and BC3 formats.
+ * A BC1 block stores the colors in 8 bytes (4 bits per texel) as two RGB565
+ * endpoints and a 2 bit index per texel into the four colors on the line
+ * between them. BC3 puts an 8 byte alpha block in front of it with two 8 bit
+ * endpoints and 3 bit indices. Texels are given in row order, 16 per block
+ */
+constexpr int BC1_BLOCK_SIZE = 8;
+constexpr int BC3_BLOCK_SIZE = 16;
+
+void encode_bc1_block(const uint32* texels, uint8* block);
+void encode_bc3_block(const uint32* texels, uint8* block);
+
+void decode_bc1_block(const uint8* block, uint32* texels);
+void decode_bc3_block(const uint8* block, uint32* texels);
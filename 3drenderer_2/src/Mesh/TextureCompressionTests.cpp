@@ -0,0 +1,126 @@
+#include "TextureCompression.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "Texture.h"
+#include "../Utils/UnitTests.h"
+
+/** Largest difference of a channel between two colors, alpha included */
+static int get_color_difference(uint32 a, uint32 b)
+{
+	int difference = 0;
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		difference = std::max(difference, abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF)));
+	}
+	return difference;
+}
+
+static uint32 make_color(int a, int r, int g, int b)
+{
+	return ((uint32)a << 24) | ((uint32)r << 16) | ((uint32)g << 8) | (uint32)b;
+}
+
+UNIT_TEST("texture compression: solid blocks decode to the color they were given")
+{
+	// Colors that RGB565 holds exactly
+	for (const uint32 color : { 0xFF000000u, 0xFFFFFFFFu, 0xFFFF0000u, 0xFF00FF00u, 0xFF0000FFu, 0xFF8410FFu })
+	{
+		uint32 texels[16];
+		std::fill(texels, texels + 16, color);
+
+		uint8 block[BC3_BLOCK_SIZE];
+		uint32 decoded[16];
+		encode_bc1_block(texels, block);
+		decode_bc1_block(block, decoded);
+		for (const uint32 texel : decoded)
+		{
+			CHECK(texel == color);
+		}
+
+		encode_bc3_block(texels, block);
+		decode_bc3_block(block, decoded);
+		for (const uint32 texel : decoded)
+		{
+			CHECK(texel == color);
+		}
+	}
+}
+
+UNIT_TEST("texture compression: gradients stay close to the source")
+{
+	// A color ramp across the whole range of a channel, with alpha going the
+	// other way. Four colors can be off by a sixth of the range, eight alpha
+	// values by a fourteenth
+	uint32 texels[16];
+	for (int i = 0; i < 16; i++)
+	{
+		const int t = i * 255 / 15;
+		texels[i] = make_color(255 - t, t, 128, 255 - t / 2);
+	}
+
+	uint8 block[BC3_BLOCK_SIZE];
+	uint32 decoded[16];
+	encode_bc1_block(texels, block);
+	decode_bc1_block(block, decoded);
+	int bc1_error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		// BC1 has no alpha, the texels come back opaque
+		CHECK((decoded[i] >> 24) == 0xFF);
+		bc1_error = std::max(bc1_error, get_color_difference(decoded[i] | 0xFF000000, texels[i] | 0xFF000000));
+	}
+	CHECK(bc1_error <= 48);
+
+	encode_bc3_block(texels, block);
+	decode_bc3_block(block, decoded);
+	int bc3_error = 0;
+	int alpha_error = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		bc3_error = std::max(bc3_error, get_color_difference(decoded[i] | 0xFF000000, texels[i] | 0xFF000000));
+		alpha_error = std::max(alpha_error, abs((int)(decoded[i] >> 24) - (int)(texels[i] >> 24)));
+	}
+	CHECK(bc3_error <= 48);
+	CHECK(alpha_error <= 20);
+}
+
+UNIT_TEST("texture compression: compressed textures sample back the image")
+{
+	// Smooth enough for every block to be close to a line of colors
+	constexpr int SIZE = 64;
+	std::vector<uint32> pixels(SIZE * SIZE);
+	for (int y = 0; y < SIZE; y++)
+	{
+		for (int x = 0; x < SIZE; x++)
+		{
+			pixels[y * SIZE + x] = make_color(255 - y * 2, x * 4, y * 4, 255 - x * 2);
+		}
+	}
+
+	for (const ETextureFormat format : { TEXTURE_FORMAT_BC1, TEXTURE_FORMAT_BC3 })
+	{
+		TextureLoadOptions options;
+		options.format = format;
+		const std::shared_ptr<Texture> texture = create_texture(pixels.data(), SIZE, SIZE, SIZE * (int)sizeof(uint32), options);
+		CHECK(texture->format == format);
+
+		int error = 0;
+		for (int y = 0; y < SIZE; y++)
+		{
+			for (int x = 0; x < SIZE; x++)
+			{
+				// The image is given top row first, v = 0 is its bottom row
+				const float u = ((float)x + 0.5f) / SIZE;
+				const float v = ((float)(SIZE - 1 - y) + 0.5f) / SIZE;
+				uint32 expected = pixels[y * SIZE + x];
+				expected = format == TEXTURE_FORMAT_BC1 ? expected | 0xFF000000 : expected;
+				error = std::max(error, get_color_difference(sample_texture(*texture, u, v, 0.0f, FILTER_POINT), expected));
+			}
+		}
+		// Rounding to RGB565, then to the four colors of the block
+		CHECK(error <= 12);
+	}
+}
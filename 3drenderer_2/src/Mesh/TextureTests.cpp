@@ -0,0 +1,31 @@
+#include "Texture.h"
+
+#include <vector>
+
+#include "../Utils/UnitTests.h"
+
+static std::shared_ptr<Texture> make_solid_texture(uint32 color, ETextureFormat format)
+{
+	constexpr int SIZE = 16;
+	const std::vector<uint32> pixels(SIZE * SIZE, color);
+	TextureLoadOptions options;
+	options.format = format;
+	return create_texture(pixels.data(), SIZE, SIZE, SIZE * (int)sizeof(uint32), options);
+}
+
+UNIT_TEST("texture: decoded blocks of a freed texture aren't reused")
+{
+	// Textures freed and created one after the other tend to get the same
+	// memory back, with the decoded block cache of this thread still warm
+	for (const ETextureFormat format : { TEXTURE_FORMAT_BC1, TEXTURE_FORMAT_BC3 })
+	{
+		std::shared_ptr<Texture> texture = make_solid_texture(0xFFFF0000, format);
+		CHECK(sample_texture(*texture, 0.5f, 0.5f, 0.0f, FILTER_POINT) == 0xFFFF0000);
+		const uint32 first_id = texture->id;
+		texture.reset();
+
+		texture = make_solid_texture(0xFF0000FF, format);
+		CHECK(texture->id != first_id);
+		CHECK(sample_texture(*texture, 0.5f, 0.5f, 0.0f, FILTER_POINT) == 0xFF0000FF);
+	}
+}
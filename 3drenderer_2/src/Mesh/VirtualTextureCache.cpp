@@ -0,0 +1,294 @@
+#include "VirtualTextureCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "Texture.h"
+#include "../Utils/TraceRecorder.h"
+
+// Pages queued at once. Keeps the reads from lagging far behind the camera
+// and bounds the memory held by pages on their way into the pool
+constexpr int MAX_PAGES_IN_FLIGHT = 16;
+
+VirtualTextureCache::~VirtualTextureCache()
+{
+	destroy();
+}
+
+void VirtualTextureCache::initialize(int max_pages_)
+{
+	destroy();
+
+	max_pages = max_pages_;
+	pool = std::make_unique<uint32[]>((size_t)max_pages * VIRTUAL_PAGE_TEXELS);
+	slots.resize(max_pages);
+
+	is_stopping = false;
+	streamer = std::thread(&VirtualTextureCache::stream_pages, this);
+}
+
+void VirtualTextureCache::destroy()
+{
+	if (streamer.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			is_stopping = true;
+		}
+		wake_streamer.notify_one();
+		streamer.join();
+	}
+
+	// Detach the pool from the textures that outlive the cache
+	for (PageSlot& slot : slots)
+	{
+		if (const std::shared_ptr<Texture> texture = slot.texture.lock())
+		{
+			VirtualPage& page = texture->mips[slot.level].pages[slot.page];
+			page.texels = nullptr;
+			page.slot = -1;
+		}
+	}
+	for (const std::weak_ptr<Texture>& weak_texture : textures)
+	{
+		if (const std::shared_ptr<Texture> texture = weak_texture.lock())
+		{
+			for (int level = 0; level < texture->num_virtual_levels; level++)
+			{
+				const MipLevel& mip = texture->mips[level];
+				const int num_pages = mip.pages_per_row * (mip.height >> VIRTUAL_PAGE_SHIFT);
+				for (int i = 0; i < num_pages; i++)
+				{
+					mip.pages[i].requested = false;
+				}
+			}
+		}
+	}
+
+	textures.clear();
+	slots.clear();
+	pool.reset();
+	queued.clear();
+	completed.clear();
+	max_pages = 0;
+	num_resident = 0;
+	num_in_flight = 0;
+}
+
+void VirtualTextureCache::add_texture(const std::shared_ptr<Texture>& texture)
+{
+	if (!texture || texture->num_virtual_levels == 0)
+	{
+		return;
+	}
+
+	// Meshes share their textures through the texture cache
+	for (const std::weak_ptr<Texture>& added : textures)
+	{
+		if (added.lock() == texture)
+		{
+			return;
+		}
+	}
+	textures.push_back(texture);
+}
+
+int VirtualTextureCache::acquire_slot()
+{
+	// Take a free slot, or else the least recently used one that wasn't
+	// sampled in the last frame
+	int best = -1;
+	uint32 best_last_used = virtual_texture_frame;
+	for (int i = 0; i < max_pages; i++)
+	{
+		const std::shared_ptr<Texture> texture = slots[i].texture.lock();
+		if (!texture)
+		{
+			return i;
+		}
+		const uint32 last_used = texture->mips[slots[i].level].pages[slots[i].page].last_used;
+		if (last_used < best_last_used)
+		{
+			best = i;
+			best_last_used = last_used;
+		}
+	}
+
+	if (best >= 0)
+	{
+		const std::shared_ptr<Texture> texture = slots[best].texture.lock();
+		VirtualPage& page = texture->mips[slots[best].level].pages[slots[best].page];
+		page.texels = nullptr;
+		page.slot = -1;
+		slots[best].texture.reset();
+		num_resident--;
+		num_evicted++;
+	}
+	return best;
+}
+
+void VirtualTextureCache::update()
+{
+	ZoneScoped; // for tracy
+
+	if (max_pages == 0)
+	{
+		return;
+	}
+
+	// Drop the textures that were freed. Their slots show up as free since the
+	// weak pointers expire along with them
+	textures.erase(
+		std::remove_if(textures.begin(), textures.end(),
+			[](const std::weak_ptr<Texture>& texture) { return texture.expired(); }),
+		textures.end()
+	);
+	num_resident = 0;
+	for (const PageSlot& slot : slots)
+	{
+		num_resident += slot.texture.expired() ? 0 : 1;
+	}
+
+	// Move the pages the streaming thread has read into the pool
+	std::vector<std::unique_ptr<PageRequest>> arrived;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		arrived.swap(completed);
+	}
+	for (const std::unique_ptr<PageRequest>& request : arrived)
+	{
+		num_in_flight--;
+
+		const std::shared_ptr<Texture> texture = request->texture.lock();
+		if (!texture)
+		{
+			continue;
+		}
+		VirtualPage& page = texture->mips[request->level].pages[request->page];
+		page.requested = false;
+		if (!request->texels)
+		{
+			page.failed = true;
+			continue;
+		}
+
+		// With every slot sampled last frame the page has to wait, it gets
+		// requested again if it is still wanted
+		const int slot = acquire_slot();
+		if (slot < 0)
+		{
+			continue;
+		}
+
+		uint32* texels = &pool[(size_t)slot * VIRTUAL_PAGE_TEXELS];
+		memcpy(texels, request->texels.get(), VIRTUAL_PAGE_TEXELS * sizeof(uint32));
+		page.texels = texels;
+		page.slot = slot;
+		slots[slot] = { texture, request->level, request->page };
+		num_resident++;
+		num_loaded++;
+	}
+
+	// Don't read more pages than there are slots to put them in. When every
+	// slot was sampled last frame the budget is too small for the view, and
+	// the missing pages keep using their fallbacks instead of being read over
+	// and over again
+	int num_available = 0;
+	for (const PageSlot& slot : slots)
+	{
+		const std::shared_ptr<Texture> texture = slot.texture.lock();
+		const bool is_free = !texture
+			|| texture->mips[slot.level].pages[slot.page].last_used < virtual_texture_frame;
+		num_available += is_free ? 1 : 0;
+	}
+	const int max_requests = std::min(MAX_PAGES_IN_FLIGHT, num_available) - num_in_flight;
+
+	// Read the feedback of the last frame. Coarser levels get requested first
+	// so the fallbacks sharpen one level at a time
+	std::vector<std::unique_ptr<PageRequest>> requests;
+	num_missing = 0;
+	for (const std::weak_ptr<Texture>& weak_texture : textures)
+	{
+		const std::shared_ptr<Texture> texture = weak_texture.lock();
+		for (int level = texture->num_virtual_levels - 1; level >= 0; level--)
+		{
+			const MipLevel& mip = texture->mips[level];
+			const int num_pages = mip.pages_per_row * (mip.height >> VIRTUAL_PAGE_SHIFT);
+			for (int i = 0; i < num_pages; i++)
+			{
+				VirtualPage& page = mip.pages[i];
+				if (page.texels || page.last_used != virtual_texture_frame)
+				{
+					continue;
+				}
+				num_missing++;
+				if (page.requested || page.failed || (int)requests.size() >= max_requests)
+				{
+					continue;
+				}
+
+				std::unique_ptr<PageRequest> request = std::make_unique<PageRequest>();
+				request->texture = texture;
+				request->level = level;
+				request->page = i;
+				request->filename = texture->page_file;
+				request->offset = mip.file_offset + (size_t)i * VIRTUAL_PAGE_TEXELS * sizeof(uint32);
+				requests.push_back(std::move(request));
+				page.requested = true;
+			}
+		}
+	}
+
+	if (!requests.empty())
+	{
+		num_in_flight += (int)requests.size();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (std::unique_ptr<PageRequest>& request : requests)
+			{
+				queued.push_back(std::move(request));
+			}
+		}
+		wake_streamer.notify_one();
+	}
+
+	// The next frame gets a new stamp
+	virtual_texture_frame++;
+}
+
+void VirtualTextureCache::stream_pages()
+{
+	while (true)
+	{
+		std::unique_ptr<PageRequest> request;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake_streamer.wait(lock, [this] { return is_stopping || !queued.empty(); });
+			if (is_stopping)
+			{
+				return;
+			}
+			request = std::move(queued.front());
+			queued.pop_front();
+		}
+
+		{
+			ZoneScopedN("Read page");
+
+			std::ifstream file(request->filename, std::ios::binary);
+			file.seekg((std::streamoff)request->offset);
+			request->texels = std::make_unique<uint32[]>(VIRTUAL_PAGE_TEXELS);
+			file.read((char*)request->texels.get(), VIRTUAL_PAGE_TEXELS * sizeof(uint32));
+			if (!file)
+			{
+				std::cerr << "Failed to read a page from " << request->filename << ".\n";
+				request->texels.reset();
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		completed.push_back(std::move(request));
+	}
+}
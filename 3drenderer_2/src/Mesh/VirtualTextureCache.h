@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Utils/3d_types.h"
+
+struct Texture;
+
+/** A page the streaming thread reads from a page file */
+struct PageRequest
+{
+	std::weak_ptr<Texture> texture;
+	int level;
+	int page;
+
+	std::string filename;
+	size_t offset;
+	std::unique_ptr<uint32[]> texels; // null if the read failed
+};
+
+/**
+ * Fixed size pool of physical pages shared by every virtual texture. The
+ * rasterizer stamps each page it samples with the frame number, and falls back
+ * to a coarser level when the page isn't resident. Between frames update()
+ * reads the stamps back, queues the missing pages on a background thread and
+ * swaps the pages it has read into the pool, evicting the least recently used
+ * ones once the budget is full. Pages still in use in the last frame are never
+ * evicted, so the texels the rasterizer reads never change under it
+ */
+struct VirtualTextureCache
+{
+	~VirtualTextureCache();
+
+	void initialize(int max_pages_);
+	void destroy();
+
+	/**
+	 * Textures created without TextureLoadOptions::virtual_texture, and textures
+	 * that were already added, are ignored
+	 */
+	void add_texture(const std::shared_ptr<Texture>& texture);
+
+	/** Must be called between frames, never while rasterizing */
+	void update();
+
+	int max_pages = 0; // memory budget, VIRTUAL_PAGE_TEXELS texels each
+
+	// Statistics
+	int num_resident = 0;
+	int num_in_flight = 0; // queued or being read
+	int num_missing = 0; // pages sampled last frame that weren't resident
+	int num_loaded = 0; // since the start
+	int num_evicted = 0;
+
+	struct PageSlot
+	{
+		std::weak_ptr<Texture> texture; // expired when the slot is free
+		int level;
+		int page;
+	};
+
+	int acquire_slot();
+	void stream_pages();
+
+	std::vector<std::weak_ptr<Texture>> textures;
+	std::unique_ptr<uint32[]> pool;
+	std::vector<PageSlot> slots;
+
+	// Shared with the streaming thread
+	std::thread streamer;
+	std::mutex mutex;
+	std::condition_variable wake_streamer;
+	std::deque<std::unique_ptr<PageRequest>> queued;
+	std::vector<std::unique_ptr<PageRequest>> completed;
+	bool is_stopping = false;
+};
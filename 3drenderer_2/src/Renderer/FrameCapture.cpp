@@ -0,0 +1,231 @@
+#include "FrameCapture.h"
+
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#include "Renderer.h"
+#include "../Mesh/AssetCache.h"
+#include "../Utils/MappedFile.h"
+#include "../Viewport/Viewport.h"
+#include "../World/World.h"
+
+constexpr char FRAME_CAPTURE_MAGIC[4] = { 'F', 'R', 'C', 'P' };
+constexpr uint32 FRAME_CAPTURE_VERSION = 1;
+constexpr uint32 FRAME_CAPTURE_LAYOUT = (uint32)(sizeof(Triangle) + sizeof(Line3D) + sizeof(glm::mat4));
+
+/** All the pages of a virtual level, read back from its page file */
+static bool read_virtual_level(const Texture& texture, const MipLevel& level, std::vector<uint32>& texels)
+{
+	const int page_rows = level.height >> VIRTUAL_PAGE_SHIFT;
+	texels.resize((size_t)level.pages_per_row * page_rows * VIRTUAL_PAGE_TEXELS);
+	std::ifstream file(texture.page_file, std::ios::binary);
+	file.seekg((std::streamoff)level.file_offset);
+	file.read((char*)texels.data(), (std::streamsize)(texels.size() * sizeof(uint32)));
+	if (!file)
+	{
+		std::cerr << "Failed to read the page file " << texture.page_file << ".\n";
+		return false;
+	}
+	return true;
+}
+
+bool save_frame_capture(const char* filename, const Renderer& renderer)
+{
+	const World& world = *renderer.world;
+
+	// Triangles refer to their texture by its index plus one, zero is none
+	std::vector<Triangle> triangles = world.triangles_in_scene;
+	std::vector<const Texture*> textures;
+	std::unordered_map<const Texture*, size_t> texture_indices;
+	for (Triangle& triangle : triangles)
+	{
+		if (triangle.texture)
+		{
+			const auto [it, is_new] = texture_indices.emplace(triangle.texture, textures.size());
+			if (is_new)
+			{
+				textures.push_back(triangle.texture);
+			}
+			triangle.texture = (Texture*)(uintptr_t)(it->second + 1);
+		}
+	}
+
+	CacheWriter writer;
+	writer.file.open(filename, std::ios::binary | std::ios::trunc);
+	if (!writer.file)
+	{
+		std::cerr << "Failed to create " << filename << ".\n";
+		return false;
+	}
+
+	writer.write(FRAME_CAPTURE_MAGIC);
+	writer.write(FRAME_CAPTURE_VERSION);
+	writer.write(FRAME_CAPTURE_LAYOUT);
+	writer.write((int32)renderer.viewport->width);
+	writer.write((int32)renderer.viewport->height);
+	writer.write((int32)renderer.render_mode);
+	writer.write((int32)renderer.shading_mode);
+	writer.write((int32)renderer.texture_filter);
+	writer.write((int32)renderer.backface_culling);
+	writer.write(world.camera.projection_matrix);
+
+	writer.write((uint32)textures.size());
+	std::vector<uint32> pages;
+	for (const Texture* texture : textures)
+	{
+		writer.write((int32)texture->format);
+		writer.write((int32)texture->width);
+		writer.write((int32)texture->height);
+		writer.write((int32)texture->num_virtual_levels);
+		writer.write((uint32)texture->mips.size());
+		for (int i = 0; i < (int)texture->mips.size(); i++)
+		{
+			const MipLevel& level = texture->mips[i];
+			writer.write((int32)level.width);
+			writer.write((int32)level.height);
+			if (i < texture->num_virtual_levels)
+			{
+				writer.write((int32)level.pages_per_row);
+				if (!read_virtual_level(*texture, level, pages))
+				{
+					return false;
+				}
+				writer.write_vector(pages);
+			}
+			else
+			{
+				const size_t size = get_level_data_size(level, texture->format);
+				const void* data = texture->format == TEXTURE_FORMAT_ARGB8888 ? (const void*)level.pixels : (const void*)level.blocks;
+				writer.write((uint64)size);
+				writer.write_bytes(data, size, CACHE_ALIGNMENT);
+			}
+		}
+	}
+
+	writer.write_vector(triangles);
+	writer.write_vector(world.lines_in_scene);
+
+	writer.file.close();
+	if (!writer.file)
+	{
+		std::cerr << "Failed to write " << filename << ".\n";
+		return false;
+	}
+	std::cout << "Captured " << triangles.size() << " triangles, " << world.lines_in_scene.size() << " lines and "
+			  << textures.size() << " textures to " << filename << "\n";
+	return true;
+}
+
+bool load_frame_capture(const char* filename, FrameCapture& capture)
+{
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		std::cerr << "Failed to open the frame capture " << filename << ".\n";
+		return false;
+	}
+	CacheReader reader{ file.data, file.size };
+
+	const std::array<char, 4> magic = reader.read<std::array<char, 4>>();
+	const uint32 version = reader.read<uint32>();
+	const uint32 layout = reader.read<uint32>();
+	if (!reader.is_valid || memcmp(magic.data(), FRAME_CAPTURE_MAGIC, sizeof(FRAME_CAPTURE_MAGIC)) != 0
+		|| version != FRAME_CAPTURE_VERSION || layout != FRAME_CAPTURE_LAYOUT)
+	{
+		std::cerr << filename << " isn't a frame capture of this version of the renderer.\n";
+		return false;
+	}
+
+	capture.width = reader.read<int32>();
+	capture.height = reader.read<int32>();
+	capture.render_mode = (ERenderMode)reader.read<int32>();
+	capture.shading_mode = (EShadingMode)reader.read<int32>();
+	capture.texture_filter = (ETextureFilter)reader.read<int32>();
+	capture.backface_culling = reader.read<int32>() != 0;
+	capture.projection_matrix = reader.read<glm::mat4>();
+
+	const uint32 num_textures = reader.read<uint32>();
+	capture.textures.clear();
+	for (uint32 i = 0; i < num_textures && reader.is_valid; i++)
+	{
+		std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+		texture->format = (ETextureFormat)reader.read<int32>();
+		texture->width = reader.read<int32>();
+		texture->height = reader.read<int32>();
+		texture->num_virtual_levels = reader.read<int32>();
+		texture->memory_size = 0;
+		const uint32 num_levels = reader.read<uint32>();
+		texture->mips.resize(reader.is_valid ? num_levels : 0);
+		for (int j = 0; j < (int)texture->mips.size() && reader.is_valid; j++)
+		{
+			MipLevel& level = texture->mips[j];
+			const int width = reader.read<int32>();
+			const int height = reader.read<int32>();
+			set_level_size(level, width, height);
+
+			size_t size;
+			const uint8* data;
+			if (j < texture->num_virtual_levels)
+			{
+				level.pages_per_row = reader.read<int32>();
+				const uint64 num_texels = reader.read<uint64>();
+				size = num_texels * sizeof(uint32);
+				data = reader.read_bytes(size, CACHE_ALIGNMENT);
+			}
+			else
+			{
+				size = reader.read<uint64>();
+				data = reader.read_bytes(size, CACHE_ALIGNMENT);
+			}
+			if (!data)
+			{
+				break;
+			}
+			level.storage = std::make_unique<uint8[]>(size);
+			memcpy(level.storage.get(), data, size);
+			texture->memory_size += size;
+
+			if (j < texture->num_virtual_levels)
+			{
+				// Every page is resident, straight from the storage
+				const size_t num_pages = size / (VIRTUAL_PAGE_TEXELS * sizeof(uint32));
+				level.pages = std::make_unique<VirtualPage[]>(num_pages);
+				for (size_t k = 0; k < num_pages; k++)
+				{
+					level.pages[k].texels = (const uint32*)level.storage.get() + k * VIRTUAL_PAGE_TEXELS;
+				}
+			}
+			else if (texture->format == TEXTURE_FORMAT_ARGB8888)
+			{
+				level.pixels = (const uint32*)level.storage.get();
+			}
+			else
+			{
+				level.blocks = level.storage.get();
+			}
+		}
+		capture.textures.push_back(std::move(texture));
+	}
+
+	reader.read_vector(capture.triangles);
+	reader.read_vector(capture.lines);
+	if (!reader.is_valid)
+	{
+		std::cerr << "The frame capture " << filename << " is truncated.\n";
+		return false;
+	}
+
+	for (Triangle& triangle : capture.triangles)
+	{
+		const uintptr_t index = (uintptr_t)triangle.texture;
+		if (index > capture.textures.size())
+		{
+			std::cerr << "The frame capture " << filename << " refers to a texture it doesn't have.\n";
+			return false;
+		}
+		triangle.texture = index > 0 ? capture.textures[index - 1].get() : nullptr;
+	}
+	return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+
+#include "RenderMode.h"
+#include "ShadingMode.h"
+#include "TextureFilter.h"
+#include "../Line/Line3D.h"
+#include "../Mesh/Texture.h"
+#include "../Triangle/Triangle.h"
+
+struct Renderer;
+
+/**
+ * Everything the renderer reads to draw one frame, after the world has
+ * transformed and culled the scene: the clip space triangles, the view space
+ * lines and their projection, the textures the triangles sample and the
+ * settings of the renderer. Replaying a capture needs no meshes, no world
+ * update and no input, so a slow frame can be drawn again and again on its own
+ */
+struct FrameCapture
+{
+	int width;
+	int height;
+	ERenderMode render_mode;
+	EShadingMode shading_mode;
+	ETextureFilter texture_filter;
+	bool backface_culling;
+	glm::mat4 projection_matrix;
+
+	std::vector<Triangle> triangles; // point into textures
+	std::vector<Line3D> lines;
+
+	/**
+	 * Copies of every level. Virtual levels keep all of their pages resident,
+	 * so they never fall back to coarser levels the way they can while live
+	 */
+	std::vector<std::shared_ptr<Texture>> textures;
+};
+
+/**
+ * Writes the frame about to be rendered, the triangles and lines the world
+ * produced for it and the settings of the renderer. Call between World::update
+ * and Renderer::render
+ */
+bool save_frame_capture(const char* filename, const Renderer& renderer);
+bool load_frame_capture(const char* filename, FrameCapture& capture);
@@ -9,4 +9,11 @@ enum ERenderMode
 	SOLID_WIREFRAME,
 	TEXTURED,
 	TEXTURED_WIREFRAME,
+
+	// Debug views, drawn as color ramps
+	DEBUG_DEPTH,
+	DEBUG_OVERDRAW, // times each pixel passed the depth test
+	DEBUG_DEPTH_REJECTIONS, // times each pixel failed the depth test
+	DEBUG_TILE_TIME, // time spent rasterizing the triangles touching each tile
+	DEBUG_TILE_TRIANGLES, // triangles touching each tile
 };
\ No newline at end of file
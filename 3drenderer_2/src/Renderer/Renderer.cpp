@@ -1,15 +1,22 @@
 #include "Renderer.h"
 
+#include <algorithm>
+#include <chrono>
 #include <thread>
 
 #include <omp.h>
-#include <tracy/tracy/Tracy.hpp>
 
+#include "FrameCapture.h"
 #include "../Clipping/Clipper.h"
 #include "../Graphics/Graphics.h"
 #include "../Math/Math3D.h"
 #include "../Triangle/Triangle.h"
 #include "../Utils/Colors.h"
+#include "../Utils/Constants.h"
+#include "../Utils/CycleCounters.h"
+#include "../Utils/FrameTimings.h"
+#include "../Utils/PipelineStats.h"
+#include "../Utils/TraceRecorder.h"
 #include "../Utils/math_helpers.h"
 #include "../Viewport/Viewport.h"
 #include "../Window/Window.h"
@@ -36,13 +43,21 @@ void Renderer::initialize(
 	graphics_init(window->renderer, viewport);
 	initialize_framebuffer();
 
+	// The total number of physical cores on the machine, plus one. Note that
+	// this assumes that the PC has two logical cores per physical core
+	num_threads = (int)(std::thread::hardware_concurrency() / 2) + 1;
+
 	render_mode = TEXTURED_WIREFRAME;
 	shading_mode = GOURAUD;
+	texture_filter = FILTER_BILINEAR;
 	display_face_normals = false;
 	backface_culling = true;
+	capture_next_frame = false;
+	capture_filename = "frame.capture";
 
-	// Create the array of triangles that will be rasterized
-	triangles_to_rasterize = std::make_unique<std::array<Triangle, MAX_TRIANGLES>>();
+	// Create the array of triangles that will be rasterized. It grows on
+	// demand, so this is only a starting size
+	triangles_to_rasterize.reserve(MAX_TRIANGLES);
 }
 
 void Renderer::destroy()
@@ -54,52 +69,87 @@ void Renderer::render()
 {
 	ZoneScoped; // for tracy
 
-	clear_framebuffer(Colors::BLACK);
-	clear_z_buffer();
+	if (capture_next_frame)
+	{
+		save_frame_capture(capture_filename.c_str(), *this);
+		capture_next_frame = false;
+	}
+
+	{
+		StageTimer timer(FRAME_STAGE_CLEAR);
+		clear_framebuffer(Colors::BLACK);
+		clear_z_buffer();
+		if (render_mode == DEBUG_OVERDRAW || render_mode == DEBUG_DEPTH_REJECTIONS)
+		{
+			clear_pixel_counts();
+		}
+	}
 
 	// Render all triangles in the scene
 	render_triangles_in_scene();
 	// Clear the array of triangles
 	world->triangles_in_scene.clear();
 
+	// The debug views replace the frame with a heatmap, under the lines
+	draw_debug_view();
+
 	// Render all lines in the scene
-	render_lines();
-	// Reset the positions of the gizmo
-	world->gizmo.reset();
+	{
+		StageTimer timer(FRAME_STAGE_LINES);
+		render_lines();
+	}
+	gather_pipeline_stats();
 
+	StageTimer timer(FRAME_STAGE_PRESENT);
 	update_framebuffer();
 }
 
 constexpr int NUM_TRIANGLES_PER_BATCH = 10;
 
+// Side of the tiles of the tile debug views, in pixels
+constexpr int DEBUG_TILE_SIZE = 32;
+// Pixel counts the overdraw and rejection views saturate at
+constexpr uint32 DEBUG_MAX_PIXEL_COUNT = 8;
+
 void Renderer::render_triangles_in_scene()
 {
 	ZoneScoped; // for tracy
+	TIMED_BLOCK("Render triangles");
 
-	int num_triangles_to_rasterize = 0;
 	// Clip all the triangles and stick them in a new array
-	clip_triangles(
-		world->triangles_in_scene, 
-		triangles_to_rasterize->data(),
-		num_triangles_to_rasterize
-	);
+	{
+		StageTimer timer(FRAME_STAGE_CLIPPING);
+		clip_triangles(world->triangles_in_scene, triangles_to_rasterize);
+	}
+	int num_triangles_to_rasterize = (int)triangles_to_rasterize.size();
+
+	// The tile debug views time or count the triangles touching each tile
+	const bool is_tile_view = render_mode == DEBUG_TILE_TIME || render_mode == DEBUG_TILE_TRIANGLES;
+	if (is_tile_view)
+	{
+		const int tiles_x = (viewport->width + DEBUG_TILE_SIZE - 1) / DEBUG_TILE_SIZE;
+		const int tiles_y = (viewport->height + DEBUG_TILE_SIZE - 1) / DEBUG_TILE_SIZE;
+		thread_tile_costs.resize(num_threads);
+		for (std::vector<float>& costs : thread_tile_costs)
+		{
+			costs.assign((size_t)tiles_x * tiles_y, 0.0f);
+		}
+	}
 
-	ZoneNamedN(rasterize_triangles_scope, "Rasterization", true); // for tracy
+	ZoneNamedTraced(rasterize_triangles_scope, "Rasterization", TRACE_DETAIL_FUNCTION); // for tracy
+	StageTimer timer(FRAME_STAGE_RASTERIZATION);
 
-// Set the number of threads to execute to the total number of physical cores on
-// the machine, plus one. Note that this function assumes that the PC has two
-// logical cores per physical core
 #pragma omp parallel \
-	num_threads((std::thread::hardware_concurrency() / 2) + 1) \
+	num_threads(num_threads) \
 	default(none) \
-	shared(num_triangles_to_rasterize)
+	shared(num_triangles_to_rasterize, is_tile_view)
 // Give each thread ten triangles at a time
 #pragma omp for schedule(static, NUM_TRIANGLES_PER_BATCH)
 	for (int i = 0; i < num_triangles_to_rasterize; i++)
 	{
-		ZoneNamedN(render_triangle_scope, "Render triangle", true); // for tracy
+		ZoneNamedTraced(render_triangle_scope, "Render triangle", TRACE_DETAIL_TRIANGLE); // for tracy
 
-		Triangle& triangle = triangles_to_rasterize->data()[i];
+		Triangle& triangle = triangles_to_rasterize[i];
 
 		// Perform conversion to NDC and viewport transform here
 		for (Vertex& vertex : triangle.vertices)
@@ -115,15 +165,90 @@ void Renderer::render_triangles_in_scene()
 		}
 
 		// Perform backface culling
+		PipelineStats& stats = get_thread_pipeline_stats();
 		if (backface_culling)
 		{
 			if (!triangle.is_front_facing())
 			{
+				stats.counters[PIPELINE_TRIANGLES_BACKFACE_CULLED]++;
 				continue;
 			}
 		}
 
+		const glm::vec2 a(triangle.vertices[0].position);
+		const glm::vec2 b(triangle.vertices[1].position);
+		const glm::vec2 c(triangle.vertices[2].position);
+		stats.counters[PIPELINE_TRIANGLES_RASTERIZED]++;
+		stats.add_triangle_size(fabsf(Math3D::orient2d_f(a, b, c)) * 0.5f);
+
+		if (!is_tile_view)
+		{
+			rasterize_triangle(triangle);
+			continue;
+		}
+
+		const auto start = std::chrono::steady_clock::now();
 		rasterize_triangle(triangle);
+		const float cost = render_mode == DEBUG_TILE_TIME
+							   ? std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count()
+							   : 1.0f;
+		add_tile_cost(triangle, cost, thread_tile_costs[omp_get_thread_num()]);
+	}
+}
+
+void Renderer::add_tile_cost(const Triangle& triangle, float cost, std::vector<float>& costs) const
+{
+	// Every tile the screen bounds of the triangle overlap
+	const glm::vec4& a = triangle.vertices[0].position;
+	const glm::vec4& b = triangle.vertices[1].position;
+	const glm::vec4& c = triangle.vertices[2].position;
+	const int tiles_x = (viewport->width + DEBUG_TILE_SIZE - 1) / DEBUG_TILE_SIZE;
+	const int tiles_y = (viewport->height + DEBUG_TILE_SIZE - 1) / DEBUG_TILE_SIZE;
+	const int min_x = std::clamp((int)lrintf(std::min({ a.x, b.x, c.x })) / DEBUG_TILE_SIZE, 0, tiles_x - 1);
+	const int max_x = std::clamp((int)lrintf(std::max({ a.x, b.x, c.x })) / DEBUG_TILE_SIZE, 0, tiles_x - 1);
+	const int min_y = std::clamp((int)lrintf(std::min({ a.y, b.y, c.y })) / DEBUG_TILE_SIZE, 0, tiles_y - 1);
+	const int max_y = std::clamp((int)lrintf(std::max({ a.y, b.y, c.y })) / DEBUG_TILE_SIZE, 0, tiles_y - 1);
+
+	for (int y = min_y; y <= max_y; y++)
+	{
+		for (int x = min_x; x <= max_x; x++)
+		{
+			costs[(size_t)y * tiles_x + x] += cost;
+		}
+	}
+}
+
+void Renderer::draw_debug_view()
+{
+	switch (render_mode)
+	{
+		case DEBUG_DEPTH:
+		{
+			draw_depth_heatmap();
+			break;
+		}
+		case DEBUG_OVERDRAW:
+		case DEBUG_DEPTH_REJECTIONS:
+		{
+			draw_count_heatmap(DEBUG_MAX_PIXEL_COUNT);
+			break;
+		}
+		case DEBUG_TILE_TIME:
+		case DEBUG_TILE_TRIANGLES:
+		{
+			tile_costs.assign(thread_tile_costs[0].size(), 0.0f);
+			for (const std::vector<float>& costs : thread_tile_costs)
+			{
+				for (size_t i = 0; i < costs.size(); i++)
+				{
+					tile_costs[i] += costs[i];
+				}
+			}
+			draw_tile_heatmap(tile_costs.data(), DEBUG_TILE_SIZE);
+			break;
+		}
+		default:
+			break;
 	}
 }
 
@@ -193,12 +318,12 @@ void Renderer::rasterize_triangle(Triangle& triangle) const
 		}
 		case SOLID:
 		{
-			draw_solid(triangle, Colors::WHITE, shading_mode);
+			draw_solid(triangle, triangle.color, shading_mode);
 			break;
 		}
 		case SOLID_WIREFRAME:
 		{
-			draw_solid(triangle, Colors::WHITE, shading_mode);
+			draw_solid(triangle, triangle.color, shading_mode);
 			draw_wireframe_3d(triangle, Colors::BLACK);
 			break;
 		}
@@ -210,7 +335,7 @@ void Renderer::rasterize_triangle(Triangle& triangle) const
 			}
 			else
 			{
-				draw_textured(triangle, shading_mode);
+				draw_textured(triangle, shading_mode, texture_filter);
 			}
 			break;
 		}
@@ -223,11 +348,36 @@ void Renderer::rasterize_triangle(Triangle& triangle) const
 			}
 			else
 			{
-				draw_textured(triangle, shading_mode);
+				draw_textured(triangle, shading_mode, texture_filter);
 				draw_wireframe_3d(triangle, Colors::BLACK);
 			}
 			break;
 		}
+		case DEBUG_DEPTH:
+		case DEBUG_OVERDRAW:
+		{
+			draw_depth_complexity(triangle, false);
+			break;
+		}
+		case DEBUG_DEPTH_REJECTIONS:
+		{
+			draw_depth_complexity(triangle, true);
+			break;
+		}
+		// Drawn the way they would be, so the times are those of a real frame
+		case DEBUG_TILE_TIME:
+		case DEBUG_TILE_TRIANGLES:
+		{
+			if (!triangle.texture)
+			{
+				draw_solid(triangle, Colors::RED, NONE);
+			}
+			else
+			{
+				draw_textured(triangle, shading_mode, texture_filter);
+			}
+			break;
+		}
 	}
 }
 
@@ -265,6 +415,11 @@ void Renderer::draw_face_normal(const Triangle& triangle) const
 		case SOLID_WIREFRAME:
 		case TEXTURED:
 		case TEXTURED_WIREFRAME:
+		case DEBUG_DEPTH:
+		case DEBUG_OVERDRAW:
+		case DEBUG_DEPTH_REJECTIONS:
+		case DEBUG_TILE_TIME:
+		case DEBUG_TILE_TRIANGLES:
 			draw_line_bresenham_3d(center_, end_, center_z, end_z, Colors::GREEN);
 			break;
 	}
@@ -272,6 +427,7 @@ void Renderer::draw_face_normal(const Triangle& triangle) const
 
 void Renderer::display_frame()
 {
+	StageTimer timer(FRAME_STAGE_PRESENT);
 	render_frame();
 }
 
@@ -292,3 +448,21 @@ void Renderer::set_shading_mode(EShadingMode mode)
 		shading_mode = mode;
 	}
 }
+
+void Renderer::cycle_texture_filter()
+{
+	texture_filter = (ETextureFilter)((texture_filter + 1) % NUM_TEXTURE_FILTERS);
+}
+
+void Renderer::cycle_debug_view()
+{
+	// The first debug view from any other mode, then each one in turn
+	if (render_mode < DEBUG_DEPTH || render_mode == DEBUG_TILE_TRIANGLES)
+	{
+		render_mode = DEBUG_DEPTH;
+	}
+	else
+	{
+		render_mode = (ERenderMode)(render_mode + 1);
+	}
+}
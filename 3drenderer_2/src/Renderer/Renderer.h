@@ -1,14 +1,14 @@
 #pragma once
 
-#include <array>
-#include <memory>
+#include <string>
+#include <vector>
 
 #include "RenderMode.h"
 #include "ShadingMode.h"
-#include "../Utils/Constants.h"
+#include "TextureFilter.h"
+#include "../Triangle/Triangle.h"
 
 struct SDL_Texture;
-struct Triangle;
 struct Viewport;
 struct Window;
 struct World;
@@ -26,20 +26,35 @@ struct Renderer
 
 	void set_render_mode(ERenderMode mode);
 	void set_shading_mode(EShadingMode mode);
+	void cycle_texture_filter();
+	void cycle_debug_view();
 
 	Viewport* viewport;
 	Window* window;
 	World* world;
 
-	std::unique_ptr<std::array<Triangle, MAX_TRIANGLES>> triangles_to_rasterize;
+	std::vector<Triangle> triangles_to_rasterize;
 
 	ERenderMode render_mode;
 	EShadingMode shading_mode;
+	ETextureFilter texture_filter;
 	bool display_face_normals;
 	bool backface_culling;
+	int num_threads; // rasterizing the triangles
+
+	// The next frame rendered is written to capture_filename, see FrameCapture
+	bool capture_next_frame;
+	std::string capture_filename;
+
+	// Cost of the triangles touching each tile of the screen, for the tile
+	// debug views. Each thread adds up its own, summed once they are all done
+	std::vector<std::vector<float>> thread_tile_costs;
+	std::vector<float> tile_costs;
 
 	void render_triangles_in_scene();
 	void render_lines() const;
 	void rasterize_triangle(Triangle& triangle) const;
+	void add_tile_cost(const Triangle& triangle, float cost, std::vector<float>& costs) const;
+	void draw_debug_view();
 	void draw_face_normal(const Triangle& triangle) const;
 };
\ No newline at end of file
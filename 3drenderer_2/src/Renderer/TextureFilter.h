@@ -0,0 +1,9 @@
+#pragma once
+
+enum ETextureFilter
+{
+	FILTER_POINT, // nearest texel of the nearest mip level
+	FILTER_BILINEAR, // blend of the four nearest texels of the nearest mip level
+	FILTER_TRILINEAR, // blend of the two nearest mip levels, each filtered bilinearly
+	NUM_TEXTURE_FILTERS,
+};
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <array>
-#include <memory>
 
 #include <glm/vec3.hpp>
 
@@ -16,7 +15,7 @@ struct Triangle
 	float signed_area; // For backface culling
 	uint32 color; // for flat-colored triangles
 	float flat_value; // for flat shading
-	std::shared_ptr<Texture> texture;
+	Texture* texture = nullptr; // owned by the mesh the triangle came from
 
 	bool is_front_facing();
 };
\ No newline at end of file
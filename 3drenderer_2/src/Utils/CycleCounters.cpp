@@ -0,0 +1,167 @@
+#include "CycleCounters.h"
+
+#ifdef PROFILING_ON
+
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HAS_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_RDTSC
+#endif
+
+#include "string_ops.h"
+#include "../Logger/Logger.h"
+
+/**
+ * Only the thread owning the values writes them, with plain loads and stores.
+ * They are atomic so snapshots can read them while the thread is running
+ */
+struct CycleCounterValues
+{
+	std::atomic<uint64> cycles{ 0 };
+	std::atomic<uint64> nanoseconds{ 0 };
+	std::atomic<uint64> calls{ 0 };
+};
+
+struct ThreadCycleCounters
+{
+	CycleCounterValues values[MAX_CYCLE_COUNTERS];
+};
+
+// Taken to register a counter or a thread, and to take a snapshot. Timing a
+// block never takes it
+static std::mutex registry_mutex;
+static const char* counter_names[MAX_CYCLE_COUNTERS];
+static std::atomic<int> num_counters{ 0 };
+static std::vector<std::unique_ptr<ThreadCycleCounters>> thread_counters;
+
+// Sums of every thread at the last snapshot. Counters are never reset, each
+// snapshot is the difference from the one before
+static CycleCounterSnapshot last_totals[MAX_CYCLE_COUNTERS];
+
+std::vector<CycleCounterSnapshot> frame_cycle_counters;
+
+uint64 read_cycle_counter()
+{
+#ifdef HAS_RDTSC
+	return __rdtsc();
+#else
+	return (uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+int register_cycle_counter(const char* name)
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	const int id = num_counters.load(std::memory_order_relaxed);
+	if (id == MAX_CYCLE_COUNTERS)
+	{
+		std::cerr << "Too many cycle counters, " << name << " isn't counted.\n";
+		return -1;
+	}
+	counter_names[id] = name;
+	last_totals[id] = { name, 0, 0, 0 };
+	num_counters.store(id + 1, std::memory_order_release);
+	return id;
+}
+
+static ThreadCycleCounters& get_thread_cycle_counters()
+{
+	thread_local ThreadCycleCounters* counters = []
+	{
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		thread_counters.push_back(std::make_unique<ThreadCycleCounters>());
+		return thread_counters.back().get();
+	}();
+	return *counters;
+}
+
+void add_cycle_counter_sample(int id, uint64 cycles, uint64 nanoseconds)
+{
+	if (id < 0)
+	{
+		return;
+	}
+
+	CycleCounterValues& values = get_thread_cycle_counters().values[id];
+	values.cycles.store(values.cycles.load(std::memory_order_relaxed) + cycles, std::memory_order_relaxed);
+	values.nanoseconds.store(values.nanoseconds.load(std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+	values.calls.store(values.calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void snapshot_cycle_counters()
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	const int count = num_counters.load(std::memory_order_acquire);
+	frame_cycle_counters.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		CycleCounterSnapshot total = { counter_names[i], 0, 0, 0 };
+		for (const std::unique_ptr<ThreadCycleCounters>& counters : thread_counters)
+		{
+			total.cycles += counters->values[i].cycles.load(std::memory_order_relaxed);
+			total.nanoseconds += counters->values[i].nanoseconds.load(std::memory_order_relaxed);
+			total.calls += counters->values[i].calls.load(std::memory_order_relaxed);
+		}
+
+		frame_cycle_counters[i] = {
+			counter_names[i],
+			total.cycles - last_totals[i].cycles,
+			total.nanoseconds - last_totals[i].nanoseconds,
+			total.calls - last_totals[i].calls,
+		};
+		last_totals[i] = total;
+	}
+}
+
+void log_cycle_counters()
+{
+	for (const CycleCounterSnapshot& counter : frame_cycle_counters)
+	{
+		std::ostringstream ms;
+		ms << std::fixed << std::setprecision(3) << (double)counter.nanoseconds / 1e6;
+		Logger::print(
+			LOG_CATEGORY_PERF_COUNTER,
+			std::string(counter.name) + ": " + to_string_with_commas(counter.cycles) + " cycles ("
+			+ ms.str() + " ms), " + to_string_with_commas(counter.calls) + " calls"
+		);
+	}
+}
+
+bool write_cycle_counters_json(const char* filename)
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	std::ofstream json(filename);
+	json << std::fixed << std::setprecision(4);
+	json << "{\n";
+	json << "  \"counters\": [\n";
+	for (size_t i = 0; i < frame_cycle_counters.size(); i++)
+	{
+		const CycleCounterSnapshot& frame = frame_cycle_counters[i];
+		const CycleCounterSnapshot& total = last_totals[i];
+		json << "    { \"name\": \"" << frame.name << "\""
+			 << ", \"frame\": { \"cycles\": " << frame.cycles << ", \"ms\": " << (double)frame.nanoseconds / 1e6 << ", \"calls\": " << frame.calls << " }"
+			 << ", \"total\": { \"cycles\": " << total.cycles << ", \"ms\": " << (double)total.nanoseconds / 1e6 << ", \"calls\": " << total.calls << " } }"
+			 << (i + 1 < frame_cycle_counters.size() ? "," : "") << "\n";
+	}
+	json << "  ]\n";
+	json << "}\n";
+	if (!json)
+	{
+		std::cerr << "Failed to write " << filename << ".\n";
+		return false;
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "3d_types.h"
+
+/**
+ * Timed blocks of code, counted per thread. TIMED_BLOCK("name") at the top of
+ * a scope registers a counter for that line the first time it runs, then adds
+ * the cycles, the nanoseconds and one call to it when the scope ends. Each
+ * thread only ever writes its own counters, so timing a block takes no locks
+ * and no read-modify-write atomics. Everything compiles out unless PROFILING_ON
+ * is defined, leaving the functions below as empty inlines
+ */
+
+/** A counter summed over every thread, between two snapshots */
+struct CycleCounterSnapshot
+{
+	const char* name;
+	uint64 cycles;
+	uint64 nanoseconds;
+	uint64 calls;
+};
+
+#ifdef PROFILING_ON
+
+constexpr int MAX_CYCLE_COUNTERS = 64;
+
+/** Time stamp counter where the CPU has one, nanoseconds elsewhere */
+uint64 read_cycle_counter();
+
+/** Returns the id of the counter, or -1 once MAX_CYCLE_COUNTERS are taken */
+int register_cycle_counter(const char* name);
+void add_cycle_counter_sample(int id, uint64 cycles, uint64 nanoseconds);
+
+struct CycleCounterScope
+{
+	explicit CycleCounterScope(int id_)
+		: id(id_), start_cycles(read_cycle_counter()), start_time(std::chrono::steady_clock::now())
+	{
+	}
+
+	~CycleCounterScope()
+	{
+		const uint64 cycles = read_cycle_counter() - start_cycles;
+		const auto elapsed = std::chrono::steady_clock::now() - start_time;
+		add_cycle_counter_sample(id, cycles, (uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	}
+
+	int id;
+	uint64 start_cycles;
+	std::chrono::steady_clock::time_point start_time;
+};
+
+#define TIMED_BLOCK_NAME(prefix, line) prefix##line
+#define TIMED_BLOCK_AT(name, line) \
+	static const int TIMED_BLOCK_NAME(cycle_counter_, line) = register_cycle_counter(name); \
+	const CycleCounterScope TIMED_BLOCK_NAME(cycle_counter_scope_, line)(TIMED_BLOCK_NAME(cycle_counter_, line))
+#define TIMED_BLOCK(name) TIMED_BLOCK_AT(name, __LINE__)
+
+/**
+ * Sums every thread into frame_cycle_counters, as the difference from the last
+ * snapshot. Called once per frame
+ */
+void snapshot_cycle_counters();
+/** Writes the last snapshot to the performance counter log */
+void log_cycle_counters();
+/** Writes the last snapshot and the totals since the start as JSON */
+bool write_cycle_counters_json(const char* filename);
+
+extern std::vector<CycleCounterSnapshot> frame_cycle_counters;
+
+#else
+
+#define TIMED_BLOCK(name)
+
+inline void snapshot_cycle_counters() {}
+inline void log_cycle_counters() {}
+inline bool write_cycle_counters_json(const char*) { return true; }
+
+#endif
@@ -0,0 +1,32 @@
+#include "FrameTimings.h"
+
+const char* FRAME_STAGE_NAMES[NUM_FRAME_STAGES] = {
+	"streaming",
+	"culling",
+	"geometry",
+	"clear",
+	"clipping",
+	"rasterization",
+	"lines",
+	"present",
+};
+
+double frame_stage_ms[NUM_FRAME_STAGES] = {};
+
+void reset_frame_timings()
+{
+	for (double& ms : frame_stage_ms)
+	{
+		ms = 0.0;
+	}
+}
+
+StageTimer::StageTimer(EFrameStage stage_)
+	: stage(stage_), start(std::chrono::steady_clock::now())
+{
+}
+
+StageTimer::~StageTimer()
+{
+	frame_stage_ms[stage] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
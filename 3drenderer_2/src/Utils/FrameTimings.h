@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+
+/** Parts of a frame whose time is measured every frame */
+enum EFrameStage
+{
+	FRAME_STAGE_STREAMING, // swapping in meshes, chunks, cells and texture pages
+	FRAME_STAGE_CULLING, // camera, entity transforms, frustum culling, LOD selection
+	FRAME_STAGE_GEOMETRY, // transforming and shading the triangles of the visible entities
+	FRAME_STAGE_CLEAR, // framebuffer and depth buffer
+	FRAME_STAGE_CLIPPING,
+	FRAME_STAGE_RASTERIZATION,
+	FRAME_STAGE_LINES, // gizmo and light
+	FRAME_STAGE_PRESENT, // copying the framebuffer to the window
+	NUM_FRAME_STAGES,
+};
+
+extern const char* FRAME_STAGE_NAMES[NUM_FRAME_STAGES];
+
+/**
+ * Milliseconds spent in each stage by the last frame. Each stage is timed
+ * once per frame, so this costs a couple of clock reads per stage
+ */
+extern double frame_stage_ms[NUM_FRAME_STAGES];
+
+/** Adds the time until it goes out of scope to a stage of the frame */
+struct StageTimer
+{
+	StageTimer(EFrameStage stage_);
+	~StageTimer();
+
+	EFrameStage stage;
+	std::chrono::steady_clock::time_point start;
+};
+
+/** Called at the start of each frame */
+void reset_frame_timings();
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+#include "3d_types.h"
+
+/**
+ * Read only view of a whole file through the virtual memory system. Pages are
+ * only read from disk when they are first touched, and stay shared with the
+ * OS file cache
+ */
+struct MappedFile
+{
+	~MappedFile();
+
+	bool open(const char* filename);
+	void close();
+
+	const uint8* data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#endif
+};
@@ -0,0 +1,99 @@
+#include "PipelineStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+const char* PIPELINE_COUNTER_NAMES[NUM_PIPELINE_COUNTERS] = {
+	"triangles_submitted",
+	"triangles_frustum_culled",
+	"triangles_backface_culled",
+	"triangles_clipped",
+	"triangles_generated",
+	"triangles_rasterized",
+	"pixels_tested",
+	"pixels_passed",
+	"pixels_overdrawn",
+	"texels_fetched",
+};
+
+PipelineStats frame_pipeline_stats;
+
+// The counters of every thread that has counted anything. Threads register
+// once, the first time they count
+static std::mutex thread_stats_mutex;
+static std::vector<std::unique_ptr<PipelineStats>> thread_stats;
+
+std::string get_triangle_size_bucket_name(int bucket)
+{
+	if (bucket == 0)
+	{
+		return "<1";
+	}
+	if (bucket == NUM_TRIANGLE_SIZE_BUCKETS - 1)
+	{
+		return std::to_string(1 << (bucket - 1)) + "+";
+	}
+	return std::to_string(1 << (bucket - 1)) + "-" + std::to_string(1 << bucket);
+}
+
+void PipelineStats::add_triangle_size(float area)
+{
+	const int bucket = area < 1.0f ? 0 : std::min(std::ilogb(area) + 1, NUM_TRIANGLE_SIZE_BUCKETS - 1);
+	triangle_sizes[bucket]++;
+}
+
+void PipelineStats::add(const PipelineStats& other)
+{
+	for (int i = 0; i < NUM_PIPELINE_COUNTERS; i++)
+	{
+		counters[i] += other.counters[i];
+	}
+	for (int i = 0; i < NUM_TRIANGLE_SIZE_BUCKETS; i++)
+	{
+		triangle_sizes[i] += other.triangle_sizes[i];
+	}
+}
+
+void PipelineStats::reset()
+{
+	*this = PipelineStats();
+}
+
+double PipelineStats::get_overdraw() const
+{
+	const uint64 covered = counters[PIPELINE_PIXELS_PASSED] - counters[PIPELINE_PIXELS_OVERDRAWN];
+	return covered > 0 ? (double)counters[PIPELINE_PIXELS_PASSED] / (double)covered : 0.0;
+}
+
+PipelineStats& get_thread_pipeline_stats()
+{
+	thread_local PipelineStats* stats = []
+	{
+		std::lock_guard<std::mutex> lock(thread_stats_mutex);
+		thread_stats.push_back(std::make_unique<PipelineStats>());
+		return thread_stats.back().get();
+	}();
+	return *stats;
+}
+
+void reset_pipeline_stats()
+{
+	std::lock_guard<std::mutex> lock(thread_stats_mutex);
+	for (const std::unique_ptr<PipelineStats>& stats : thread_stats)
+	{
+		stats->reset();
+	}
+}
+
+void gather_pipeline_stats()
+{
+	std::lock_guard<std::mutex> lock(thread_stats_mutex);
+	frame_pipeline_stats.reset();
+	for (const std::unique_ptr<PipelineStats>& stats : thread_stats)
+	{
+		frame_pipeline_stats.add(*stats);
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+
+#include "3d_types.h"
+
+/** Work done by each stage of the pipeline, counted every frame */
+enum EPipelineCounter
+{
+	PIPELINE_TRIANGLES_SUBMITTED, // of the visible entities, before any culling
+	PIPELINE_TRIANGLES_FRUSTUM_CULLED, // by the bounds of their meshlet, or entirely outside a clip plane
+	PIPELINE_TRIANGLES_BACKFACE_CULLED, // by the cone of their meshlet, or their winding on screen
+	PIPELINE_TRIANGLES_CLIPPED, // cut by a clip plane, with part of them kept
+	PIPELINE_TRIANGLES_GENERATED, // by clipping, on top of the one each clipped triangle turns into
+	PIPELINE_TRIANGLES_RASTERIZED,
+	PIPELINE_PIXELS_TESTED, // against the depth buffer
+	PIPELINE_PIXELS_PASSED, // the depth test, and were shaded
+	PIPELINE_PIXELS_OVERDRAWN, // passed over a pixel already written this frame
+	PIPELINE_TEXELS_FETCHED,
+	NUM_PIPELINE_COUNTERS,
+};
+
+extern const char* PIPELINE_COUNTER_NAMES[NUM_PIPELINE_COUNTERS];
+
+/**
+ * Screen area of the rasterized triangles in pixels. The first bucket holds the
+ * triangles smaller than a pixel, each bucket after that twice the area of the
+ * one before, and the last one everything larger
+ */
+constexpr int NUM_TRIANGLE_SIZE_BUCKETS = 16;
+
+/** "<1", "1-2", "2-4" and so on up to "16384+" */
+std::string get_triangle_size_bucket_name(int bucket);
+
+struct alignas(64) PipelineStats
+{
+	uint64 counters[NUM_PIPELINE_COUNTERS] = {};
+	uint64 triangle_sizes[NUM_TRIANGLE_SIZE_BUCKETS] = {};
+
+	void add_triangle_size(float area);
+	void add(const PipelineStats& other);
+	void reset();
+
+	/** Times each pixel covered by the frame was shaded, on average */
+	double get_overdraw() const;
+};
+
+/**
+ * Totals of the last frame, gathered from every thread at the end of
+ * Renderer::render()
+ */
+extern PipelineStats frame_pipeline_stats;
+
+/**
+ * The counters of the calling thread for the frame in progress. No other
+ * thread writes to them, so the stages count without atomics. Look them up
+ * once per batch or triangle and count into locals in the inner loops
+ */
+PipelineStats& get_thread_pipeline_stats();
+
+/** Called at the start of each frame, with no stage running */
+void reset_pipeline_stats();
+/** Sums the counters of every thread into frame_pipeline_stats */
+void gather_pipeline_stats();
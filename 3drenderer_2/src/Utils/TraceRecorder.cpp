@@ -0,0 +1,245 @@
+#include "TraceRecorder.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TraceEvent
+{
+	const char* name;
+	int64 start;
+	int64 duration;
+	ETraceDetail detail;
+};
+
+/**
+ * Ring of the events of one thread. Only the thread owning the buffer writes
+ * to it, and is_writing is set for as long as it does. The trace is only read
+ * once it is closed and the writer isn't in the middle of an event
+ */
+struct TraceBuffer
+{
+	std::unique_ptr<TraceEvent[]> events;
+	uint64 capacity;
+	std::atomic<uint64> num_written{ 0 };
+	std::atomic<bool> is_writing{ false };
+	bool is_main_thread = false;
+};
+
+static const char* TRACE_DETAIL_NAMES[NUM_TRACE_DETAILS] = { "function", "triangle" };
+
+std::atomic<int> recorded_trace_detail{ -1 };
+
+// Set before the trace is written. Zones that end after it aren't recorded
+static std::atomic<bool> is_trace_closed{ false };
+
+// Taken to register a thread and to write the trace. Recording a zone never
+// takes it
+static std::mutex trace_mutex;
+static std::vector<std::unique_ptr<TraceBuffer>> trace_buffers;
+static std::thread::id main_thread_id;
+
+// Set by the main thread under trace_mutex, read by the threads registering
+static TraceOptions trace_options;
+
+// Only used from the main thread
+static int trace_frame = 0;
+static bool is_trace_finished = false;
+static std::vector<int64> trace_frame_starts;
+
+bool parse_trace_detail(const std::string& name, ETraceDetail& detail)
+{
+	for (int i = 0; i < NUM_TRACE_DETAILS; i++)
+	{
+		if (name == TRACE_DETAIL_NAMES[i])
+		{
+			detail = (ETraceDetail)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+int64 get_trace_time()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static TraceBuffer& get_thread_trace_buffer()
+{
+	thread_local TraceBuffer* buffer = []
+	{
+		// Only threads that record a zone get a ring, so nothing is allocated
+		// unless a trace was asked for
+		std::lock_guard<std::mutex> lock(trace_mutex);
+		std::unique_ptr<TraceBuffer> new_buffer = std::make_unique<TraceBuffer>();
+		new_buffer->capacity = (uint64)trace_options.events_per_thread;
+		new_buffer->events = std::make_unique<TraceEvent[]>(new_buffer->capacity);
+		new_buffer->is_main_thread = std::this_thread::get_id() == main_thread_id;
+		trace_buffers.push_back(std::move(new_buffer));
+		return trace_buffers.back().get();
+	}();
+	return *buffer;
+}
+
+void add_trace_event(const char* name, int64 start, ETraceDetail detail)
+{
+	const int64 end = get_trace_time();
+	TraceBuffer& buffer = get_thread_trace_buffer();
+
+	// Sequentially consistent, paired with close_trace(): either the trace
+	// sees this thread writing and waits, or this thread sees it closed
+	buffer.is_writing.store(true);
+	if (!is_trace_closed.load())
+	{
+		const uint64 index = buffer.num_written.load(std::memory_order_relaxed);
+		buffer.events[index % buffer.capacity] = { name, start, end - start, detail };
+		buffer.num_written.store(index + 1, std::memory_order_relaxed);
+	}
+	buffer.is_writing.store(false, std::memory_order_release);
+}
+
+static void write_json_string(std::ofstream& json, const char* text)
+{
+	json << '"';
+	for (const char* c = text; *c; c++)
+	{
+		if (*c == '"' || *c == '\\')
+		{
+			json << '\\';
+		}
+		json << *c;
+	}
+	json << '"';
+}
+
+/** Stops recording, and waits for the events being written to be done */
+static void close_trace()
+{
+	recorded_trace_detail.store(-1, std::memory_order_relaxed);
+	is_trace_closed.store(true);
+
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	for (const std::unique_ptr<TraceBuffer>& buffer : trace_buffers)
+	{
+		while (buffer->is_writing.load())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+static bool write_trace()
+{
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	const int64 origin = trace_frame_starts.empty() ? 0 : trace_frame_starts.front();
+
+	std::ofstream json(trace_options.filename);
+	json << std::fixed << std::setprecision(3);
+	json << "{\n";
+	json << "  \"displayTimeUnit\": \"ms\",\n";
+	json << "  \"traceEvents\": [\n";
+	json << "    { \"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": { \"name\": \"3drenderer\" } }";
+
+	for (size_t i = 0; i < trace_frame_starts.size(); i++)
+	{
+		json << ",\n    { \"name\": \"Frame " << trace_options.first_frame + (int)i << "\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 1, \"tid\": 0"
+			 << ", \"ts\": " << (double)(trace_frame_starts[i] - origin) / 1e3 << " }";
+	}
+
+	uint64 num_events = 0;
+	uint64 num_dropped = 0;
+	for (size_t tid = 0; tid < trace_buffers.size(); tid++)
+	{
+		const TraceBuffer& buffer = *trace_buffers[tid];
+		const uint64 num_written = buffer.num_written.load(std::memory_order_relaxed);
+		const uint64 first = num_written > buffer.capacity ? num_written - buffer.capacity : 0;
+		if (num_written == 0)
+		{
+			continue;
+		}
+
+		json << ",\n    { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid
+			 << ", \"args\": { \"name\": \"" << (buffer.is_main_thread ? "Main thread" : "Thread " + std::to_string(tid)) << "\" } }";
+		for (uint64 i = first; i < num_written; i++)
+		{
+			const TraceEvent& event = buffer.events[i % buffer.capacity];
+			json << ",\n    { \"name\": ";
+			write_json_string(json, event.name);
+			json << ", \"cat\": \"" << TRACE_DETAIL_NAMES[event.detail] << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+				 << ", \"ts\": " << (double)(event.start - origin) / 1e3 << ", \"dur\": " << (double)event.duration / 1e3 << " }";
+		}
+		num_events += num_written - first;
+		num_dropped += first;
+	}
+	json << "\n  ]\n";
+	json << "}\n";
+	if (!json)
+	{
+		std::cerr << "Failed to write " << trace_options.filename << ".\n";
+		return false;
+	}
+
+	std::cout << "Traced " << trace_frame_starts.size() << " frames, " << num_events << " events to " << trace_options.filename << ".\n";
+	if (num_dropped > 0)
+	{
+		std::cout << num_dropped << " older events were overwritten, trace fewer frames, at a lower detail or with a larger --trace-buffer to keep them.\n";
+	}
+	return true;
+}
+
+void start_trace(const TraceOptions& options)
+{
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	trace_options = options;
+	main_thread_id = std::this_thread::get_id();
+	trace_frame = 0;
+	is_trace_finished = options.filename.empty();
+}
+
+void begin_trace_frame()
+{
+	if (is_trace_finished)
+	{
+		return;
+	}
+
+	const int frame = trace_frame++;
+	if (frame == trace_options.first_frame + trace_options.num_frames)
+	{
+		finish_trace();
+		return;
+	}
+	if (frame == trace_options.first_frame)
+	{
+		recorded_trace_detail.store(trace_options.detail, std::memory_order_relaxed);
+	}
+	if (frame >= trace_options.first_frame)
+	{
+		trace_frame_starts.push_back(get_trace_time());
+	}
+}
+
+bool finish_trace()
+{
+	if (is_trace_finished)
+	{
+		return true;
+	}
+
+	// Zones still open on other threads end after the trace is closed, and
+	// are left out of it
+	close_trace();
+	is_trace_finished = true;
+	if (trace_frame_starts.empty())
+	{
+		std::cerr << "Failed to trace " << trace_options.filename << ", the run ended before frame " << trace_options.first_frame << ".\n";
+		return false;
+	}
+	return write_trace();
+}
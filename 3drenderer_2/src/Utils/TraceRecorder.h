@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include <tracy/tracy/Tracy.hpp>
+
+#include "3d_types.h"
+
+/**
+ * Records the Tracy zones into per-thread ring buffers and writes them as a
+ * Chrome trace (chrome://tracing, ui.perfetto.dev), for profiling without a
+ * Tracy server. Include this instead of Tracy.hpp: ZoneScoped and ZoneScopedN
+ * below open a Tracy zone and a recorded one under the same name. The zones of
+ * each triangle use ZoneScopedTriangle, and are only recorded at
+ * TRACE_DETAIL_TRIANGLE
+ */
+
+/** Zones at or below the detail of the trace are recorded */
+enum ETraceDetail
+{
+	TRACE_DETAIL_FUNCTION,
+	TRACE_DETAIL_TRIANGLE, // one zone per triangle drawn or clipped, many times the events
+	NUM_TRACE_DETAILS,
+};
+
+/** "function" or "triangle", also the category of the zones in the trace */
+bool parse_trace_detail(const std::string& name, ETraceDetail& detail);
+
+struct TraceOptions
+{
+	std::string filename; // nothing is recorded if empty
+	int first_frame = 0;
+	int num_frames = 5;
+	ETraceDetail detail = TRACE_DETAIL_FUNCTION;
+	int events_per_thread = 1 << 17; // the oldest are overwritten past that
+};
+
+/** Detail of the zones being recorded, -1 outside the traced frames */
+extern std::atomic<int> recorded_trace_detail;
+
+int64 get_trace_time();
+void add_trace_event(const char* name, int64 start, ETraceDetail detail);
+
+struct TraceZone
+{
+	TraceZone(const char* name_, ETraceDetail detail_)
+		: name(detail_ <= recorded_trace_detail.load(std::memory_order_relaxed) ? name_ : nullptr),
+		  detail(detail_),
+		  start(name ? get_trace_time() : 0)
+	{
+	}
+
+	~TraceZone()
+	{
+		if (name)
+		{
+			add_trace_event(name, start, detail);
+		}
+	}
+
+	const char* name;
+	ETraceDetail detail;
+	int64 start;
+};
+
+#undef ZoneScoped
+#undef ZoneScopedN
+#define ZoneScoped ZoneNamed(___tracy_scoped_zone, true); const TraceZone ___trace_zone(__FUNCTION__, TRACE_DETAIL_FUNCTION)
+#define ZoneScopedN(name) ZoneNamedN(___tracy_scoped_zone, name, true); const TraceZone ___trace_zone(name, TRACE_DETAIL_FUNCTION)
+#define ZoneScopedTriangle ZoneNamed(___tracy_scoped_zone, true); const TraceZone ___trace_zone(__FUNCTION__, TRACE_DETAIL_TRIANGLE)
+/** ZoneNamedN with the given detail, for more than one zone in a scope */
+#define ZoneNamedTraced(varname, name, detail) ZoneNamedN(varname, name, true); const TraceZone varname##_trace(name, detail)
+
+/** Records the frames in options once they are reached */
+void start_trace(const TraceOptions& options);
+/**
+ * Called at the start of every frame on the main thread. Starts recording at
+ * the first traced frame, and writes the trace after the last one
+ */
+void begin_trace_frame();
+/** Writes the trace if the run ended before the last traced frame */
+bool finish_trace();
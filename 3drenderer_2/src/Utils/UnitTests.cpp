@@ -0,0 +1,59 @@
+#include "UnitTests.h"
+
+#include <iostream>
+#include <vector>
+
+struct UnitTest
+{
+	const char* name;
+	UnitTestFunction function;
+};
+
+// Function local so it exists before the tests of other files register
+static std::vector<UnitTest>& get_unit_tests()
+{
+	static std::vector<UnitTest> tests;
+	return tests;
+}
+
+// Failed checks of the test running
+static int num_failed_checks = 0;
+
+int register_unit_test(const char* name, UnitTestFunction function)
+{
+	std::vector<UnitTest>& tests = get_unit_tests();
+	tests.push_back({ name, function });
+	return (int)tests.size() - 1;
+}
+
+void fail_unit_test_check(const char* condition, const char* file, int line)
+{
+	std::cerr << "  " << file << "(" << line << "): CHECK(" << condition << ") failed\n";
+	num_failed_checks++;
+}
+
+bool run_unit_tests(const std::string& filter)
+{
+	int num_run = 0;
+	int num_failed = 0;
+	for (const UnitTest& test : get_unit_tests())
+	{
+		if (!filter.empty() && std::string(test.name).find(filter) == std::string::npos)
+		{
+			continue;
+		}
+
+		std::cout << test.name << "\n";
+		num_failed_checks = 0;
+		test.function();
+		num_run++;
+		if (num_failed_checks > 0)
+		{
+			std::cout << "  FAILED\n";
+			num_failed++;
+		}
+	}
+
+	std::cout << num_run - num_failed << " of " << num_run << " tests passed\n";
+	return num_failed == 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+/**
+ * Checks of single modules, run with --test. The tests of each module sit next
+ * to it in a file of their own, as UNIT_TEST("name") { ... } blocks that
+ * register themselves before main() runs. CHECK(condition) reports the failed
+ * condition with its file and line and carries on, so one run shows every
+ * failure of a test
+ */
+
+using UnitTestFunction = void (*)();
+
+int register_unit_test(const char* name, UnitTestFunction function);
+void fail_unit_test_check(const char* condition, const char* file, int line);
+
+#define UNIT_TEST_NAME(prefix, line) prefix##line
+#define UNIT_TEST_AT(name, line) \
+	static void UNIT_TEST_NAME(unit_test_, line)(); \
+	static const int UNIT_TEST_NAME(unit_test_id_, line) = register_unit_test(name, UNIT_TEST_NAME(unit_test_, line)); \
+	static void UNIT_TEST_NAME(unit_test_, line)()
+#define UNIT_TEST(name) UNIT_TEST_AT(name, __LINE__)
+
+#define CHECK(condition) ((condition) ? (void)0 : fail_unit_test_check(#condition, __FILE__, __LINE__))
+
+/**
+ * Runs the tests whose name contains filter, all of them if it is empty.
+ * Returns false if any check failed
+ */
+bool run_unit_tests(const std::string& filter);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstring>
+
+#include <glm/vec3.hpp>
+
+#include "3d_types.h"
+
+/**
+ * Hashes a position by its exact bit pattern. Used for welding vertices of a
+ * triangle soup back together
+ */
+struct Vec3BitHash
+{
+	size_t operator()(const glm::vec3& p) const
+	{
+		uint32 bits[3];
+		memcpy(bits, &p, sizeof(bits));
+		return (size_t)bits[0] * 73856093u ^ (size_t)bits[1] * 19349663u
+			   ^ (size_t)bits[2] * 83492791u;
+	}
+};
@@ -0,0 +1,88 @@
+#include "image_io.h"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+bool save_ppm(const char* filename, const uint32* pixels, int width, int height)
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Failed to create " << filename << ".\n";
+		return false;
+	}
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	std::vector<uint8> row((size_t)width * 3);
+	for (int y = 0; y < height; y++)
+	{
+		const uint32* row_pixels = pixels + (size_t)y * width;
+		for (int x = 0; x < width; x++)
+		{
+			row[x * 3 + 0] = (uint8)(row_pixels[x] >> 16);
+			row[x * 3 + 1] = (uint8)(row_pixels[x] >> 8);
+			row[x * 3 + 2] = (uint8)row_pixels[x];
+		}
+		file.write((const char*)row.data(), (std::streamsize)row.size());
+	}
+
+	if (!file)
+	{
+		std::cerr << "Failed to write " << filename << ".\n";
+		return false;
+	}
+	return true;
+}
+
+/** Next number of the header, skipping whitespace and comments */
+static bool read_header_value(std::istream& file, int& value)
+{
+	while (true)
+	{
+		file >> std::ws;
+		if (file.peek() != '#')
+		{
+			break;
+		}
+		std::string comment;
+		std::getline(file, comment);
+	}
+	return (bool)(file >> value);
+}
+
+bool load_ppm(const char* filename, std::vector<uint32>& pixels, int& width, int& height)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	std::string magic;
+	int max_value;
+	file >> magic;
+	if (magic != "P6" || !read_header_value(file, width) || !read_header_value(file, height)
+		|| !read_header_value(file, max_value) || width <= 0 || height <= 0 || max_value != 255)
+	{
+		std::cerr << filename << " isn't an 8 bit binary PPM image.\n";
+		return false;
+	}
+	// A single whitespace character separates the header from the pixels
+	file.get();
+
+	std::vector<uint8> data((size_t)width * height * 3);
+	file.read((char*)data.data(), (std::streamsize)data.size());
+	if (!file)
+	{
+		std::cerr << "Failed to read " << filename << ".\n";
+		return false;
+	}
+
+	pixels.resize((size_t)width * height);
+	for (size_t i = 0; i < pixels.size(); i++)
+	{
+		pixels[i] = 0xFF000000 | ((uint32)data[i * 3] << 16) | ((uint32)data[i * 3 + 1] << 8) | data[i * 3 + 2];
+	}
+	return true;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <vector>
+
+#include "3d_types.h"
+
+/** Binary PPM images (P6, 8 bits per channel), ARGB8888 pixels with the top row first */
+bool save_ppm(const char* filename, const uint32* pixels, int width, int height);
+/** Alpha is set to 0xFF. Returns false if the file can't be read or isn't a binary PPM */
+bool load_ppm(const char* filename, std::vector<uint32>& pixels, int& width, int& height);
@@ -1,14 +1,24 @@
 #include "World.h"
 
-#include <tracy/tracy/Tracy.hpp>
+#include <algorithm>
+#include <thread>
+
+#include <glm/matrix.hpp>
+#include <omp.h>
 
 #include "../Logger/Logger.h"
 #include "../Math/Math3D.h"
 #include "../Viewport/Viewport.h"
+#include "../Utils/CycleCounters.h"
+#include "../Utils/FrameTimings.h"
+#include "../Utils/PipelineStats.h"
+#include "../Utils/TraceRecorder.h"
 #include "../Utils/string_ops.h"
 
-void World::load_level(const std::unique_ptr<Viewport>& viewport)
+void World::load_level(const std::unique_ptr<Viewport>& viewport_)
 {
+	viewport = viewport_.get();
+
 	// TODO: Set the starting camera/light params. Load the starting mesh
 	// Set the camera position
 	camera.translation = glm::vec3(0.0f, 8.0f, 15.0f);
@@ -33,98 +43,497 @@ void World::load_level(const std::unique_ptr<Viewport>& viewport)
 	light.rotation = rot3(0.0f, 0.0f, 0.0f);
 	light.intensity = 1.0f;
 
-	// Load the starting mesh
-	std::unique_ptr<Mesh> mesh = create_mesh("assets/models/robot/robot.obj");
+	virtual_textures.initialize(texture_page_budget);
+	asset_loader.initialize(num_asset_loaders);
+	placeholder_mesh = create_placeholder_mesh();
 
-	// Add the mesh to the array of meshes
+	// Place the starting mesh in the world. The first frames draw a box in its
+	// place while it loads
+	const int robot = spawn_async("assets/models/robot/robot.obj");
+	crowd_size = 1;
+	attach_gizmo(robot);
+}
+
+void World::add_mesh(std::unique_ptr<Mesh> mesh)
+{
+	for (const std::shared_ptr<Texture>& texture : mesh->textures)
+	{
+		virtual_textures.add_texture(texture);
+	}
 	meshes.push_back(std::move(mesh));
 }
 
-void World::update()
+int World::spawn_async(const char* filename, glm::vec3 translation, rot3 rotation)
+{
+	const int handle = asset_loader.load_mesh(filename, texture_options);
+	const int entity = entities.create(placeholder_mesh.get(), translation, rotation);
+	loading_entities.emplace_back(handle, entity);
+	return entity;
+}
+
+void World::swap_in_loaded_meshes()
 {
 	ZoneScoped; // for tracy
 
-	// Update the position and rotation of the camera
-	camera.update();
-	// Update the view matrix
-	camera.set_view();
-	// Update the position and rotation of the light
-	light.update();
+	std::vector<std::unique_ptr<MeshRequest>> loaded;
+	asset_loader.collect(loaded);
+	if (loaded.empty())
+	{
+		return;
+	}
+
+	// Point the entities waiting on each mesh at it. Meshes that failed to
+	// load leave their entities hidden
+	for (std::unique_ptr<MeshRequest>& request : loaded)
+	{
+		for (const std::pair<int, int>& loading : loading_entities)
+		{
+			if (loading.first == request->handle)
+			{
+				entities.set_mesh(loading.second, request->mesh.get());
+			}
+		}
+		if (request->mesh)
+		{
+			add_mesh(std::move(request->mesh));
+		}
+	}
+
+	loading_entities.erase(
+		std::remove_if(loading_entities.begin(), loading_entities.end(),
+			[this](const std::pair<int, int>& loading) { return asset_loader.get_state(loading.first) != ASSET_LOADING; }),
+		loading_entities.end()
+	);
+}
+
+int World::spawn_streamed(const char* filename, glm::vec3 translation, rot3 rotation)
+{
+	StreamedMesh streamed;
+	streamed.mesh = std::make_unique<ChunkedMesh>();
+	streamed.mesh->open(filename, texture_options);
+	streamed.entity = entities.create(nullptr, translation, rotation);
+	streamed_meshes.push_back(std::move(streamed));
+	return streamed_meshes.back().entity;
+}
+
+void World::update_streamed_meshes()
+{
+	ZoneScoped; // for tracy
+
+	for (StreamedMesh& streamed : streamed_meshes)
+	{
+		ChunkedMesh& mesh = *streamed.mesh;
+		mesh.memory_budget = (size_t)streaming_budget_mb << 20;
+		mesh.update(entities.get_transform(streamed.entity), camera, viewport->height, lod_error_threshold, lod_hysteresis);
+		if (mesh.state != ASSET_READY)
+		{
+			continue;
+		}
 
-	const glm::vec3 scale(1.0f);
-	const rot3 rotation(0.0f, x, 0.0f);
-	//const glm::vec3 translation(0.0f, 0.0f, 0.0f);
+		// The chunks get their entities once the mesh is open. They stay
+		// hidden until a level of theirs is in memory
+		if (streamed.chunk_entities.empty())
+		{
+			for (const std::shared_ptr<Texture>& texture : mesh.textures)
+			{
+				virtual_textures.add_texture(texture);
+			}
+			for (size_t i = 0; i < mesh.chunks.size(); i++)
+			{
+				streamed.chunk_entities.push_back(
+					entities.create(nullptr, glm::vec3(0.0f), rot3(0.0f), glm::vec3(1.0f), Colors::WHITE, streamed.entity)
+				);
+			}
+		}
+
+		for (size_t i = 0; i < mesh.chunks.size(); i++)
+		{
+			const int entity = streamed.chunk_entities[i];
+			Mesh* chunk_mesh = mesh.chunks[i].mesh.get();
+			if (entities.meshes[entity] != chunk_mesh)
+			{
+				entities.set_mesh(entity, chunk_mesh);
+			}
+		}
+	}
+}
+
+bool World::load_world(const char* filename)
+{
+	spawn_crowd(nullptr, 0);
+	world_streamer.texture_options = texture_options;
+	if (!world_streamer.load(filename, num_asset_loaders))
+	{
+		return false;
+	}
+	world_streamer.create_entities(entities);
+	return true;
+}
+
+void World::wait_for_assets()
+{
+	asset_loader.wait();
+	swap_in_loaded_meshes();
+}
+
+// Colors the entities of a crowd cycle through
+constexpr uint32 CROWD_TINTS[] = {
+	Colors::WHITE,
+	0xFFFF8080,
+	0xFF80FF80,
+	0xFF8080FF,
+	0xFFFFFF80,
+	0xFF80FFFF,
+	0xFFFF80FF,
+};
+constexpr int NUM_CROWD_TINTS = sizeof(CROWD_TINTS) / sizeof(CROWD_TINTS[0]);
+
+void World::spawn_crowd(Mesh* mesh, int count)
+{
+	entities.clear();
+	loading_entities.clear();
+	streamed_meshes.clear();
+	world_streamer.destroy();
+	gizmo_entity = -1;
+	crowd_size = 0;
+	if (!mesh || count <= 0)
+	{
+		return;
+	}
+	crowd_size = count;
 
-	for (const std::unique_ptr<Mesh>& mesh : meshes)
+	// Lay the entities out on a square grid that starts at the origin and
+	// extends away from the starting camera position
+	const int columns = (int)ceilf(sqrtf((float)count));
+	const float spacing = std::max(mesh->bounds_radius * 2.0f, 1.0f);
+	for (int i = 0; i < count; i++)
 	{
-		mesh->scale = scale;
-		mesh->rotate(rotation);
-		mesh->update();
-		modelview_matrix = camera.view_matrix * mesh->transform;
-		transform_gizmo();
-		transform_mesh(mesh.get()); // Passing the raw pointer
+		const int row = i / columns;
+		const int column = i % columns;
+		const glm::vec3 translation(
+			((float)column - (float)(columns - 1) * 0.5f) * spacing,
+			0.0f,
+			-(float)row * spacing
+		);
+		// Vary the rotation so the crowd doesn't all face the same way
+		const rot3 rotation(0.0f, (float)((i * 37) % 360), 0.0f);
+		entities.create(mesh, translation, rotation, glm::vec3(1.0f), CROWD_TINTS[i % NUM_CROWD_TINTS]);
 	}
 
-	transform_light_direction_vector();
+	attach_gizmo(0);
 }
 
-// NOTE: The raw pointers will not be managed after being created, so make sure
-// not to access them after the unique_ptr goes out of scope!
-void World::transform_mesh(Mesh* mesh)
+void World::attach_gizmo(int parent)
 {
-	// Line segments for computing the face normal
-	glm::vec3 ab, ca;
+	// The gizmo has no mesh, it only borrows the transform of its parent
+	gizmo_entity = entities.create(nullptr, glm::vec3(0.0f), rot3(0.0f), glm::vec3(1.0f), Colors::WHITE, parent);
+}
 
-	// Loop over all the triangles in the mesh
-	for (const Triangle& triangle : mesh->triangles)
+void World::update()
+{
+	ZoneScoped; // for tracy
+
+	// Replace the placeholders of the meshes that finished loading, swap in
+	// the chunks and cells needed from where the camera was last frame, then
+	// stream in the texture pages the last frame was missing
 	{
-		/* Local space */
-		Triangle transformed_triangle = triangle;
+		StageTimer timer(FRAME_STAGE_STREAMING);
+		swap_in_loaded_meshes();
+		update_streamed_meshes();
+		world_streamer.update(camera.translation, entities, virtual_textures);
+		virtual_textures.update();
+	}
 
-		// Compute the face normal of the triangle
-		ab = glm::vec3(transformed_triangle.vertices[1].position - transformed_triangle.vertices[0].position);
-		ca = glm::vec3(transformed_triangle.vertices[2].position - transformed_triangle.vertices[0].position);
-		glm::vec3 face_normal = glm::cross(ab, ca);
-		face_normal = glm::normalize(face_normal);
+	{
+		StageTimer timer(FRAME_STAGE_CULLING);
+
+		// Update the position and rotation of the camera
+		camera.update();
+		// Update the view matrix
+		camera.set_view();
+		// Update the position and rotation of the light
+		light.update();
 
-		// Rotate the face normal
-		Math3D::rotate_normal(face_normal, mesh->transform);
-		transformed_triangle.face_normal = face_normal;
+		// Only rebuilds the matrices of entities that moved
+		entities.update_transforms();
 
-		for (Vertex& vertex : transformed_triangle.vertices)
+		// Flag the entities whose bounds touch the view frustum
+		glm::vec4 frustum_planes[6];
+		extract_frustum_planes(camera.vp_matrix, frustum_planes);
+		entities.cull(frustum_planes);
+
+		constexpr uint8 DRAW_FLAGS = RENDER_FLAG_VISIBLE | RENDER_FLAG_IN_VIEW;
+		const int num_entities = entities.size();
+		visible_entities.clear();
+		for (int i = 0; i < num_entities; i++)
 		{
-			// Transform the vertices by the model matrix
-			Math3D::transform_point(vertex.position, mesh->transform);
-			// Rotate the vertex normals by the model matrix
-			Math3D::rotate_normal(vertex.normal, mesh->transform);
+			if ((entities.render_flags[i] & DRAW_FLAGS) == DRAW_FLAGS)
+			{
+				select_lod(i);
+				visible_entities.push_back(i);
+			}
 		}
 
-		/* World space */
-		compute_light_intensity(transformed_triangle);
+		if (gizmo_entity >= 0)
+		{
+			modelview_matrix = camera.view_matrix * entities.get_transform(gizmo_entity);
+			transform_gizmo();
+		}
+	}
 
-		for (Vertex& vertex : transformed_triangle.vertices)
+	{
+		StageTimer timer(FRAME_STAGE_GEOMETRY);
+		transform_entities();
+		transform_light_direction_vector();
+	}
+}
+
+void World::select_lod(int entity)
+{
+	const Mesh* mesh = entities.meshes[entity];
+
+	// The bounding sphere of the mesh in world space. Its radius has been
+	// scaled by the largest scale factor of the entity and its ancestors
+	const glm::vec3 center = entities.get_bounds_center(entity);
+	const float radius = entities.radius[entity];
+	const float max_scale = entities.local_radius[entity] > 0.0f ? radius / entities.local_radius[entity] : 1.0f;
+
+	// Work out how many pixels one world unit covers at the distance of the
+	// closest point on the bounding sphere
+	float pixels_per_unit;
+	if (camera.projection_mode & ORTHOGRAPHIC)
+	{
+		pixels_per_unit = (float)viewport->height / (2.0f * camera.ortho_dist);
+	}
+	else
+	{
+		const float distance = std::max(glm::length(center - camera.translation) - radius, camera.znear);
+		const float half_fov = glm::radians(camera.fov) * 0.5f;
+		pixels_per_unit = (float)viewport->height / (2.0f * tanf(half_fov) * distance);
+	}
+
+	// Find the coarsest levels (a higher index is coarser) whose error stays
+	// under the threshold, and under the threshold tightened by the hysteresis
+	int coarsest_within_threshold = 0;
+	int coarsest_within_hysteresis = 0;
+	for (int i = 1; i < mesh->num_lods(); i++)
+	{
+		const float error = mesh->get_lod_error(i) * max_scale * pixels_per_unit;
+		if (error <= lod_error_threshold)
+		{
+			coarsest_within_threshold = i;
+		}
+		if (error <= lod_error_threshold * (1.0f - lod_hysteresis))
+		{
+			coarsest_within_hysteresis = i;
+		}
+	}
+
+	// Only switch levels once we've crossed the threshold on either side: go
+	// finer as soon as the current level is over the threshold, and coarser
+	// only once a coarser level is well under it
+	int& current_lod = entities.current_lod[entity];
+	if (current_lod > coarsest_within_threshold)
+	{
+		current_lod = coarsest_within_threshold;
+	}
+	else if (current_lod < coarsest_within_hysteresis)
+	{
+		current_lod = coarsest_within_hysteresis;
+	}
+}
+
+// Entities with the same mesh are transformed this many at a time, so that
+// each meshlet is read once per batch and stays in the cache for all of them
+constexpr int ENTITIES_PER_BATCH = 16;
+
+void World::transform_entities()
+{
+	ZoneScoped; // for tracy
+
+	// Group the entities by the triangles they will read
+	std::sort(
+		visible_entities.begin(),
+		visible_entities.end(),
+		[this](int a, int b)
+		{
+			if (entities.meshes[a] != entities.meshes[b])
+			{
+				return entities.meshes[a] < entities.meshes[b];
+			}
+			return entities.current_lod[a] < entities.current_lod[b];
+		}
+	);
+
+	// Split the groups up into batches
+	std::vector<std::pair<int, int>> batches; // first entity, entity count
+	const int num_visible = (int)visible_entities.size();
+	int first = 0;
+	while (first < num_visible)
+	{
+		const int head = visible_entities[first];
+		int count = 1;
+		while (count < ENTITIES_PER_BATCH && first + count < num_visible)
 		{
-			// Transform the vertices by the concatenated view-projection matrix
-			Math3D::transform_point(vertex.position, camera.vp_matrix);
-			// Rotate the vertex normals by the concatenated view-projection matrix
-			Math3D::rotate_normal(vertex.normal, camera.vp_matrix);
+			const int next = visible_entities[first + count];
+			if (entities.meshes[next] != entities.meshes[head]
+				|| entities.current_lod[next] != entities.current_lod[head])
+			{
+				break;
+			}
+			count++;
 		}
+		batches.emplace_back(first, count);
+		first += count;
+	}
 
-		/* Clip space */
-		// Add the transformed triangle to the bin of triangles to be rendered
-		triangles_in_scene.push_back(transformed_triangle);
+	const int num_threads = (int)(std::thread::hardware_concurrency() / 2) + 1;
+	thread_triangles.resize(num_threads);
+	for (std::vector<Triangle>& triangles : thread_triangles)
+	{
+		triangles.clear();
+	}
+
+	const int num_batches = (int)batches.size();
+	int frustum_culled = 0;
+	int backface_culled = 0;
+
+// Same thread count as the rasterizer. Batches vary a lot in size with the
+// level of detail, so hand them out dynamically
+#pragma omp parallel for \
+	num_threads(num_threads) \
+	schedule(dynamic, 1) \
+	reduction(+ : frustum_culled, backface_culled)
+	for (int i = 0; i < num_batches; i++)
+	{
+		transform_batch(
+			&visible_entities[batches[i].first],
+			batches[i].second,
+			thread_triangles[omp_get_thread_num()],
+			frustum_culled,
+			backface_culled
+		);
+	}
+
+	// Gather the results of every thread into the bin of triangles to be
+	// rendered
+	for (const std::vector<Triangle>& triangles : thread_triangles)
+	{
+		triangles_in_scene.insert(triangles_in_scene.end(), triangles.begin(), triangles.end());
+	}
+
+	Logger::print(LOG_CATEGORY_CLIPPING, "Entities: " + std::to_string(visible_entities.size())
+		+ "/" + std::to_string(entities.size()) + " in view");
+	Logger::print(LOG_CATEGORY_CLIPPING, "Meshlets frustum culled: " + std::to_string(frustum_culled)
+		+ ", backface culled: " + std::to_string(backface_culled));
+}
+
+void World::transform_batch(
+	const int* batch,
+	int batch_size,
+	std::vector<Triangle>& out_triangles,
+	int& frustum_culled,
+	int& backface_culled
+) const
+{
+	ZoneScoped; // for tracy
+	TIMED_BLOCK("Transform batch");
+
+	// Every entity in the batch shares the same mesh and level of detail
+	const Mesh* mesh = entities.meshes[batch[0]];
+	const int lod = entities.current_lod[batch[0]];
+	const std::vector<Triangle>& triangles = mesh->get_lod_triangles(lod);
+	const std::vector<Meshlet>& meshlets = mesh->get_lod_meshlets(lod);
+
+	// Cull in object space so the meshlet bounds don't need transforming
+	glm::mat4 transforms[ENTITIES_PER_BATCH];
+	glm::vec4 frustum_planes[ENTITIES_PER_BATCH][6];
+	glm::vec3 camera_positions[ENTITIES_PER_BATCH];
+	for (int k = 0; k < batch_size; k++)
+	{
+		transforms[k] = entities.get_transform(batch[k]);
+		extract_frustum_planes(camera.vp_matrix * transforms[k], frustum_planes[k]);
+		camera_positions[k] = glm::vec3(glm::inverse(transforms[k]) * glm::vec4(camera.translation, 1.0f));
+	}
+
+	// The cone test assumes the view rays converge on the camera position,
+	// which doesn't hold for an orthographic projection
+	const bool cone_culling = backface_culling && (camera.projection_mode & PERSPECTIVE);
+
+	PipelineStats& stats = get_thread_pipeline_stats();
+	for (const Meshlet& meshlet : meshlets)
+	{
+		for (int k = 0; k < batch_size; k++)
+		{
+			stats.counters[PIPELINE_TRIANGLES_SUBMITTED] += meshlet.triangle_count;
+			if (is_sphere_outside_frustum(meshlet.center, meshlet.radius, frustum_planes[k]))
+			{
+				stats.counters[PIPELINE_TRIANGLES_FRUSTUM_CULLED] += meshlet.triangle_count;
+				frustum_culled++;
+				continue;
+			}
+			if (cone_culling && is_meshlet_backfacing(meshlet, camera_positions[k]))
+			{
+				stats.counters[PIPELINE_TRIANGLES_BACKFACE_CULLED] += meshlet.triangle_count;
+				backface_culled++;
+				continue;
+			}
+
+			// Loop over all the triangles in the meshlet
+			const uint32 tint = entities.tints[batch[k]];
+			for (int i = meshlet.triangle_offset; i < meshlet.triangle_offset + meshlet.triangle_count; i++)
+			{
+				out_triangles.push_back(triangles[i]);
+				transform_triangle(out_triangles.back(), transforms[k], tint);
+			}
+		}
+	}
+}
+
+void World::transform_triangle(Triangle& triangle, const glm::mat4& transform, uint32 tint) const
+{
+	/* Local space */
+	// Compute the face normal of the triangle
+	const glm::vec3 ab = glm::vec3(triangle.vertices[1].position - triangle.vertices[0].position);
+	const glm::vec3 ca = glm::vec3(triangle.vertices[2].position - triangle.vertices[0].position);
+	glm::vec3 face_normal = glm::cross(ab, ca);
+	face_normal = glm::normalize(face_normal);
+
+	// Rotate the face normal
+	Math3D::rotate_normal(face_normal, transform);
+	triangle.face_normal = face_normal;
+	triangle.color = tint;
+
+	for (Vertex& vertex : triangle.vertices)
+	{
+		// Transform the vertices by the model matrix
+		Math3D::transform_point(vertex.position, transform);
+		// Rotate the vertex normals by the model matrix
+		Math3D::rotate_normal(vertex.normal, transform);
+	}
+
+	/* World space */
+	compute_light_intensity(triangle);
+
+	for (Vertex& vertex : triangle.vertices)
+	{
+		// Transform the vertices by the concatenated view-projection matrix
+		Math3D::transform_point(vertex.position, camera.vp_matrix);
+		// Rotate the vertex normals by the concatenated view-projection matrix
+		Math3D::rotate_normal(vertex.normal, camera.vp_matrix);
 	}
 }
 
 void World::transform_gizmo()
 {
-	for (Line3D& basis : gizmo.bases)
+	for (const Line3D& basis : gizmo.bases)
 	{
-		for (glm::vec4& point : basis.points)
+		Line3D line = basis;
+		for (glm::vec4& point : line.points)
 		{
 			Math3D::transform_point(point, modelview_matrix);
 		}
-		lines_in_scene.push_back(basis);
+		lines_in_scene.push_back(line);
 	}
 }
 
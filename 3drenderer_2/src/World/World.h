@@ -5,38 +5,140 @@
 
 #include <glm/mat4x4.hpp>
 
+#include "WorldStreamer.h"
 #include "../Camera/Camera.h"
+#include "../Entity/EntityStore.h"
 #include "../Light/Light.h"
+#include "../Mesh/AssetLoader.h"
+#include "../Mesh/ChunkedMesh.h"
 #include "../Mesh/Gizmo.h"
 #include "../Mesh/Mesh.h"
+#include "../Mesh/VirtualTextureCache.h"
 #include "../Triangle/Triangle.h"
 
 struct Line3D;
 struct Viewport;
 struct Triangle;
 
+/** A chunked mesh placed in the world, with an entity for each of its chunks */
+struct StreamedMesh
+{
+	std::unique_ptr<ChunkedMesh> mesh;
+	int entity; // places the whole mesh, the chunk entities are attached to it
+	std::vector<int> chunk_entities; // empty until the mesh is open
+};
+
 struct World
 {
-	void load_level(const std::unique_ptr<Viewport>& viewport);
+	void load_level(const std::unique_ptr<Viewport>& viewport_);
 	void update();
 
+	Viewport* viewport;
+
 	Camera camera;
-	std::vector<std::unique_ptr<Mesh>> meshes; // triangles
+	std::vector<std::unique_ptr<Mesh>> meshes; // shared geometry
+	EntityStore entities; // placements of the meshes
 	/**
 	 * The x axis of the gizmo is drawn in yellow. The y axis is drawn in
 	 * magenta, and the z axis cyan.
 	 */
 	Gizmo gizmo; // three lines
+	int gizmo_entity = -1; // places the gizmo, attached to another entity
+	int crowd_size = 0; // number of mesh entities spawned
 	Light light; // one line
 
+	/**
+	 * Entities that survived frustum culling this frame, sorted so that
+	 * entities with the same mesh and level of detail sit next to each other
+	 */
+	std::vector<int> visible_entities;
+	// Triangles transformed by each thread of the geometry stage
+	std::vector<std::vector<Triangle>> thread_triangles;
+
 	std::vector<Triangle> triangles_in_scene;
 	std::vector<Line3D> lines_in_scene;
 
 	glm::mat4 modelview_matrix;
 
-	float x = 0.1f;
+	/**
+	 * Maximum error, in pixels, a level of detail may introduce on screen
+	 * before a finer level gets picked. Switching down to a coarser level
+	 * requires the error to drop below lod_error_threshold * (1 -
+	 * lod_hysteresis), so meshes sitting on the boundary between two levels
+	 * don't flicker back and forth between them
+	 */
+	float lod_error_threshold = 2.0f;
+	float lod_hysteresis = 0.25f;
+
+	// Skip meshlets whose normal cone faces away from the camera
+	bool backface_culling = true;
+
+	// Applied to every texture loaded with a mesh
+	TextureLoadOptions texture_options = { TEXTURE_FORMAT_ARGB8888, true };
+
+	/**
+	 * Pages of the virtual textures kept in memory, 64 KB each. Textures
+	 * loaded as virtual textures only hold their small levels in memory
+	 * otherwise
+	 */
+	int texture_page_budget = 256;
+	VirtualTextureCache virtual_textures;
+
+	/**
+	 * Meshes load on this many background threads. Entities spawned with
+	 * spawn_async() draw placeholder_mesh until their mesh is swapped in at the
+	 * start of a frame
+	 */
+	int num_asset_loaders = 2;
+	AssetLoader asset_loader;
+	std::unique_ptr<Mesh> placeholder_mesh;
+	std::vector<std::pair<int, int>> loading_entities; // asset handle, entity
+
+	/**
+	 * Meshes too large to keep in memory, streamed in a chunk at a time. Each
+	 * of them keeps at most streaming_budget_mb of chunks in memory
+	 */
+	int streaming_budget_mb = 512;
+	std::vector<StreamedMesh> streamed_meshes;
+
+	// Loads and unloads the cells of a large world around the camera
+	WorldStreamer world_streamer;
+
+	void add_mesh(std::unique_ptr<Mesh> mesh);
+	/** Places a mesh that is still to be loaded, returns the entity */
+	int spawn_async(
+		const char* filename,
+		glm::vec3 translation = glm::vec3(0.0f),
+		rot3 rotation = rot3(0.0f)
+	);
+	void swap_in_loaded_meshes();
+	/** Places a mesh that is streamed in chunks, returns the entity */
+	int spawn_streamed(
+		const char* filename,
+		glm::vec3 translation = glm::vec3(0.0f),
+		rot3 rotation = rot3(0.0f)
+	);
+	void update_streamed_meshes();
+	/**
+	 * Replaces the entities with the placements of a world description, see
+	 * WorldStreamer. Returns false if it can't be read
+	 */
+	bool load_world(const char* filename);
+	/** Blocks until every mesh has loaded and been swapped in */
+	void wait_for_assets();
+	void spawn_crowd(Mesh* mesh, int count);
+	void attach_gizmo(int parent);
 
-	void transform_mesh(Mesh* mesh);
+	void select_lod(int entity);
+	void transform_entities();
+	void transform_batch(
+		const int* batch,
+		int batch_size,
+		std::vector<Triangle>& out_triangles,
+		int& frustum_culled,
+		int& backface_culled
+	) const;
+	void transform_triangle(Triangle& triangle, const glm::mat4& transform, uint32 tint) const;
 	void transform_gizmo();
 	void transform_light_direction_vector();
 	void compute_light_intensity(Triangle& transformed_triangle) const;
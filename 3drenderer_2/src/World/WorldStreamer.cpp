@@ -0,0 +1,301 @@
+#include "WorldStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <glm/geometric.hpp>
+
+#include "../Entity/EntityStore.h"
+#include "../Mesh/Mesh.h"
+#include "../Mesh/VirtualTextureCache.h"
+#include "../Triangle/Triangle.h"
+#include "../Utils/TraceRecorder.h"
+
+/** Geometry and textures of the mesh. Textures shared with other meshes count for each of them */
+static size_t get_mesh_size(const Mesh& mesh)
+{
+	size_t size = mesh.triangles.size() * sizeof(Triangle) + mesh.meshlets.size() * sizeof(Meshlet);
+	for (const MeshLOD& lod : mesh.lods)
+	{
+		size += lod.triangles.size() * sizeof(Triangle) + lod.meshlets.size() * sizeof(Meshlet);
+	}
+	for (const std::shared_ptr<Texture>& texture : mesh.textures)
+	{
+		size += texture ? texture->memory_size : 0;
+	}
+	return size;
+}
+
+bool WorldStreamer::load(const char* filename_, int num_threads)
+{
+	destroy();
+
+	std::ifstream file(filename_);
+	if (!file)
+	{
+		std::cerr << "Failed to open the world " << filename_ << ".\n";
+		return false;
+	}
+	filename = filename_;
+
+	std::string line;
+	int line_number = 0;
+	while (std::getline(file, line))
+	{
+		line_number++;
+		std::istringstream stream(line);
+		std::string keyword;
+		if (!(stream >> keyword) || keyword[0] == '#')
+		{
+			continue;
+		}
+
+		if (keyword == "cell_size")
+		{
+			stream >> cell_size;
+		}
+		else if (keyword == "mesh")
+		{
+			CellPlacement placement;
+			placement.rotation = rot3(0.0f);
+			stream >> placement.filename >> placement.translation.x >> placement.translation.y >> placement.translation.z;
+			if (!stream)
+			{
+				std::cerr << filename << ":" << line_number << ": expected a file and a position.\n";
+				continue;
+			}
+			// The rotation is optional
+			float pitch, yaw, roll;
+			if (stream >> pitch >> yaw >> roll)
+			{
+				placement.rotation = rot3(pitch, yaw, roll);
+			}
+			placements.push_back(placement);
+		}
+		else
+		{
+			std::cerr << filename << ":" << line_number << ": unknown keyword " << keyword << ".\n";
+		}
+	}
+	cell_size = std::max(cell_size, 1.0f);
+
+	// Sort the placements into the cells of the grid
+	std::unordered_map<int64, int> cell_indices;
+	for (int i = 0; i < (int)placements.size(); i++)
+	{
+		const glm::vec3& translation = placements[i].translation;
+		const int x = (int)floorf(translation.x / cell_size);
+		const int z = (int)floorf(translation.z / cell_size);
+		const int64 key = ((int64)x << 32) | (uint32)z;
+		const auto [it, is_new] = cell_indices.emplace(key, (int)cells.size());
+		if (is_new)
+		{
+			WorldCell cell;
+			cell.min = glm::vec2((float)x, (float)z) * cell_size;
+			cell.max = cell.min + cell_size;
+			cells.push_back(cell);
+		}
+		cells[it->second].placements.push_back(i);
+	}
+
+	std::cout << "Loaded the world " << filename << ": " << placements.size() << " meshes in " << cells.size() << " cells\n";
+
+	asset_loader.initialize(num_threads);
+	return true;
+}
+
+void WorldStreamer::destroy()
+{
+	asset_loader.destroy();
+	placements.clear();
+	cells.clear();
+	assets.clear();
+	filename.clear();
+	num_loaded = 0;
+	num_loading = 0;
+	used_bytes = 0;
+}
+
+void WorldStreamer::create_entities(EntityStore& entities)
+{
+	for (CellPlacement& placement : placements)
+	{
+		placement.entity = entities.create(nullptr, placement.translation, placement.rotation);
+	}
+}
+
+void WorldStreamer::acquire_asset(const std::string& asset_filename)
+{
+	StreamedAsset& asset = assets[asset_filename];
+	if (asset.users == 0 && asset.handle < 0)
+	{
+		asset.handle = asset_loader.load_mesh(asset_filename.c_str(), texture_options);
+	}
+	asset.users++;
+}
+
+void WorldStreamer::release_asset(const std::string& asset_filename)
+{
+	const auto it = assets.find(asset_filename);
+	StreamedAsset& asset = it->second;
+	asset.users--;
+
+	// A mesh still loading is dropped once it arrives
+	if (asset.users == 0 && asset.state != ASSET_LOADING)
+	{
+		used_bytes -= asset.memory_size;
+		assets.erase(it);
+	}
+}
+
+void WorldStreamer::unload_cell(WorldCell& cell, EntityStore& entities)
+{
+	for (const int i : cell.placements)
+	{
+		entities.set_mesh(placements[i].entity, nullptr);
+	}
+	for (const int i : cell.placements)
+	{
+		release_asset(placements[i].filename);
+	}
+
+	if (cell.state == CELL_LOADED)
+	{
+		num_loaded--;
+	}
+	else
+	{
+		num_loading--;
+	}
+	cell.state = CELL_UNLOADED;
+}
+
+void WorldStreamer::update(glm::vec3 camera_position, EntityStore& entities, VirtualTextureCache& virtual_textures)
+{
+	ZoneScoped; // for tracy
+
+	if (cells.empty())
+	{
+		return;
+	}
+
+	// Take over the meshes that finished loading
+	std::vector<std::unique_ptr<MeshRequest>> loaded;
+	asset_loader.collect(loaded);
+	for (std::unique_ptr<MeshRequest>& request : loaded)
+	{
+		const auto it = assets.find(request->filename);
+		if (it == assets.end() || it->second.handle != request->handle)
+		{
+			continue;
+		}
+		StreamedAsset& asset = it->second;
+		asset.state = request->mesh ? ASSET_READY : ASSET_FAILED;
+		if (asset.users == 0)
+		{
+			assets.erase(it);
+			continue;
+		}
+		if (request->mesh)
+		{
+			for (const std::shared_ptr<Texture>& texture : request->mesh->textures)
+			{
+				virtual_textures.add_texture(texture);
+			}
+			asset.mesh = std::move(request->mesh);
+			asset.memory_size = get_mesh_size(*asset.mesh);
+			used_bytes += asset.memory_size;
+		}
+	}
+
+	// Show the cells whose meshes are all in. Placements whose mesh failed
+	// to load stay hidden
+	for (WorldCell& cell : cells)
+	{
+		if (cell.state != CELL_LOADING)
+		{
+			continue;
+		}
+		const bool is_loading = std::any_of(cell.placements.begin(), cell.placements.end(),
+			[this](int i) { return assets[placements[i].filename].state == ASSET_LOADING; });
+		if (is_loading)
+		{
+			continue;
+		}
+
+		std::vector<const StreamedAsset*> cell_assets;
+		for (const int i : cell.placements)
+		{
+			const StreamedAsset& asset = assets[placements[i].filename];
+			entities.set_mesh(placements[i].entity, asset.mesh.get());
+			if (std::find(cell_assets.begin(), cell_assets.end(), &asset) == cell_assets.end())
+			{
+				cell_assets.push_back(&asset);
+			}
+		}
+		cell.memory_size = 0;
+		for (const StreamedAsset* asset : cell_assets)
+		{
+			cell.memory_size += asset->memory_size;
+		}
+		cell.state = CELL_LOADED;
+		num_loading--;
+		num_loaded++;
+	}
+
+	// Distance from the camera to the square of each cell
+	const glm::vec2 camera_xz(camera_position.x, camera_position.z);
+	std::vector<int> order(cells.size());
+	for (int i = 0; i < (int)cells.size(); i++)
+	{
+		WorldCell& cell = cells[i];
+		const glm::vec2 offset = glm::max(glm::max(cell.min - camera_xz, camera_xz - cell.max), glm::vec2(0.0f));
+		cell.distance = glm::length(offset);
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [this](int a, int b) { return cells[a].distance < cells[b].distance; });
+
+	// Want the cells in reach nearest first, for as long as the sizes they had
+	// the last time they were loaded fit in the budget
+	std::vector<bool> is_wanted(cells.size(), false);
+	size_t wanted_bytes = 0;
+	for (const int i : order)
+	{
+		const WorldCell& cell = cells[i];
+		if (cell.distance > load_radius || (wanted_bytes > 0 && wanted_bytes + cell.memory_size > memory_budget))
+		{
+			break;
+		}
+		wanted_bytes += cell.memory_size;
+		is_wanted[i] = true;
+	}
+
+	// Unload the farthest cells first, once they are past unload_radius or
+	// the meshes no longer fit
+	const float unload_distance = std::max(unload_radius, load_radius);
+	for (auto it = order.rbegin(); it != order.rend(); ++it)
+	{
+		WorldCell& cell = cells[*it];
+		if (cell.state != CELL_UNLOADED && !is_wanted[*it] && (cell.distance > unload_distance || used_bytes > memory_budget))
+		{
+			unload_cell(cell, entities);
+		}
+	}
+
+	for (const int i : order)
+	{
+		WorldCell& cell = cells[i];
+		if (is_wanted[i] && cell.state == CELL_UNLOADED)
+		{
+			for (const int placement : cell.placements)
+			{
+				acquire_asset(placements[placement].filename);
+			}
+			cell.state = CELL_LOADING;
+			num_loading++;
+		}
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include "../Math/Rotator.h"
+#include "../Mesh/AssetLoader.h"
+#include "../Mesh/Texture.h"
+
+struct EntityStore;
+struct Mesh;
+struct VirtualTextureCache;
+
+/** A mesh placed in the world description */
+struct CellPlacement
+{
+	std::string filename;
+	glm::vec3 translation;
+	rot3 rotation;
+	int entity = -1; // hidden while its cell isn't loaded
+};
+
+enum ECellState
+{
+	CELL_UNLOADED,
+	CELL_LOADING,
+	CELL_LOADED,
+};
+
+/** A square of the world on the xz plane, with the placements inside it */
+struct WorldCell
+{
+	glm::vec2 min;
+	glm::vec2 max;
+	std::vector<int> placements;
+	ECellState state = CELL_UNLOADED;
+	size_t memory_size = 0; // of its meshes, known once it has loaded once
+	float distance = 0.0f; // from the camera on the xz plane, at the last update
+};
+
+/** A mesh used by the loaded cells, shared between all of its placements */
+struct StreamedAsset
+{
+	int handle = -1;
+	EAssetState state = ASSET_LOADING;
+	std::unique_ptr<Mesh> mesh; // null until loaded, or if loading failed
+	size_t memory_size = 0;
+	int users = 0; // loading or loaded cells
+};
+
+/**
+ * Streams a world described by a text file in and out around the camera. The
+ * file lists the meshes of the world one per line:
+ *
+ *     cell_size <units>
+ *     mesh <OBJ file> <x> <y> <z> [<pitch> <yaw> <roll>]
+ *
+ * The placements are grouped into square cells on the xz plane. Every
+ * placement gets a hidden entity up front. Cells closer to the camera than
+ * load_radius have their meshes loaded on the asset loading threads, and
+ * their entities show once all of them are in. Loaded cells are only unloaded
+ * again past unload_radius, so a camera moving along the edge of load_radius
+ * doesn't keep loading and unloading the same cells. Meshes are freed as soon
+ * as no loaded cell uses them anymore.
+ *
+ * memory_budget bounds the meshes of the loaded cells. Cells are wanted
+ * nearest first until the sizes they had when last loaded fill the budget,
+ * and when the budget is exceeded the farthest cells that aren't wanted are
+ * unloaded first
+ */
+struct WorldStreamer
+{
+	/**
+	 * Reads the world description and starts num_threads loading threads,
+	 * returns false if the file can't be read
+	 */
+	bool load(const char* filename_, int num_threads);
+	void destroy();
+
+	/** Creates the hidden entities of the placements, once after load() */
+	void create_entities(EntityStore& entities);
+
+	/** Must be called between frames */
+	void update(glm::vec3 camera_position, EntityStore& entities, VirtualTextureCache& virtual_textures);
+
+	void acquire_asset(const std::string& filename);
+	void release_asset(const std::string& filename);
+	void unload_cell(WorldCell& cell, EntityStore& entities);
+
+	float cell_size = 50.0f;
+	float load_radius = 100.0f;
+	float unload_radius = 150.0f; // hysteresis, kept above load_radius
+	size_t memory_budget = (size_t)256 << 20;
+	TextureLoadOptions texture_options;
+
+	// Statistics
+	int num_loaded = 0; // cells
+	int num_loading = 0;
+	size_t used_bytes = 0; // meshes alive right now
+
+	std::string filename;
+	std::vector<CellPlacement> placements;
+	std::vector<WorldCell> cells;
+	std::unordered_map<std::string, StreamedAsset> assets; // by OBJ file
+	AssetLoader asset_loader;
+};
@@ -18,13 +18,19 @@ int main(int argc, char* args[])
 	//_CrtSetBreakAlloc(863);
 #endif
 
+	int exit_code;
 	// Need to put braces here to contain the scope!
 	{
 		Application app;
-		
+		if (!app.parse_arguments(argc, args))
+		{
+			return 1;
+		}
+
 		app.initialize();
 		app.run();
 		app.destroy();
+		exit_code = app.exit_code;
 	}
 
 #ifdef _MSC_VER
@@ -32,5 +38,5 @@ int main(int argc, char* args[])
 	_CrtDumpMemoryLeaks();
 #endif
 
-	return 0;
+	return exit_code;
 }